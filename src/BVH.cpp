@@ -1,11 +1,59 @@
 #include "BVH.h"
 
+#include <algorithm>
+#include <array>
 #include <stack>
 #include <queue>
 
 const BVHNode &BoundingVolumeTree::getNode(int node_index) const
 {
-    return nodes.at(node_index);
+    return nodes[node_index];
+}
+
+bool BoundingVolumeTree::containsObject(int object_index) const
+{
+    return object_index >= 0 && object_index < object2node_indices.size() && object2node_indices[object_index] != -1;
+}
+
+std::size_t BoundingVolumeTree::getObjectCount() const
+{
+    return object_count;
+}
+
+//! \brief takes a node from the free list, the node storage grows only when the free list is empty
+int BoundingVolumeTree::allocateNode()
+{
+    //! we ran out of free node spots, so we double the storage and link the new spots into the free list
+    if (free_list_head == -1)
+    {
+        int old_size = nodes.size();
+        int new_size = 2 * old_size + 1;
+        nodes.resize(new_size);
+        node2object_indices.resize(new_size, -1);
+        for (int i = old_size; i < new_size; ++i)
+        {
+            nodes[i].parent_index = i + 1;
+            nodes[i].height = -1;
+        }
+        nodes[new_size - 1].parent_index = -1;
+        free_list_head = old_size;
+    }
+
+    int node_index = free_list_head;
+    free_list_head = nodes[node_index].parent_index;
+    nodes[node_index] = BVHNode{};
+    node2object_indices[node_index] = -1;
+    return node_index;
+}
+
+void BoundingVolumeTree::freeNode(int node_index)
+{
+    nodes[node_index].child_index_1 = -1;
+    nodes[node_index].child_index_2 = -1;
+    nodes[node_index].parent_index = free_list_head;
+    nodes[node_index].height = -1;
+    node2object_indices[node_index] = -1;
+    free_list_head = node_index;
 }
 
 //! \brief adds new leaf node holding object with index \p object_index
@@ -16,58 +64,55 @@ const BVHNode &BoundingVolumeTree::getNode(int node_index) const
 //! \brief in the new tree each internal node has exactly two children!
 void BoundingVolumeTree::addRect(AABB rect, int object_index)
 {
-    assert(object2node_indices.count(object_index) == 0);
+    assert(!containsObject(object_index));
 
-    //! we ran out of free node spots, so we increase node spots
-    if (free_indices.empty())
+    if (object_index >= object2node_indices.size())
     {
-        for (int i = nodes.size(); i < 2 * nodes.size() + 1; ++i)
-        {
-            free_indices.insert(i);
-        }
-        nodes.resize(2 * nodes.size() + 1);
+        object2node_indices.resize(std::max<std::size_t>(object_index + 1, 2 * object2node_indices.size()), -1);
     }
 
-    int new_parent = *free_indices.begin();
-    free_indices.erase(free_indices.begin());
+    int new_leaf = allocateNode();
+    nodes[new_leaf].rect = rect;
+    node2object_indices[new_leaf] = object_index;
+    object2node_indices[object_index] = new_leaf;
+    object_count++;
+
+    insertLeaf(new_leaf);
+}
 
-    if (object2node_indices.empty()) //! tree is empty
+//! \brief puts the detached leaf \p new_leaf into the tree
+//! \brief creates a new internal node which becomes parent of the leaf and of its best sibling
+void BoundingVolumeTree::insertLeaf(int new_leaf)
+{
+    if (root_ind == -1) //! tree is empty
     {
-        root_ind = 0;
-        object2node_indices[object_index] = root_ind;
-        nodes[new_parent] = {rect, -1, -1, -1, object_index};
+        root_ind = new_leaf;
+        nodes[new_leaf].parent_index = -1;
         return;
     }
 
-    assert(!containsCycle());
-    assert(isConsistent());
-
-    int new_leaf = *free_indices.begin();
-    free_indices.erase(free_indices.begin());
-    assert(object2node_indices.count(object_index) == 0);
-    object2node_indices[object_index] = new_leaf;
-
-    // nodes.push_back(new_node);
+    const auto rect = nodes[new_leaf].rect;
+    int new_parent = allocateNode();
 
     //! find best sibling
     int best_index = findBestSiblingGreedy(rect);
 
-    int old_parent = nodes.at(best_index).parent_index;
-    nodes.at(new_parent).height = nodes.at(best_index).height + 1;
-    nodes.at(new_parent).child_index_1 = best_index;
-    nodes.at(new_parent).child_index_2 = new_leaf;
-    nodes.at(new_parent).parent_index = old_parent;
+    int old_parent = nodes[best_index].parent_index;
+    nodes[new_parent].height = nodes[best_index].height + 1;
+    nodes[new_parent].child_index_1 = best_index;
+    nodes[new_parent].child_index_2 = new_leaf;
+    nodes[new_parent].parent_index = old_parent;
 
     //! fix old parents children
     if (old_parent != -1) //! not a root
     {
-        if (nodes.at(old_parent).child_index_1 == best_index)
+        if (nodes[old_parent].child_index_1 == best_index)
         {
-            nodes.at(old_parent).child_index_1 = new_parent;
+            nodes[old_parent].child_index_1 = new_parent;
         }
         else
         {
-            nodes.at(old_parent).child_index_2 = new_parent;
+            nodes[old_parent].child_index_2 = new_parent;
         }
     }
     else
@@ -75,66 +120,382 @@ void BoundingVolumeTree::addRect(AABB rect, int object_index)
         root_ind = new_parent;
     }
 
-    nodes.at(best_index).parent_index = new_parent;
-    nodes.at(new_leaf).parent_index = new_parent;
-    nodes.at(new_leaf).rect = rect;
-    nodes.at(new_leaf).object_index = object_index;
-    nodes.at(new_parent).rect = makeUnion(nodes.at(best_index).rect, rect);
+    nodes[best_index].parent_index = new_parent;
+    nodes[new_leaf].parent_index = new_parent;
+    nodes[new_parent].rect = makeUnion(nodes[best_index].rect, rect);
 
     //! refit bounding volumes
-    refitFrom(nodes.at(new_leaf).parent_index);
+    refitFrom(nodes[new_leaf].parent_index);
+    //! profit
+}
+
+//! \brief adds many objects at once, object \p object_indices[i] is bound by rectangle \p rects[i]
+//! \brief few objects are added one by one, otherwise the whole tree (old and new leaves)
+//! \brief is rebuilt top-down, which is faster and gives better trees than inserting leaves one by one
+void BoundingVolumeTree::addRects(const std::vector<AABB> &rects, const std::vector<int> &object_indices)
+{
+    assert(rects.size() == object_indices.size());
+
+    if (rects.size() * 8 < object_count)
+    {
+        for (std::size_t i = 0; i < rects.size(); ++i)
+        {
+            addRect(rects[i], object_indices[i]);
+        }
+        return;
+    }
+
+    auto leaves = collectLeaves(rects.size());
+    for (std::size_t i = 0; i < rects.size(); ++i)
+    {
+        assert(!containsObject(object_indices[i]));
+        leaves.push_back({rects[i], object_indices[i]});
+    }
+    rebuildTopDown(leaves);
+
+    assert(!containsCycle());
+    assert(isConsistent());
+}
+
+//! \brief rebuilds the whole tree top-down, which restores its quality after many incremental changes
+void BoundingVolumeTree::rebuild()
+{
+    auto leaves = collectLeaves(0);
+    rebuildTopDown(leaves);
 
     assert(!containsCycle());
     assert(isConsistent());
-    //! profit
+}
+
+//! \brief \returns rects and objects of all leaves in the tree
+//! \param extra_capacity  space reserved for leaves which the caller wants to add
+std::vector<std::pair<AABB, int>> BoundingVolumeTree::collectLeaves(std::size_t extra_capacity) const
+{
+    std::vector<std::pair<AABB, int>> leaves;
+    leaves.reserve(object_count + extra_capacity);
+    for (int object_index = 0; object_index < object2node_indices.size(); ++object_index)
+    {
+        if (object2node_indices[object_index] != -1)
+        {
+            leaves.push_back({nodes[object2node_indices[object_index]].rect, object_index});
+        }
+    }
+    return leaves;
+}
+
+//! \brief measures the tree once per \p quality_settings.check_period calls, should be called once per frame
+//! \brief rebuilds the tree when its internal perimeter per leaf grew too much since the last rebuild
+void BoundingVolumeTree::updateQuality()
+{
+    quality_stats.frame_visited_nodes = visited_nodes;
+    visited_nodes = 0;
+
+    if (++frames_since_check < quality_settings.check_period)
+    {
+        return;
+    }
+    frames_since_check = 0;
+
+    measureQuality();
+    if (!quality_settings.auto_rebuild || object_count < quality_settings.min_object_count)
+    {
+        return;
+    }
+    float perimeter_per_leaf = quality_stats.internal_perimeter / object_count;
+    if (quality_stats.built_perimeter_per_leaf <= 0.f ||
+        perimeter_per_leaf > quality_settings.rebuild_threshold * quality_stats.built_perimeter_per_leaf)
+    {
+        rebuild();
+    }
+}
+
+void BoundingVolumeTree::measureQuality()
+{
+    quality_stats.internal_perimeter = 0.f;
+    quality_stats.max_depth = 0;
+    if (root_ind == -1)
+    {
+        return;
+    }
+    for (int node_index = 0; node_index < nodes.size(); ++node_index)
+    {
+        const auto &node = nodes[node_index];
+        if (node.height > 0) //! free nodes have height -1 and leaves 0
+        {
+            quality_stats.internal_perimeter += node.rect.perimeter();
+        }
+    }
+    quality_stats.max_depth = calcMaxDepth();
+}
+
+const BVHQualityStats &BoundingVolumeTree::getQualityStats() const
+{
+    return quality_stats;
+}
+
+//! \brief throws away all nodes and builds the tree from \p leaves
+void BoundingVolumeTree::rebuildTopDown(std::vector<std::pair<AABB, int>> &leaves)
+{
+    clear();
+    if (leaves.empty())
+    {
+        return;
+    }
+
+    int max_object_index = 0;
+    for (const auto &leaf : leaves)
+    {
+        max_object_index = std::max(max_object_index, leaf.second);
+    }
+    if (max_object_index >= object2node_indices.size())
+    {
+        object2node_indices.resize(max_object_index + 1, -1);
+    }
+    object_count = leaves.size();
+    root_ind = buildSubtree(leaves, 0, leaves.size(), -1);
+
+    measureQuality();
+    quality_stats.built_perimeter_per_leaf = quality_stats.internal_perimeter / object_count;
+    quality_stats.rebuild_count++;
+}
+
+//! \brief builds subtree over leaves in range [\p begin, \p end)
+//! \brief leaves are split along the longer side of the box bounding their centers
+//! \brief the split is chosen by binned surface area heuristic (in 2D perimeter is the surface)
+//! \returns index of the root node of the subtree
+int BoundingVolumeTree::buildSubtree(std::vector<std::pair<AABB, int>> &leaves,
+                                     std::size_t begin, std::size_t end, int parent_index)
+{
+    int node_index = allocateNode();
+    nodes[node_index].parent_index = parent_index;
+
+    if (end - begin == 1)
+    {
+        auto [rect, object_index] = leaves[begin];
+        nodes[node_index].rect = rect;
+        node2object_indices[node_index] = object_index;
+        object2node_indices[object_index] = node_index;
+        return node_index;
+    }
+
+    AABB centers_rect = {leaves[begin].first.getCenter(), leaves[begin].first.getCenter()};
+    for (std::size_t i = begin + 1; i < end; ++i)
+    {
+        auto center = leaves[i].first.getCenter();
+        centers_rect = makeUnion(centers_rect, {center, center});
+    }
+    bool split_in_x = centers_rect.getSize().x >= centers_rect.getSize().y;
+    auto axisCoord = [split_in_x](utils::Vector2f r)
+    {
+        return split_in_x ? r.x : r.y;
+    };
+
+    auto mid = begin + (end - begin) / 2;
+    float extent = axisCoord(centers_rect.getSize());
+    if (extent > 0.f)
+    {
+        constexpr int n_bins = 12;
+        struct Bin
+        {
+            AABB rect;
+            int count = 0;
+        };
+        std::array<Bin, n_bins> bins;
+        float min_coord = axisCoord(centers_rect.r_min);
+        auto binOf = [&](const AABB &rect)
+        {
+            int bin_ind = n_bins * (axisCoord(rect.getCenter()) - min_coord) / extent;
+            return std::min(bin_ind, n_bins - 1);
+        };
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            auto &bin = bins[binOf(leaves[i].first)];
+            bin.rect = bin.count == 0 ? leaves[i].first : makeUnion(bin.rect, leaves[i].first);
+            bin.count++;
+        }
+
+        //! cost of putting bins [split, n_bins) to the right child
+        std::array<float, n_bins> right_costs;
+        AABB right_rect;
+        int right_count = 0;
+        for (int split = n_bins - 1; split > 0; --split)
+        {
+            if (bins[split].count > 0)
+            {
+                right_rect = right_count == 0 ? bins[split].rect : makeUnion(right_rect, bins[split].rect);
+                right_count += bins[split].count;
+            }
+            right_costs[split] = right_count * (right_count > 0 ? right_rect.perimeter() : 0.f);
+        }
+
+        float best_cost = std::numeric_limits<float>::max();
+        int best_split = -1;
+        AABB left_rect;
+        int left_count = 0;
+        for (int split = 1; split < n_bins; ++split)
+        {
+            const auto &bin = bins[split - 1];
+            if (bin.count > 0)
+            {
+                left_rect = left_count == 0 ? bin.rect : makeUnion(left_rect, bin.rect);
+                left_count += bin.count;
+            }
+            bool both_sides_filled = left_count > 0 && left_count < end - begin;
+            float cost = left_count * (left_count > 0 ? left_rect.perimeter() : 0.f) + right_costs[split];
+            if (both_sides_filled && cost < best_cost)
+            {
+                best_cost = cost;
+                best_split = split;
+            }
+        }
+
+        if (best_split != -1)
+        {
+            auto mid_it = std::partition(leaves.begin() + begin, leaves.begin() + end,
+                                         [&](const auto &leaf)
+                                         { return binOf(leaf.first) < best_split; });
+            mid = mid_it - leaves.begin();
+        }
+    }
+    if (extent <= 0.f || mid == begin || mid == end)
+    { //! all centers are in one bin so we just split in half
+        mid = begin + (end - begin) / 2;
+        std::nth_element(leaves.begin() + begin, leaves.begin() + mid, leaves.begin() + end,
+                         [&](const auto &leaf_a, const auto &leaf_b)
+                         { return axisCoord(leaf_a.first.getCenter()) < axisCoord(leaf_b.first.getCenter()); });
+    }
+
+    int child_1 = buildSubtree(leaves, begin, mid, node_index);
+    int child_2 = buildSubtree(leaves, mid, end, node_index);
+
+    auto &node = nodes[node_index];
+    node.child_index_1 = child_1;
+    node.child_index_2 = child_2;
+    node.rect = makeUnion(nodes[child_1].rect, nodes[child_2].rect);
+    node.height = 1 + std::max(nodes[child_1].height, nodes[child_2].height);
+    return node_index;
 }
 
 //! \brief removes object with \p object_index from the tree
 //! \brief the object must be present in the tree!
 void BoundingVolumeTree::removeObject(int object_index)
 {
-    assert(object2node_indices.count(object_index) > 0);
+    assert(containsObject(object_index));
 
-    auto leaf_index = object2node_indices.at(object_index);
+    auto leaf_index = object2node_indices[object_index];
 
     removeLeaf(leaf_index);
-    object2node_indices.erase(object_index);
+    freeNode(leaf_index);
+    object2node_indices[object_index] = -1;
+    object_count--;
+}
+
+//! \brief changes bounding rect of object \p object_index to \p new_rect
+//! \brief the leaf is reinserted in place, so no nodes are allocated or freed
+void BoundingVolumeTree::moveObject(int object_index, AABB new_rect)
+{
+    assert(containsObject(object_index));
+
+    auto leaf_index = object2node_indices[object_index];
+    removeLeaf(leaf_index);
+    nodes[leaf_index].rect = new_rect;
+    insertLeaf(leaf_index);
+}
+
+//! \brief changes bounding rect of object \p object_index without changing the structure of the tree
+//! \brief this is possible only when \p new_rect stays inside the parent of the leaf, ancestors are then only shrunk
+//! \returns true if the rect was changed, otherwise the object has to be moved by moveObject
+bool BoundingVolumeTree::moveObjectInPlace(int object_index, AABB new_rect)
+{
+    assert(containsObject(object_index));
+
+    auto leaf_index = object2node_indices[object_index];
+    auto parent_index = nodes[leaf_index].parent_index;
+    if (parent_index != -1 && !contains(nodes[parent_index].rect, new_rect))
+    {
+        return false;
+    }
+
+    nodes[leaf_index].rect = new_rect;
+    //! ancestors can only get smaller so we stop at the first one which did not change
+    for (int node_index = parent_index; node_index != -1; node_index = nodes[node_index].parent_index)
+    {
+        auto &node = nodes[node_index];
+        auto refitted_rect = makeUnion(nodes[node.child_index_1].rect, nodes[node.child_index_2].rect);
+        if (refitted_rect.perimeter() == node.rect.perimeter())
+        {
+            break;
+        }
+        node.rect = refitted_rect;
+    }
+    return true;
+}
+
+//! \brief removes all objects in \p object_indices from the tree
+//! \brief when a large part of the tree goes away, leaves are only detached
+//! \brief and the whole tree is refitted once at the end instead of after each removal
+void BoundingVolumeTree::removeObjects(const std::vector<int> &object_indices)
+{
+    //! removing few objects one by one is cheaper than refitting everything
+    if (object_indices.size() * 8 < object_count)
+    {
+        for (auto object_index : object_indices)
+        {
+            removeObject(object_index);
+        }
+        return;
+    }
+
+    for (auto object_index : object_indices)
+    {
+        assert(containsObject(object_index));
+        auto leaf_index = object2node_indices[object_index];
+        detachLeaf(leaf_index);
+        freeNode(leaf_index);
+        object2node_indices[object_index] = -1;
+    }
+    object_count -= object_indices.size();
+    refitAll();
     assert(!containsCycle());
     assert(isConsistent());
-    // std::cout << "max balance is: " << calcMaxDepth() << "\n";
 }
 
-//! \brief removes leaf with node index \p leaf index
+//! \brief takes leaf with node index \p leaf index out of the tree, the leaf node itself is not freed
 //! \brief does necessary bookeeping and refits the bounding volumes
 void BoundingVolumeTree::removeLeaf(int leaf_index)
 {
+    refitFrom(detachLeaf(leaf_index));
+}
 
-    assert(nodes.at(leaf_index).isLeaf());
+//! \brief takes leaf with node index \p leaf_index and its parent out of the tree
+//! \brief the sibling of the leaf takes place of the parent, which is freed
+//! \returns index of the node from which the bounding volumes need refitting (-1 if none)
+int BoundingVolumeTree::detachLeaf(int leaf_index)
+{
+
+    assert(nodes[leaf_index].isLeaf());
     if (leaf_index == root_ind) //! there is just one leaf thus it is root
     {
-        free_indices.insert(leaf_index);
         root_ind = -1;
-        return;
+        return -1;
     }
 
-    const auto &removed_leaf_node = nodes.at(leaf_index);
+    const auto &removed_leaf_node = nodes[leaf_index];
     const auto removed_internal_index = removed_leaf_node.parent_index;
-    const auto &removed_internal_node = nodes.at(removed_internal_index);
+    const auto &removed_internal_node = nodes[removed_internal_index];
 
-    bool is_left = true;
     auto sibling_index = removed_internal_node.child_index_2;
     if (leaf_index == removed_internal_node.child_index_2)
     {
-        is_left = false;
         sibling_index = removed_internal_node.child_index_1;
     }
-    auto &sibling_node = nodes.at(sibling_index);
+    auto &sibling_node = nodes[sibling_index];
 
     if (removed_internal_node.parent_index != -1)
     {
         sibling_node.parent_index = removed_internal_node.parent_index;
 
-        auto &internal_parent = nodes.at(removed_internal_node.parent_index);
+        auto &internal_parent = nodes[removed_internal_node.parent_index];
 
         if (internal_parent.child_index_1 == removed_internal_index)
         {
@@ -144,8 +505,8 @@ void BoundingVolumeTree::removeLeaf(int leaf_index)
         {
             internal_parent.child_index_2 = sibling_index;
         }
-        const auto &child1 = nodes.at(internal_parent.child_index_1);
-        const auto &child2 = nodes.at(internal_parent.child_index_2);
+        const auto &child1 = nodes[internal_parent.child_index_1];
+        const auto &child2 = nodes[internal_parent.child_index_2];
         internal_parent.rect = makeUnion(child1.rect, child2.rect);
         internal_parent.height = 1 + std::max(child1.height, child2.height);
     }
@@ -156,21 +517,10 @@ void BoundingVolumeTree::removeLeaf(int leaf_index)
     }
 
     //! deactivate removed node
-    free_indices.insert(leaf_index);
-    free_indices.insert(removed_internal_index);
-    nodes.at(leaf_index).child_index_1 = -1;
-    nodes.at(leaf_index).child_index_2 = -1;
-    nodes.at(leaf_index).parent_index = -1;
-    nodes.at(leaf_index).height = 0;
-    if (removed_internal_index != -1)
-    {
-        nodes.at(removed_internal_index).child_index_1 = -1;
-        nodes.at(removed_internal_index).child_index_2 = -1;
-        nodes.at(removed_internal_index).parent_index = -1; //! refit volumes for ancenstors
-        nodes.at(removed_internal_index).height = 0;
-    }
+    freeNode(removed_internal_index);
+    nodes[leaf_index].parent_index = -1;
 
-    refitFrom(sibling_node.parent_index);
+    return sibling_node.parent_index;
 }
 
 //! \brief refits bounding volumes of all parent nodes nodes
@@ -182,13 +532,47 @@ void BoundingVolumeTree::refitFrom(int starting_node_index)
     {
         current_index = balance(current_index);
 
-        auto &current_node = nodes.at(current_index);
-        const auto &child_1 = nodes.at(current_node.child_index_1);
-        const auto &child_2 = nodes.at(current_node.child_index_2);
+        auto &current_node = nodes[current_index];
+        const auto &child_1 = nodes[current_node.child_index_1];
+        const auto &child_2 = nodes[current_node.child_index_2];
         current_node.rect = makeUnion(child_1.rect, child_2.rect);
         current_node.height = 1 + std::max(child_1.height, child_2.height);
 
-        current_index = nodes.at(current_index).parent_index;
+        current_index = nodes[current_index].parent_index;
+    }
+}
+
+//! \brief recomputes bounding volumes and heights of all internal nodes, children before parents
+void BoundingVolumeTree::refitAll()
+{
+    if (root_ind == -1)
+    {
+        return;
+    }
+
+    //! parents are always before their children in this list
+    std::vector<int> top_down_order = {root_ind};
+    top_down_order.reserve(nodes.size());
+    for (std::size_t i = 0; i < top_down_order.size(); ++i)
+    {
+        const auto &node = nodes[top_down_order[i]];
+        if (!node.isLeaf())
+        {
+            top_down_order.push_back(node.child_index_1);
+            top_down_order.push_back(node.child_index_2);
+        }
+    }
+
+    for (auto it = top_down_order.rbegin(); it != top_down_order.rend(); ++it)
+    {
+        auto &node = nodes[*it];
+        if (!node.isLeaf())
+        {
+            const auto &child_1 = nodes[node.child_index_1];
+            const auto &child_2 = nodes[node.child_index_2];
+            node.rect = makeUnion(child_1.rect, child_2.rect);
+            node.height = 1 + std::max(child_1.height, child_2.height);
+        }
     }
 }
 
@@ -199,12 +583,12 @@ int BoundingVolumeTree::findBestSibling(const AABB &new_rect)
 {
     auto calcCostChange = [&new_rect, this](int node_index)
     {
-        return makeUnion(nodes.at(node_index).rect, new_rect).volume() - nodes.at(node_index).rect.volume();
+        return makeUnion(nodes[node_index].rect, new_rect).volume() - nodes[node_index].rect.volume();
     };
 
     int best_index = root_ind;
     auto current_index = root_ind;
-    float insertion_cost = makeUnion(nodes.at(root_ind).rect, new_rect).volume();
+    float insertion_cost = makeUnion(nodes[root_ind].rect, new_rect).volume();
 
     std::vector<std::pair<int, float>> to_visit;
     std::priority_queue pq(to_visit.begin(), to_visit.end(), [](const auto &p1, const auto &p2)
@@ -218,15 +602,15 @@ int BoundingVolumeTree::findBestSibling(const AABB &new_rect)
         auto current_index = pq.top().first;
         auto cumulated_cost = pq.top().second;
         pq.pop();
-        auto current_cost = makeUnion(nodes.at(current_index).rect, new_rect).volume();
+        auto current_cost = makeUnion(nodes[current_index].rect, new_rect).volume();
 
-        auto child1 = nodes.at(current_index).child_index_1;
-        auto child2 = nodes.at(current_index).child_index_2;
+        auto child1 = nodes[current_index].child_index_1;
+        auto child2 = nodes[current_index].child_index_2;
 
         //! cost of changing current node
         auto cost_of_exchange = current_cost + cumulated_cost;
 
-        cumulated_cost += current_cost - nodes.at(current_index).rect.volume();
+        cumulated_cost += current_cost - nodes[current_index].rect.volume();
 
         if (cost_of_exchange < best_cost)
         {
@@ -256,45 +640,45 @@ int BoundingVolumeTree::findBestSiblingGreedy(const AABB &new_rect)
 {
     auto calcCostChange = [&new_rect, this](int node_index)
     {
-        return makeUnion(nodes.at(node_index).rect, new_rect).volume() - nodes.at(node_index).rect.volume();
+        return makeUnion(nodes[node_index].rect, new_rect).volume() - nodes[node_index].rect.volume();
     };
 
     int current_index = root_ind;
-    while (!nodes.at(current_index).isLeaf())
+    while (!nodes[current_index].isLeaf())
     {
-        auto current_cost = makeUnion(nodes.at(current_index).rect, new_rect).volume();
-        auto combined_vol = makeUnion(nodes.at(current_index).rect, new_rect).volume();
-        float vol = nodes.at(current_index).rect.volume();
+        auto current_cost = makeUnion(nodes[current_index].rect, new_rect).volume();
+        auto combined_vol = makeUnion(nodes[current_index].rect, new_rect).volume();
+        float vol = nodes[current_index].rect.volume();
         float cumulated_cost = (combined_vol - vol);
         float cost = combined_vol;
 
-        auto child1 = nodes.at(current_index).child_index_1;
-        auto child2 = nodes.at(current_index).child_index_2;
+        auto child1 = nodes[current_index].child_index_1;
+        auto child2 = nodes[current_index].child_index_2;
 
         //! cost of changing current node
         auto cost_of_exchange = current_cost + cumulated_cost;
 
         float cost_1;
-        auto new_vol = makeUnion(nodes.at(child1).rect, new_rect).volume();
-        if (!nodes.at(child1).isLeaf())
+        auto new_vol = makeUnion(nodes[child1].rect, new_rect).volume();
+        if (!nodes[child1].isLeaf())
         {
             cost_1 = new_vol + cumulated_cost;
         }
         else
         {
-            auto old_vol = nodes.at(child1).rect.volume();
+            auto old_vol = nodes[child1].rect.volume();
             cost_1 = new_vol - old_vol + cumulated_cost;
         }
 
         float cost_2;
-        new_vol = makeUnion(nodes.at(child2).rect, new_rect).volume();
-        if (!nodes.at(child2).isLeaf())
+        new_vol = makeUnion(nodes[child2].rect, new_rect).volume();
+        if (!nodes[child2].isLeaf())
         {
             cost_2 = new_vol + cumulated_cost;
         }
         else
         {
-            auto old_vol = nodes.at(child2).rect.volume();
+            auto old_vol = nodes[child2].rect.volume();
             cost_2 = new_vol - old_vol + cumulated_cost;
         }
         if (cost < cost_1 && cost < cost_2)
@@ -315,7 +699,7 @@ int BoundingVolumeTree::findBestSiblingGreedy(const AABB &new_rect)
 
 bool BoundingVolumeTree::isLeaf(int node_index) const
 {
-    return nodes.at(node_index).child_index_1 == -1 && nodes.at(node_index).child_index_2 == -1;
+    return nodes[node_index].child_index_1 == -1 && nodes[node_index].child_index_2 == -1;
 }
 
 //! \brief checks if tree contains cycles thus not being a tree (good for debugging)
@@ -337,44 +721,54 @@ bool BoundingVolumeTree::containsCycle() const
             return true;
         }
         visited[current] = true;
-        if (nodes.at(current).child_index_1 != -1)
+        if (nodes[current].child_index_1 != -1)
         {
-            to_visit.push(nodes.at(current).child_index_1);
-            to_visit.push(nodes.at(current).child_index_2);
+            to_visit.push(nodes[current].child_index_1);
+            to_visit.push(nodes[current].child_index_2);
         }
     }
     return false;
 }
 
 //! \brief for every node checks if the child of the node has parent that is the node
+//! \brief and that leaves and objects point at each other
 bool BoundingVolumeTree::isConsistent() const
 {
-    if(root_ind == -1)
+    if (root_ind == -1)
     {
-        return true;
+        return object_count == 0;
+    }
+    if (nodes[root_ind].parent_index != -1)
+    {
+        return false;
     }
-    std::vector<bool> visited(nodes.size(), false);
-    std::stack<int> to_visit;
-    to_visit.push(root_ind);
 
-    for (auto &[entity_ind, node_ind] : object2node_indices)
+    std::size_t leaf_count = 0;
+    std::vector<int> to_visit = {root_ind};
+    while (!to_visit.empty())
     {
-        if (nodes.at(node_ind).child_index_1 != -1)
-        {
-            return node_ind != nodes.at(nodes.at(node_ind).child_index_1).parent_index;
-        }
-        if (nodes.at(node_ind).child_index_2 != -1)
+        auto node_ind = to_visit.back();
+        to_visit.pop_back();
+        const auto &node = nodes[node_ind];
+        if (node.isLeaf())
         {
-            return node_ind != nodes.at(nodes.at(node_ind).child_index_2).parent_index;
+            leaf_count++;
+            auto object_index = node2object_indices[node_ind];
+            if (object_index == -1 || object2node_indices[object_index] != node_ind)
+            {
+                return false;
+            }
+            continue;
         }
-
-        if (nodes.at(node_ind).parent_index == -1 && root_ind != node_ind)
+        if (nodes[node.child_index_1].parent_index != node_ind || nodes[node.child_index_2].parent_index != node_ind)
         {
             return false;
         }
+        to_visit.push_back(node.child_index_1);
+        to_visit.push_back(node.child_index_2);
     }
 
-    return true;
+    return leaf_count == object_count;
 }
 
 //! \brief does tree rotation on subtree at node_index \p index_a
@@ -385,18 +779,18 @@ int BoundingVolumeTree::balance(int index_a)
 
     assert(index_a != -1);
 
-    auto &node_a = nodes.at(index_a);
+    auto &node_a = nodes[index_a];
     if (node_a.isLeaf() || node_a.height <= 1)
     {
         return index_a;
     }
 
-    auto index_b = nodes.at(index_a).child_index_1;
-    auto index_c = nodes.at(index_a).child_index_2;
-    auto &node_c = nodes.at(index_c);
-    auto &node_b = nodes.at(index_b);
+    auto index_b = nodes[index_a].child_index_1;
+    auto index_c = nodes[index_a].child_index_2;
+    auto &node_c = nodes[index_c];
+    auto &node_b = nodes[index_b];
 
-    auto root_node_height = nodes.at(root_ind).height;
+    auto root_node_height = nodes[root_ind].height;
     auto height_diff = node_c.height - node_b.height;
     if (height_diff > 1)
     { //! C is higher so it needs to move closer to root
@@ -436,9 +830,9 @@ int BoundingVolumeTree::balance(int index_a)
 void BoundingVolumeTree::moveNodeUp(int going_up_index)
 {
 
-    auto &node_c = nodes.at(going_up_index);
+    auto &node_c = nodes[going_up_index];
     auto index_a = node_c.parent_index;
-    auto &node_a = nodes.at(index_a);
+    auto &node_a = nodes[index_a];
 
     bool switched = false;
     int index_b = node_a.child_index_1;
@@ -447,13 +841,13 @@ void BoundingVolumeTree::moveNodeUp(int going_up_index)
         index_b = node_a.child_index_2;
         switched = true;
     }
-    auto &node_b = nodes.at(index_b);
+    auto &node_b = nodes[index_b];
 
     auto index_c1 = node_c.child_index_1;
     auto index_c2 = node_c.child_index_2;
 
-    auto &node_c1 = nodes.at(index_c1);
-    auto &node_c2 = nodes.at(index_c2);
+    auto &node_c1 = nodes[index_c1];
+    auto &node_c2 = nodes[index_c2];
 
     node_c.parent_index = node_a.parent_index;
     node_a.parent_index = going_up_index;
@@ -461,13 +855,13 @@ void BoundingVolumeTree::moveNodeUp(int going_up_index)
 
     if (node_c.parent_index != -1) //! tell As old parent that he has a new kid
     {
-        if (nodes.at(node_c.parent_index).child_index_1 == index_a)
+        if (nodes[node_c.parent_index].child_index_1 == index_a)
         {
-            nodes.at(node_c.parent_index).child_index_1 = going_up_index;
+            nodes[node_c.parent_index].child_index_1 = going_up_index;
         }
         else
         {
-            nodes.at(node_c.parent_index).child_index_2 = going_up_index;
+            nodes[node_c.parent_index].child_index_2 = going_up_index;
         }
     }
     else
@@ -518,41 +912,46 @@ void BoundingVolumeTree::moveNodeUp(int going_up_index)
 std::vector<int> BoundingVolumeTree::findIntersectingLeaves(AABB rect) const
 {
     std::vector<int> intersecting_leaves;
-    if (object2node_indices.empty()) //! if there are no objects there can be no intersections
-    {
-        return {};
-    }
+    findIntersectingLeaves(rect, intersecting_leaves);
+    return intersecting_leaves;
+}
 
-    std::stack<int> to_visit;
-    auto &current_node = nodes.at(root_ind);
-    to_visit.push(root_ind);
-    while (!to_visit.empty())
+//! \brief appends object indices that intersect a given \p rect to \p intersecting_leaves
+void BoundingVolumeTree::findIntersectingLeaves(const AABB &rect, std::vector<int> &intersecting_leaves) const
+{
+    forEachIntersecting(rect, [&intersecting_leaves](int object_index)
+                        { intersecting_leaves.push_back(object_index); });
+}
+
+//! \brief orders \p rects by Morton code of their centers inside the root rect, the result is in batch_order
+void BoundingVolumeTree::sortQueriesByMortonCode(const std::vector<AABB> &rects) const
+{
+    //! spreads lower 16 bits of \p x so that there is a zero bit between each two bits
+    auto spreadBits = [](std::uint32_t x)
     {
-        auto current_index = to_visit.top();
-        to_visit.pop();
-        const auto &current_node = nodes.at(current_index);
-        if (intersects(rect, current_node.rect))
-        {
+        x &= 0x0000ffff;
+        x = (x | (x << 8)) & 0x00ff00ff;
+        x = (x | (x << 4)) & 0x0f0f0f0f;
+        x = (x | (x << 2)) & 0x33333333;
+        x = (x | (x << 1)) & 0x55555555;
+        return x;
+    };
 
-            if (current_node.child_index_1 != -1)
-            {
-                to_visit.push(current_node.child_index_1);
-            }
-            if (current_node.child_index_2 != -1)
-            {
-                to_visit.push(current_node.child_index_2);
-            }
+    const auto &bounds = nodes[root_ind].rect;
+    auto size = bounds.getSize();
+    utils::Vector2f scale = {size.x > 0.f ? 65535.f / size.x : 0.f, size.y > 0.f ? 65535.f / size.y : 0.f};
 
-            if (current_node.isLeaf())
-            {
-                assert(current_node.object_index != -1);
-                assert(object2node_indices.at(current_node.object_index) == current_index);
-                intersecting_leaves.push_back(current_node.object_index);
-            }
-        }
+    batch_order.clear();
+    batch_order.reserve(rects.size());
+    for (int query_index = 0; query_index < rects.size(); ++query_index)
+    {
+        auto center = rects[query_index].getCenter();
+        float x = std::clamp((center.x - bounds.r_min.x) * scale.x, 0.f, 65535.f);
+        float y = std::clamp((center.y - bounds.r_min.y) * scale.y, 0.f, 65535.f);
+        std::uint32_t code = spreadBits(static_cast<std::uint32_t>(x)) | (spreadBits(static_cast<std::uint32_t>(y)) << 1);
+        batch_order.push_back({code, query_index});
     }
-
-    return intersecting_leaves;
+    std::sort(batch_order.begin(), batch_order.end());
 }
 
 int BoundingVolumeTree::calcMaxDepth() const
@@ -570,16 +969,16 @@ int BoundingVolumeTree::calcMaxDepth() const
         {
             max_lvl = lvl;
         }
-        auto &current = nodes.at(current_index);
+        auto &current = nodes[current_index];
         if (!current.isLeaf())
         {
-            auto &child1 = nodes.at(current.child_index_1);
-            auto &child2 = nodes.at(current.child_index_2);
+            auto &child1 = nodes[current.child_index_1];
+            auto &child2 = nodes[current.child_index_2];
             to_visit.push({current.child_index_1, lvl + 1});
             to_visit.push({current.child_index_2, lvl + 1});
         }
     }
-    assert(max_lvl == nodes.at(root_ind).height);
+    assert(max_lvl == nodes[root_ind].height);
     return max_lvl;
 }
 
@@ -588,7 +987,7 @@ int BoundingVolumeTree::calcMaxDepth() const
 //! \param to end point of the segment
 //! \param rect
 //! \returns true if there is an intersection
-bool BoundingVolumeTree::intersectsLine(utils::Vector2f from, utils::Vector2f to, AABB rect)
+bool BoundingVolumeTree::intersectsLine(utils::Vector2f from, utils::Vector2f to, AABB rect) const
 {
 
     auto dr = to - from;
@@ -613,48 +1012,35 @@ bool BoundingVolumeTree::intersectsLine(utils::Vector2f from, utils::Vector2f to
 //! \returns list of object indices
 std::vector<int> BoundingVolumeTree::rayCast(utils::Vector2f from, utils::Vector2f dir, float length)
 {
-
-    if (root_ind == -1) //! empty trees have nothing
-    {
-        return {};
-    }
-
-    utils::Vector2f to = from + dir * length;
     std::vector<int> intersections;
-
-    std::queue<int> to_visit;
-    to_visit.push(root_ind);
-    while (!to_visit.empty())
-    {
-
-        int current_ind = to_visit.front();
-        to_visit.pop();
-        auto &current = nodes.at(current_ind);
-
-        if (intersectsLine(from, to, current.rect))
-        {
-            if (!current.isLeaf())
-            {
-                to_visit.push(current.child_index_1);
-                to_visit.push(current.child_index_2);
-            }
-            else
-            {
-                intersections.push_back(current.object_index);
-            }
-        }
-    }
-
+    rayCast(from, dir, length, intersections);
     return intersections;
 }
 
+//! \brief appends objects whose bounding rects intersect given segment to \p intersections
+void BoundingVolumeTree::rayCast(utils::Vector2f from, utils::Vector2f dir, float length, std::vector<int> &intersections) const
+{
+    forEachOnLine(from, from + dir * length, [&intersections](int object_index)
+                  { intersections.push_back(object_index); });
+}
+
+//! \brief removes all objects, node storage is kept and all nodes go back to the free list
 void BoundingVolumeTree::clear()
 {
-    object2node_indices.clear();
+    std::fill(object2node_indices.begin(), object2node_indices.end(), -1);
+    std::fill(node2object_indices.begin(), node2object_indices.end(), -1);
     for (int i = 0; i < nodes.size(); ++i)
     {
-        free_indices.insert(i);
+        nodes[i] = BVHNode{};
+        nodes[i].parent_index = i + 1;
+        nodes[i].height = -1;
+    }
+    if (!nodes.empty())
+    {
+        nodes.back().parent_index = -1;
     }
+    free_list_head = nodes.empty() ? -1 : 0;
+    object_count = 0;
     root_ind = -1;
 }
 
@@ -666,12 +1052,12 @@ int BoundingVolumeTree::maxBalanceFactor() const
     to_visit.push(root_ind);
     while (!to_visit.empty())
     {
-        auto &node = nodes.at(to_visit.front());
+        auto &node = nodes[to_visit.front()];
         to_visit.pop();
         if (!node.isLeaf())
         {
-            auto h1 = nodes.at(node.child_index_1).height;
-            auto h2 = nodes.at(node.child_index_2).height;
+            auto h1 = nodes[node.child_index_1].height;
+            auto h2 = nodes[node.child_index_2].height;
             max_balance = std::max(max_balance, std::abs(h1 - h2));
             to_visit.push(node.child_index_1);
             to_visit.push(node.child_index_2);
@@ -686,123 +1072,50 @@ std::vector<std::pair<int, int>> BoundingVolumeTree::findClosePairsWith(Bounding
 {
     std::vector<std::pair<int, int>> close_pairs;
 
-    for (auto &[object_ind, node_ind] : object2node_indices)
+    for (int object_ind = 0; object_ind < object2node_indices.size(); ++object_ind)
     {
-        auto nearest_objects_inds = tree.findIntersectingLeaves(nodes.at(node_ind).rect);
-        for (auto i : nearest_objects_inds)
+        auto node_ind = object2node_indices[object_ind];
+        if (node_ind == -1)
         {
-            if (i == object_ind)
-            {
-                continue;
-            }
-            close_pairs.push_back({object_ind, i});
+            continue;
         }
+        tree.forEachIntersecting(nodes[node_ind].rect, [&close_pairs, object_ind](int other_ind)
+                                 {
+                                     if (other_ind != object_ind)
+                                     {
+                                         close_pairs.push_back({object_ind, other_ind});
+                                     } });
     }
     return close_pairs;
 }
 
-
+//! \brief finds pairs of objects within the tree whose bounding rects intersect
 std::vector<std::pair<int, int>> BoundingVolumeTree::findClosePairsWithin() const
 {
-    if(root_ind == -1)
-    {
-        return {};
-    }
-
-    
     std::vector<std::pair<int, int>> close_pairs;
-    
-    const auto& root = nodes.at(root_ind);
-    if(root.child_index_1 == -1 && root.child_index_2 == -1)
-    {
-        return {};
-    }
-    
-    std::vector<std::pair<int, int>> to_visit = {{root.child_index_1, root.child_index_2}};
-    to_visit.reserve(nodes.size());
-    while(!to_visit.empty())
-    {
-        auto [node_ind_i, node_ind_j] = to_visit.back();
-        to_visit.pop_back();
-
-        const auto& node_i = nodes.at(node_ind_i);
-        const auto& node_j = nodes.at(node_ind_j);
-        
-        if(!intersects(node_i.rect, node_j.rect))
-        {
-            continue;
-        }
-        if(!node_i.isLeaf() && !node_j.isLeaf())
-        {
-            to_visit.emplace_back(node_i.child_index_1, node_j.child_index_1);
-            to_visit.emplace_back(node_i.child_index_1, node_j.child_index_2);
-            to_visit.emplace_back(node_i.child_index_2, node_j.child_index_1);
-            to_visit.emplace_back(node_i.child_index_2, node_j.child_index_2);
-        }else if(!node_i.isLeaf() && node_j.isLeaf())
-        {
-            to_visit.emplace_back(node_i.child_index_1, node_ind_j);
-            to_visit.emplace_back(node_i.child_index_2, node_ind_j);
-        }
-        else if (node_i.isLeaf() && !node_j.isLeaf())
-        {
-            to_visit.emplace_back(node_ind_i, node_j.child_index_1);
-            to_visit.emplace_back(node_ind_i, node_j.child_index_2);
-        }else{
-            close_pairs.emplace_back(node_i.object_index, node_j.object_index);
-        }
-    }
-
+    findClosePairsWithin(close_pairs);
     return close_pairs;
 }
 
+//! \brief appends pairs of objects within the tree whose bounding rects intersect to \p close_pairs
+void BoundingVolumeTree::findClosePairsWithin(std::vector<std::pair<int, int>> &close_pairs) const
+{
+    forEachClosePairWithin([&close_pairs](int object_a, int object_b)
+                           { close_pairs.emplace_back(object_a, object_b); });
+}
+
 //! \brief finds intersectings bounding rectangles accross this and \p tree
 //! \returns list of object indices whose bounding rects intersect
 std::vector<std::pair<int, int>> BoundingVolumeTree::findClosePairsWith2(BoundingVolumeTree &tree) const
 {
     std::vector<std::pair<int, int>> close_pairs;
-
-    if (root_ind == -1 || tree.root_ind == -1)
-    {
-        return {};
-    }
-
-    std::vector<std::pair<int, int>> to_visit = {{root_ind, tree.root_ind}};
-    to_visit.reserve(std::max(tree.nodes.size(), nodes.size()));
-
-    while (!to_visit.empty())
-    {
-        auto [node_ind_i, node_ind_j] = to_visit.back();
-        to_visit.pop_back();
-
-        const auto &node_i = nodes.at(node_ind_i);
-        const auto &node_j = tree.nodes.at(node_ind_j);
-
-        if (!intersects(node_i.rect, node_j.rect))
-        {
-            continue;
-        }
-        if (!node_i.isLeaf() && !node_j.isLeaf())
-        {
-            to_visit.emplace_back(node_i.child_index_1, node_j.child_index_1);
-            to_visit.emplace_back(node_i.child_index_1, node_j.child_index_2);
-            to_visit.emplace_back(node_i.child_index_2, node_j.child_index_1);
-            to_visit.emplace_back(node_i.child_index_2, node_j.child_index_2);
-        }
-        if (!node_i.isLeaf() && node_j.isLeaf())
-        {
-            to_visit.emplace_back(node_i.child_index_1, node_ind_j);
-            to_visit.emplace_back(node_i.child_index_2, node_ind_j);
-        }
-        if (node_i.isLeaf() && !node_j.isLeaf())
-        {
-            to_visit.emplace_back(node_ind_i, node_j.child_index_1);
-            to_visit.emplace_back(node_ind_i, node_j.child_index_2);
-        }
-        if (node_i.isLeaf() && node_j.isLeaf())
-        {
-            close_pairs.push_back({node_i.object_index, node_j.object_index});
-        }
-    }
-
+    findClosePairsWith2(tree, close_pairs);
     return close_pairs;
 }
+
+//! \brief appends pairs of objects accross this and \p tree whose bounding rects intersect to \p close_pairs
+void BoundingVolumeTree::findClosePairsWith2(const BoundingVolumeTree &tree, std::vector<std::pair<int, int>> &close_pairs) const
+{
+    forEachClosePairWith(tree, [&close_pairs](int object_a, int object_b)
+                         { close_pairs.emplace_back(object_a, object_b); });
+}
@@ -1,78 +1,220 @@
 #pragma once
 
-#include <set>
-#include <unordered_map>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
 #include <queue>
 #include <limits>
+#include <utility>
 
 #include "core.h"
 
 
 
+//! \brief hot data of a node packed into 32 bytes, so that two nodes fit into a cache line
+//! \brief objects held by leaves are stored separately in the tree
 struct BVHNode
 {
     AABB rect;
     int child_index_1 = -1;
     int child_index_2 = -1;
-    int parent_index = -1;
-    int object_index = -1;
-    int height = 0;
+    int parent_index = -1; //! for free nodes this is the index of the next free node
+    int height = 0;        //! free nodes have height -1
 
     bool isLeaf() const
     {
-        return child_index_1 == -1 && child_index_2 == -1;
+        return child_index_1 == -1;
     }
 };
+static_assert(sizeof(BVHNode) == 32);
 
+//! \brief stack for tree traversals, lives on the program stack unless the traversal gets unusually deep
+template <class T, std::size_t Capacity>
+class TraversalStack
+{
+public:
+    void push(const T &value)
+    {
+        if (m_size < Capacity)
+        {
+            m_data[m_size] = value;
+        }
+        else
+        {
+            m_overflow.push_back(value);
+        }
+        m_size++;
+    }
+
+    T pop()
+    {
+        assert(m_size > 0);
+        m_size--;
+        if (m_size < Capacity)
+        {
+            return m_data[m_size];
+        }
+        T value = m_overflow.back();
+        m_overflow.pop_back();
+        return value;
+    }
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+private:
+    std::array<T, Capacity> m_data;
+    std::vector<T> m_overflow;
+    std::size_t m_size = 0;
+};
+
+//! \brief nearest hit of a ray, \p entity_ind is -1 if the ray hit nothing
 struct RayCastData
 {
-    int entity_ind;
-    utils::Vector2f hit_point;
-    utils::Vector2f hit_normal;
+    int entity_ind = -1;
+    utils::Vector2f hit_point = {0, 0}; //! end of the ray if nothing was hit
+    utils::Vector2f hit_normal = {0, 0};
+    float distance = 0.f; //! from the start of the ray to the hit point
+};
+
+//! \brief finds where the ray from \p from with inverted direction \p inv_dir enters \p rect
+//! \returns true if it enters before \p max_distance, \p entry_distance is zero for rays starting inside
+bool inline rayHitsRect(utils::Vector2f from, utils::Vector2f inv_dir, float max_distance, const AABB &rect,
+                        float &entry_distance)
+{
+    float t_min = 0.f;
+    float t_max = max_distance;
+    for (int axis = 0; axis < 2; ++axis)
+    {
+        const float origin = axis == 0 ? from.x : from.y;
+        const float inv = axis == 0 ? inv_dir.x : inv_dir.y;
+        const float r_min = axis == 0 ? rect.r_min.x : rect.r_min.y;
+        const float r_max = axis == 0 ? rect.r_max.x : rect.r_max.y;
+        if (std::isinf(inv)) //! ray parallel to the slab
+        {
+            if (origin < r_min || origin > r_max)
+            {
+                return false;
+            }
+            continue;
+        }
+        float t_1 = (r_min - origin) * inv;
+        float t_2 = (r_max - origin) * inv;
+        t_min = std::max(t_min, std::min(t_1, t_2));
+        t_max = std::min(t_max, std::max(t_1, t_2));
+    }
+    entry_distance = t_min;
+    return t_min <= t_max;
+}
+
+//! \brief measures of how good the tree is for queries
+struct BVHQualityStats
+{
+    float internal_perimeter = 0.f;       //! sum of perimeters of internal nodes, query cost grows with it
+    float built_perimeter_per_leaf = 0.f; //! internal perimeter per leaf right after the last rebuild
+    int max_depth = 0;
+    std::size_t rebuild_count = 0;
+    std::size_t frame_visited_nodes = 0; //! nodes visited by queries during the last frame
+};
+
+struct BVHQualitySettings
+{
+    float rebuild_threshold = 1.5f;    //! rebuild when internal perimeter per leaf grows this many times
+    int check_period = 30;             //! quality is measured once per this many frames
+    std::size_t min_object_count = 16; //! smaller trees are never rebuilt
+    bool auto_rebuild = true;
 };
 
 class BoundingVolumeTree
 {
 
     std::vector<BVHNode> nodes;
-    std::unordered_map<int, int> object2node_indices; //! mapping from objects to leaves
-    std::set<int> free_indices;                       //! holds node indices that can be used whe inserting new rect
+    std::vector<int> node2object_indices; //! objects held by leaves, -1 for other nodes
+    std::vector<int> object2node_indices; //! mapping from objects to leaves, -1 for objects not in the tree
+    int free_list_head = -1;              //! first node that can be used when inserting new rect
+    std::size_t object_count = 0;
     int root_ind = -1;
 
+    BVHQualityStats quality_stats;
+    int frames_since_check = 0;
+    mutable std::size_t visited_nodes = 0; //! nodes visited by queries since the last updateQuality(), updated atomically
+    mutable std::vector<std::pair<std::uint32_t, int>> batch_order; //! Morton codes and indices of batched queries
+
 public:
     const BVHNode &getNode(int node_index) const;
 
     void addRect(AABB rect, int object_index);
+    void addRects(const std::vector<AABB> &rects, const std::vector<int> &object_indices);
 
     void removeObject(int object_index);
+    void removeObjects(const std::vector<int> &object_indices);
+    void moveObject(int object_index, AABB new_rect);
+    bool moveObjectInPlace(int object_index, AABB new_rect);
 
-    const auto &getObjects() const
-    {
-        return object2node_indices;
-    }
+    void rebuild();
+    void updateQuality();
+    const BVHQualityStats &getQualityStats() const;
+
+    bool containsObject(int object_index) const;
+    std::size_t getObjectCount() const;
 
+    BVHQualitySettings quality_settings;
 
-    
     std::vector<std::pair<int, int>> findClosePairsWithin() const;
     std::vector<std::pair<int, int>> findClosePairsWith(BoundingVolumeTree &tree) const;
     std::vector<std::pair<int, int>> findClosePairsWith2(BoundingVolumeTree &tree) const;
     std::vector<int> findIntersectingLeaves(AABB rect) const;
 
+    //! queries which append results to caller owned buffers, so that the buffers can be reused between frames
+    void findClosePairsWithin(std::vector<std::pair<int, int>> &close_pairs) const;
+    void findClosePairsWith2(const BoundingVolumeTree &tree, std::vector<std::pair<int, int>> &close_pairs) const;
+    void findIntersectingLeaves(const AABB &rect, std::vector<int> &intersecting_leaves) const;
+    void rayCast(utils::Vector2f from, utils::Vector2f dir, float length, std::vector<int> &intersections) const;
+
+    template <class VisitorT>
+    void forEachIntersecting(const AABB &rect, VisitorT &&visitor) const;
+    template <class VisitorT>
+    void forEachIntersectingBatch(const std::vector<AABB> &rects, VisitorT &&visitor) const;
+    template <class VisitorT>
+    void forEachOnLine(utils::Vector2f from, utils::Vector2f to, VisitorT &&visitor) const;
+    template <class VisitorT>
+    void forEachOnRay(utils::Vector2f from, utils::Vector2f dir, float length, VisitorT &&visitor) const;
+    template <class VisitorT>
+    void forEachClosePairWithin(VisitorT &&visitor) const;
+    template <class VisitorT>
+    void forEachClosePairWith(const BoundingVolumeTree &tree, VisitorT &&visitor) const;
+
     void clear();
 
     const AABB &getObjectRect(int object_ind) const
     {
-        return nodes.at(object2node_indices.at(object_ind)).rect;
+        assert(containsObject(object_ind));
+        return nodes[object2node_indices[object_ind]].rect;
     }
 
     std::vector<int> rayCast(utils::Vector2f from, utils::Vector2f dir, float length);
 
-    bool intersectsLine(utils::Vector2f from, utils::Vector2f to, AABB rect);
+    bool intersectsLine(utils::Vector2f from, utils::Vector2f to, AABB rect) const;
 private:
+    void sortQueriesByMortonCode(const std::vector<AABB> &rects) const;
     int maxBalanceFactor() const;
     bool isLeaf(int node_index) const;
     int balance(int index);
+    int allocateNode();
+    void freeNode(int node_index);
+    void insertLeaf(int leaf_index);
     void removeLeaf(int leaf_index);
+    int detachLeaf(int leaf_index);
+    void refitAll();
+    std::vector<std::pair<AABB, int>> collectLeaves(std::size_t extra_capacity) const;
+    void measureQuality();
+    void rebuildTopDown(std::vector<std::pair<AABB, int>> &leaves);
+    int buildSubtree(std::vector<std::pair<AABB, int>> &leaves, std::size_t begin, std::size_t end, int parent_index);
     int findBestSibling(const AABB &new_rect);
     int findBestSiblingGreedy(const AABB &new_rect);
     bool containsCycle() const;
@@ -80,6 +222,264 @@ private:
     int calcMaxDepth() const;
     void moveNodeUp(int going_up_index);
     void refitFrom(int node_index);
+
+    //! queries may run concurrently from several threads, so the counter is updated atomically
+    void addVisitedNodes(std::size_t count) const
+    {
+        std::atomic_ref<std::size_t>(visited_nodes).fetch_add(count, std::memory_order_relaxed);
+    }
 };
 
+//! \brief calls \p visitor(object_index) for every object whose rect intersects \p rect
+template <class VisitorT>
+void BoundingVolumeTree::forEachIntersecting(const AABB &rect, VisitorT &&visitor) const
+{
+    if (root_ind == -1) //! if there are no objects there can be no intersections
+    {
+        return;
+    }
+
+    TraversalStack<int, 64> to_visit;
+    to_visit.push(root_ind);
+    std::size_t visited = 0;
+    while (!to_visit.empty())
+    {
+        auto current_index = to_visit.pop();
+        visited++;
+        const auto &current_node = nodes[current_index];
+        if (!intersects(rect, current_node.rect))
+        {
+            continue;
+        }
+        if (current_node.isLeaf())
+        {
+            assert(node2object_indices[current_index] != -1);
+            visitor(node2object_indices[current_index]);
+        }
+        else
+        {
+            to_visit.push(current_node.child_index_1);
+            to_visit.push(current_node.child_index_2);
+        }
+    }
+    addVisitedNodes(visited);
+}
 
+//! \brief answers many rect queries at once, calls \p visitor(query_index, object_index) for each intersection
+//! \brief queries run in Morton order of their centers, so that consecutive traversals touch the same nodes
+//! \note uses a buffer owned by the tree, so batches must not run concurrently on one tree
+template <class VisitorT>
+void BoundingVolumeTree::forEachIntersectingBatch(const std::vector<AABB> &rects, VisitorT &&visitor) const
+{
+    if (root_ind == -1)
+    {
+        return;
+    }
+
+    sortQueriesByMortonCode(rects);
+    for (auto [code, query_index] : batch_order)
+    {
+        forEachIntersecting(rects[query_index], [&visitor, query_index](int object_index)
+                            { visitor(query_index, object_index); });
+    }
+}
+
+//! \brief calls \p visitor(object_index) for every object whose rect intersects segment from \p from to \p to
+template <class VisitorT>
+void BoundingVolumeTree::forEachOnLine(utils::Vector2f from, utils::Vector2f to, VisitorT &&visitor) const
+{
+    if (root_ind == -1) //! empty trees have nothing
+    {
+        return;
+    }
+
+    TraversalStack<int, 64> to_visit;
+    to_visit.push(root_ind);
+    std::size_t visited = 0;
+    while (!to_visit.empty())
+    {
+        auto current_ind = to_visit.pop();
+        visited++;
+        const auto &current = nodes[current_ind];
+        if (!intersectsLine(from, to, current.rect))
+        {
+            continue;
+        }
+        if (current.isLeaf())
+        {
+            visitor(node2object_indices[current_ind]);
+        }
+        else
+        {
+            to_visit.push(current.child_index_1);
+            to_visit.push(current.child_index_2);
+        }
+    }
+    addVisitedNodes(visited);
+}
+
+//! \brief calls \p visitor(object_index, entry_distance) for objects whose rects the ray from \p from along unit \p dir
+//! \brief enters within \p length, nearer nodes are visited first
+//! \brief the visitor returns distance of the nearest hit found so far, rects entered farther than that are skipped
+template <class VisitorT>
+void BoundingVolumeTree::forEachOnRay(utils::Vector2f from, utils::Vector2f dir, float length, VisitorT &&visitor) const
+{
+    float root_distance;
+    const utils::Vector2f inv_dir = {1.f / dir.x, 1.f / dir.y};
+    if (root_ind == -1 || !rayHitsRect(from, inv_dir, length, nodes[root_ind].rect, root_distance))
+    {
+        return;
+    }
+
+    TraversalStack<std::pair<int, float>, 64> to_visit;
+    to_visit.push({root_ind, root_distance});
+    std::size_t visited = 0;
+    while (!to_visit.empty())
+    {
+        auto [current_ind, entry_distance] = to_visit.pop();
+        visited++;
+        if (entry_distance > length) //! a nearer hit was found after the node was pushed
+        {
+            continue;
+        }
+        const auto &current = nodes[current_ind];
+        if (current.isLeaf())
+        {
+            length = std::min(length, visitor(node2object_indices[current_ind], entry_distance));
+            continue;
+        }
+
+        float distance_1;
+        float distance_2;
+        bool hits_1 = rayHitsRect(from, inv_dir, length, nodes[current.child_index_1].rect, distance_1);
+        bool hits_2 = rayHitsRect(from, inv_dir, length, nodes[current.child_index_2].rect, distance_2);
+        //! the nearer child is pushed last so that it is popped first
+        if (hits_1 && hits_2 && distance_1 < distance_2)
+        {
+            to_visit.push({current.child_index_2, distance_2});
+            to_visit.push({current.child_index_1, distance_1});
+        }
+        else
+        {
+            if (hits_1)
+            {
+                to_visit.push({current.child_index_1, distance_1});
+            }
+            if (hits_2)
+            {
+                to_visit.push({current.child_index_2, distance_2});
+            }
+        }
+    }
+    addVisitedNodes(visited);
+}
+
+//! \brief calls \p visitor(object_a, object_b) for each pair of objects in the tree whose rects intersect
+//! \brief each pair is visited once
+template <class VisitorT>
+void BoundingVolumeTree::forEachClosePairWithin(VisitorT &&visitor) const
+{
+    if (root_ind == -1)
+    {
+        return;
+    }
+
+    //! pair of the same node stands for pairs within the subtree of that node
+    TraversalStack<std::pair<int, int>, 256> to_visit;
+    to_visit.push({root_ind, root_ind});
+    std::size_t visited = 0;
+    while (!to_visit.empty())
+    {
+        auto [node_ind_i, node_ind_j] = to_visit.pop();
+        visited++;
+
+        const auto &node_i = nodes[node_ind_i];
+        const auto &node_j = nodes[node_ind_j];
+        if (node_ind_i == node_ind_j)
+        {
+            if (!node_i.isLeaf())
+            {
+                to_visit.push({node_i.child_index_1, node_i.child_index_1});
+                to_visit.push({node_i.child_index_2, node_i.child_index_2});
+                to_visit.push({node_i.child_index_1, node_i.child_index_2});
+            }
+            continue;
+        }
+
+        if (!intersects(node_i.rect, node_j.rect))
+        {
+            continue;
+        }
+        if (!node_i.isLeaf() && !node_j.isLeaf())
+        {
+            to_visit.push({node_i.child_index_1, node_j.child_index_1});
+            to_visit.push({node_i.child_index_1, node_j.child_index_2});
+            to_visit.push({node_i.child_index_2, node_j.child_index_1});
+            to_visit.push({node_i.child_index_2, node_j.child_index_2});
+        }
+        else if (!node_i.isLeaf())
+        {
+            to_visit.push({node_i.child_index_1, node_ind_j});
+            to_visit.push({node_i.child_index_2, node_ind_j});
+        }
+        else if (!node_j.isLeaf())
+        {
+            to_visit.push({node_ind_i, node_j.child_index_1});
+            to_visit.push({node_ind_i, node_j.child_index_2});
+        }
+        else
+        {
+            visitor(node2object_indices[node_ind_i], node2object_indices[node_ind_j]);
+        }
+    }
+    addVisitedNodes(visited);
+}
+
+//! \brief calls \p visitor(object_in_this, object_in_tree) for each pair of objects
+//! \brief across this and \p tree whose rects intersect
+template <class VisitorT>
+void BoundingVolumeTree::forEachClosePairWith(const BoundingVolumeTree &tree, VisitorT &&visitor) const
+{
+    if (root_ind == -1 || tree.root_ind == -1)
+    {
+        return;
+    }
+
+    TraversalStack<std::pair<int, int>, 256> to_visit;
+    to_visit.push({root_ind, tree.root_ind});
+    std::size_t visited = 0;
+    while (!to_visit.empty())
+    {
+        auto [node_ind_i, node_ind_j] = to_visit.pop();
+        visited++;
+
+        const auto &node_i = nodes[node_ind_i];
+        const auto &node_j = tree.nodes[node_ind_j];
+        if (!intersects(node_i.rect, node_j.rect))
+        {
+            continue;
+        }
+        if (!node_i.isLeaf() && !node_j.isLeaf())
+        {
+            to_visit.push({node_i.child_index_1, node_j.child_index_1});
+            to_visit.push({node_i.child_index_1, node_j.child_index_2});
+            to_visit.push({node_i.child_index_2, node_j.child_index_1});
+            to_visit.push({node_i.child_index_2, node_j.child_index_2});
+        }
+        else if (!node_i.isLeaf())
+        {
+            to_visit.push({node_i.child_index_1, node_ind_j});
+            to_visit.push({node_i.child_index_2, node_ind_j});
+        }
+        else if (!node_j.isLeaf())
+        {
+            to_visit.push({node_ind_i, node_j.child_index_1});
+            to_visit.push({node_ind_i, node_j.child_index_2});
+        }
+        else
+        {
+            visitor(node2object_indices[node_ind_i], tree.node2object_indices[node_ind_j]);
+        }
+    }
+    addVisitedNodes(visited);
+}
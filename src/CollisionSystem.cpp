@@ -1,144 +1,773 @@
 #include "CollisionSystem.h"
 #include "GameObject.h"
 
+#include <algorithm>
+#include <chrono>
+
 #include "Systems/System.h"
 
 namespace Collisions
 {
 
-    std::vector<std::tuple<GameObject *, GameObject *, CollisionData>> collisions; //! for debugging
+    CollisionSystem::CollisionSystem(PostOffice &messenger, ContiguousColony<CollisionComponent, int> &comps,
+                                     ContiguousColony<PhysicsComponent, int> &bodies, utils::ThreadPool &workers)
+        : m_solver(bodies), p_post_office(&messenger), m_components(comps), m_workers(workers)
+    {
+        messenger.registerEvents<CollisionEventEntities, CollisionEventTypeEntity, CollisionEventTypes,
+                                 ContactBeginEvent, ContactStayEvent, ContactEndEvent>();
+    }
 
-    CollisionSystem::CollisionSystem(PostOffice &messenger, ContiguousColony<CollisionComponent, int> &comps)
-        : p_post_office(&messenger), m_components(comps)
+    //! \brief enlarges \p fitting_rect by a margin and stretches it in the direction of \p vel
+    //! \brief so that moving objects do not leave their rect in the tree every frame
+    AABB CollisionSystem::makeFatRect(AABB fitting_rect, utils::Vector2f vel) const
     {
-        messenger.registerEvents<CollisionEventEntities, CollisionEventTypeEntity, CollisionEventTypes>();
-        //! init the trees
-        for (int i = 0; i < static_cast<int>(ObjectType::Count); ++i)
+        auto margin = fitting_rect.getSize() * (m_fat_rect_settings.margin / 2.f);
+        fitting_rect.r_min = fitting_rect.r_min - margin;
+        fitting_rect.r_max = fitting_rect.r_max + margin;
+
+        auto displacement = vel * m_fat_rect_settings.velocity_lookahead;
+        if (displacement.x < 0.f)
+        {
+            fitting_rect.r_min.x += displacement.x;
+        }
+        else
+        {
+            fitting_rect.r_max.x += displacement.x;
+        }
+        if (displacement.y < 0.f)
+        {
+            fitting_rect.r_min.y += displacement.y;
+        }
+        else
         {
-            m_object_type2tree[static_cast<ObjectType>(i)] = {};
+            fitting_rect.r_max.y += displacement.y;
         }
+        return fitting_rect;
     }
 
     void CollisionSystem::insertObject(GameObject &object)
     {
-        auto bounding_rect = m_components.get(object.getId()).shape.getBoundingRect().inflate(1.5f);
-        m_object_type2tree[object.getType()].addRect(bounding_rect, object.getId());
+        auto &comp = m_components.get(object.getId());
+        comp.previous_position = object.getPosition();
+        comp.motion = {0, 0};
+        setLayers(object.getId(), comp);
+        if (comp.is_static)
+        {
+            //! static colliders enter the static tree together in the next rebuild
+            m_static_ids.push_back(object.getId());
+            m_static_rebuild_requested = true;
+            return;
+        }
+        auto &shape = comp.shape;
+        shape.updateWorldShapes();
+        auto bounding_rect = makeFatRect(shape.getBoundingRect(), object.m_vel);
+        m_tree.addRect(bounding_rect, object.getId());
+        if (m_broadphase == Broadphase::SweepAndPrune)
+        {
+            m_sweep.addRect(bounding_rect, object.getId());
+        }
+    }
+
+    //! \brief inserts many objects at once, the tree is built in one go
+    void CollisionSystem::insertObjects(const std::vector<GameObject *> &objects)
+    {
+        std::vector<AABB> rects;
+        std::vector<int> ids;
+        rects.reserve(objects.size());
+        ids.reserve(objects.size());
+        for (auto p_object : objects)
+        {
+            auto &comp = m_components.get(p_object->getId());
+            comp.previous_position = p_object->getPosition();
+            comp.motion = {0, 0};
+            setLayers(p_object->getId(), comp);
+            if (comp.is_static)
+            {
+                m_static_ids.push_back(p_object->getId());
+                m_static_rebuild_requested = true;
+                continue;
+            }
+            auto &shape = comp.shape;
+            shape.updateWorldShapes();
+            rects.push_back(makeFatRect(shape.getBoundingRect(), p_object->m_vel));
+            ids.push_back(p_object->getId());
+        }
+        m_tree.addRects(rects, ids);
+        if (m_broadphase == Broadphase::SweepAndPrune)
+        {
+            m_sweep.addRects(rects, ids);
+        }
+    }
+
+    BoundingVolumeTree &CollisionSystem::getTree()
+    {
+        return m_tree;
+    }
+
+    BoundingVolumeTree &CollisionSystem::getStaticTree()
+    {
+        return m_static_tree;
+    }
+
+    //! \brief static colliders which moved are put to their new places in one rebuild at the start of the next frame
+    void CollisionSystem::requestStaticRebuild()
+    {
+        m_static_rebuild_requested = true;
     }
 
     void CollisionSystem::removeObject(GameObject &object)
     {
-        m_object_type2tree.at(object.getType()).removeObject(object.getId());
+        m_removed_ids.push_back(object.getId());
+        if (std::erase(m_static_ids, object.getId()) > 0)
+        {
+            if (m_static_tree.containsObject(object.getId()))
+            {
+                m_static_tree.removeObject(object.getId());
+            }
+            return;
+        }
+        m_tree.removeObject(object.getId());
+        if (m_broadphase == Broadphase::SweepAndPrune)
+        {
+            m_sweep.removeObject(object.getId());
+        }
     }
 
-    void CollisionSystem::preUpdate(float dt, EntityRegistryT &entities)
+    //! \brief removes many objects at once, the tree is updated in one go
+    void CollisionSystem::removeObjects(const std::vector<GameObject *> &objects)
+    {
+        std::vector<int> removed_ids;
+        std::vector<int> removed_static_ids;
+        for (auto p_object : objects)
+        {
+            if (m_components.contains(p_object->getId()))
+            {
+                bool is_static = std::find(m_static_ids.begin(), m_static_ids.end(), p_object->getId()) != m_static_ids.end();
+                (is_static ? removed_static_ids : removed_ids).push_back(p_object->getId());
+                m_removed_ids.push_back(p_object->getId());
+            }
+        }
+        for (auto removed_id : removed_static_ids)
+        {
+            std::erase(m_static_ids, removed_id);
+            if (m_static_tree.containsObject(removed_id))
+            {
+                m_static_tree.removeObject(removed_id);
+            }
+        }
+        m_tree.removeObjects(removed_ids);
+        if (m_broadphase == Broadphase::SweepAndPrune)
+        {
+            m_sweep.removeObjects(removed_ids);
+        }
+    }
+
+    //! \brief copies layers of the collider of \p entity_id, so that the broadphase reads them from a flat array
+    void CollisionSystem::setLayers(int entity_id, const CollisionComponent &comp)
+    {
+        if (entity_id >= static_cast<int>(m_entity_layers.size()))
+        {
+            m_entity_layers.resize(entity_id + 1);
+        }
+        auto category = comp.category != 0 ? comp.category : makeTypeMask({comp.type});
+        m_entity_layers[entity_id] = {comp.type, category, comp.mask};
+    }
+
+    //! \returns milliseconds that passed since \p tic
+    static float millisecondsSince(std::chrono::high_resolution_clock::time_point tic)
     {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - tic)
+                   .count() /
+               1000.f;
+    }
 
+    //! \brief finds collisions in stages, each stage splits its work into independent tasks run on worker threads
+    //! \brief only the callbacks and events run on the calling thread, in order which does not depend on threads
+    void CollisionSystem::preUpdate(float dt, EntityRegistryT &entities)
+    {
         auto &comps = m_components.data;
         auto &comp_ids = m_components.data_ind2id;
-        for (std::size_t comp_id = 0; comp_id < comps.size(); ++comp_id)
+        m_tick++;
+        m_tree_update_stats.reset();
+        m_broadphase_stats.reset();
+
+        if (m_static_rebuild_requested)
         {
-            auto &comp = comps[comp_id];
+            rebuildStatic(entities);
+        }
+
+        //! world space shapes are cached and recomputed only for shapes which moved, static ones are skipped
+        auto tic = std::chrono::high_resolution_clock::now();
+        std::atomic<std::size_t> transformed_count = 0;
+        const auto transform_batch_count = (comps.size() + k_transform_batch_size - 1) / k_transform_batch_size;
+        m_workers.parallelFor(transform_batch_count, [&](std::size_t batch_index, std::size_t)
+                              {
+            std::size_t batch_transformed_count = 0;
+            auto batch_end = std::min(comps.size(), (batch_index + 1) * k_transform_batch_size);
+            for (std::size_t comp_id = batch_index * k_transform_batch_size; comp_id < batch_end; ++comp_id)
+            {
+                if (comps[comp_id].is_static)
+                {
+                    continue;
+                }
+                auto &entity = *entities.at(comp_ids[comp_id]);
+                auto &collision_shape = comps[comp_id].shape;
+                if (comps[comp_id].continuous)
+                {
+                    comps[comp_id].motion = entity.getPosition() - comps[comp_id].previous_position;
+                    comps[comp_id].previous_position = entity.getPosition();
+                }
+                for (auto &shape : collision_shape.convex_shapes)
+                {
+                    shape.setPosition(entity.getPosition());
+                    shape.setScale(entity.getSize() / 2.);
+                    shape.setRotation(entity.getAngle());
+                }
+                batch_transformed_count += collision_shape.updateWorldShapes();
+            }
+            transformed_count += batch_transformed_count; });
+        m_pipeline_stats.transform_time_ms = millisecondsSince(tic);
+        m_pipeline_stats.transformed_shape_count = transformed_count;
+
+        tic = std::chrono::high_resolution_clock::now();
+        refitBroadphase(entities);
+        m_pipeline_stats.refit_time_ms = millisecondsSince(tic);
+
+        tic = std::chrono::high_resolution_clock::now();
+        findClosePairs();
+        m_pipeline_stats.pairs_time_ms = millisecondsSince(tic);
+
+#ifndef NDEBUG
+        //! evaluate each collision once
+        for (auto &close_pairs : m_resolver_pairs)
+        {
+            for (auto close_pair : close_pairs)
+            {
+                assert(m_collided2.count(close_pair) == 0);
+                m_collided2.insert(close_pair);
+            }
+        }
+        m_collided2.clear();
+#endif
+
+        //! narrowphase runs on fixed size batches of pairs and each batch collects its own contacts
+        tic = std::chrono::high_resolution_clock::now();
+        m_pair_batches.clear();
+        for (std::size_t resolver_index = 0; resolver_index < m_resolver_pairs.size(); ++resolver_index)
+        {
+            const auto pair_count = m_resolver_pairs[resolver_index].size();
+            for (std::size_t first = 0; first < pair_count; first += k_narrowphase_batch_size)
+            {
+                m_pair_batches.push_back({resolver_index, first, std::min(pair_count, first + k_narrowphase_batch_size)});
+            }
+        }
+        if (m_batch_contacts.size() < m_pair_batches.size())
+        {
+            m_batch_contacts.resize(m_pair_batches.size());
+        }
+        std::atomic<std::size_t> early_out_count = 0;
+        std::atomic<std::size_t> swept_pair_count = 0;
+        std::atomic<std::size_t> sensor_pair_count = 0;
+        m_workers.parallelFor(m_pair_batches.size(), [&](std::size_t batch_index, std::size_t)
+                              {
+            auto counts = narrowPhase(m_pair_batches[batch_index], m_batch_contacts[batch_index]);
+            early_out_count += counts.axis_early_outs;
+            swept_pair_count += counts.swept_pairs;
+            sensor_pair_count += counts.sensor_pairs; });
+        m_pipeline_stats.pair_batch_count = m_pair_batches.size();
+        m_pipeline_stats.axis_early_out_count = early_out_count;
+        m_pipeline_stats.swept_pair_count = swept_pair_count;
+        m_pipeline_stats.sensor_pair_count = sensor_pair_count;
+        m_pipeline_stats.narrowphase_time_ms = millisecondsSince(tic);
+
+        tic = std::chrono::high_resolution_clock::now();
+        dispatchContacts(entities);
+        m_pipeline_stats.cached_pair_count = m_pair_cache.size();
+        m_pipeline_stats.dispatch_time_ms = millisecondsSince(tic);
+
+        tic = std::chrono::high_resolution_clock::now();
+        m_solver.solve(dt, entities, m_workers);
+        m_pipeline_stats.solver_time_ms = millisecondsSince(tic);
+    }
+
+    //! \brief updates the pair cache with results of the narrowphase, calls callbacks and sends contact events
+    //! \brief batches are ordered by resolver and pair, so the callbacks are called in the same order with any thread count
+    void CollisionSystem::dispatchContacts(EntityRegistryT &entities)
+    {
+        m_begin_events.clear();
+        m_stay_events.clear();
+        m_end_events.clear();
+
+        //! contacts of removed entities end now, so that an entity reusing the id does not continue them
+        if (!m_removed_ids.empty())
+        {
+            std::sort(m_removed_ids.begin(), m_removed_ids.end());
+            std::erase_if(m_pair_cache, [this](const auto &cached)
+                          {
+                auto &[entity_pair, cached_pair] = cached;
+                if (!std::binary_search(m_removed_ids.begin(), m_removed_ids.end(), entity_pair.first) &&
+                    !std::binary_search(m_removed_ids.begin(), m_removed_ids.end(), entity_pair.second))
+                {
+                    return false;
+                }
+                endContact(entity_pair, cached_pair);
+                return true; });
+            m_removed_ids.clear();
+        }
+
+        //! a continuous body which touched several objects during its motion keeps only the earliest contact
+        m_earliest_impacts.clear();
+        for (std::size_t batch_index = 0; batch_index < m_pair_batches.size(); ++batch_index)
+        {
+            for (auto &contact : m_batch_contacts[batch_index])
+            {
+                if (contact.data.minimum_translation <= 0.f || contact.data.time_of_impact >= 1.f)
+                {
+                    continue;
+                }
+                for (auto entity : {contact.entity_a, contact.entity_b})
+                {
+                    if (m_components.get(entity).continuous)
+                    {
+                        auto [it, inserted] = m_earliest_impacts.try_emplace(entity, contact.data.time_of_impact);
+                        it->second = std::min(it->second, contact.data.time_of_impact);
+                    }
+                }
+            }
+        }
+        auto isAfterEarliestImpact = [this](const Contact &contact)
+        {
+            for (auto entity : {contact.entity_a, contact.entity_b})
+            {
+                auto earliest = m_earliest_impacts.find(entity);
+                if (earliest != m_earliest_impacts.end() && contact.data.time_of_impact > earliest->second)
+                {
+                    return true;
+                }
+            }
+            return false;
+        };
+        m_pipeline_stats.swept_contact_count = 0;
+
+        for (std::size_t batch_index = 0; batch_index < m_pair_batches.size(); ++batch_index)
+        {
+            auto &resolver = *m_resolver_order[m_pair_batches[batch_index].resolver_index].second;
+            for (auto &contact : m_batch_contacts[batch_index])
+            {
+                auto &obj1 = *entities.at(contact.entity_a);
+                auto &obj2 = *entities.at(contact.entity_b);
+
+                auto &cached_pair = m_pair_cache[{contact.entity_a, contact.entity_b}];
+                cached_pair.last_tick = m_tick;
+                cached_pair.type_a = obj1.getType();
+                cached_pair.type_b = obj2.getType();
+                if (!m_earliest_impacts.empty() && contact.data.minimum_translation > 0.f && isAfterEarliestImpact(contact))
+                {
+                    contact.data = {};
+                }
+                if (contact.data.minimum_translation <= 0.f && !contact.data.is_overlap_only)
+                {
+                    if (cached_pair.is_touching)
+                    {
+                        endContact({contact.entity_a, contact.entity_b}, cached_pair);
+                    }
+                    cached_pair.is_touching = false;
+                    cached_pair.separating_axis = contact.data.separation_axis;
+                    cached_pair.impulse = {};
+                    continue;
+                }
+
+                m_trace.record({m_tick, contact.entity_a, contact.entity_b, cached_pair.type_a, cached_pair.type_b,
+                                contact.data.separation_axis, contact.data.minimum_translation, contact.data.contact_point});
+
+                bool is_new = !cached_pair.is_touching;
+                if (is_new)
+                {
+                    cached_pair.first_contact_tick = m_tick;
+                    m_begin_events.push_back({contact.entity_a, contact.entity_b, cached_pair.type_a, cached_pair.type_b, contact.data});
+                }
+                else
+                {
+                    m_stay_events.push_back({contact.entity_a, contact.entity_b, cached_pair.type_a, cached_pair.type_b, contact.data,
+                                             m_tick - cached_pair.first_contact_tick});
+                }
+                if (contact.data.time_of_impact < 1.f)
+                {
+                    m_pipeline_stats.swept_contact_count++;
+                }
+                cached_pair.is_touching = true;
+                cached_pair.data = contact.data;
+                cached_pair.separating_axis = {0, 0};
+                if (!contact.data.is_overlap_only && m_solver.isBody(contact.entity_a) && m_solver.isBody(contact.entity_b))
+                {
+                    m_solver.addContact(contact.entity_a, contact.entity_b, contact.data, cached_pair.impulse);
+                }
+
+                if (is_new || resolver.call_on_stay)
+                {
+                    resolver.callback(obj1, obj2, contact.data);
+                }
+            }
+        }
+
+        //! pairs whose rects stopped overlapping were not tested this frame
+        std::erase_if(m_pair_cache, [this](const auto &cached)
+                      {
+            auto &[entity_pair, cached_pair] = cached;
+            if (cached_pair.last_tick == m_tick)
+            {
+                return false;
+            }
+            if (cached_pair.is_touching)
+            {
+                endContact(entity_pair, cached_pair);
+            }
+            return true; });
+
+        p_post_office->sendBatch<ContactBeginEvent>(m_begin_events);
+        p_post_office->sendBatch<ContactStayEvent>(m_stay_events);
+        p_post_office->sendBatch<ContactEndEvent>(m_end_events);
+    }
+
+    void CollisionSystem::endContact(const std::pair<int, int> &entity_pair, const CachedPair &cached_pair)
+    {
+        m_end_events.push_back({entity_pair.first, entity_pair.second, cached_pair.type_a, cached_pair.type_b,
+                                m_tick - cached_pair.first_contact_tick});
+    }
+
+    //! \brief builds the static tree from scratch in one go, static colliders are moved to their entities first
+    //! \brief static rects are not fattened since they do not move
+    void CollisionSystem::rebuildStatic(EntityRegistryT &entities)
+    {
+        auto tic = std::chrono::high_resolution_clock::now();
+        std::vector<AABB> rects;
+        rects.reserve(m_static_ids.size());
+        for (auto entity_ind : m_static_ids)
+        {
+            auto &comp = m_components.get(entity_ind);
+            auto &entity = *entities.at(entity_ind);
             for (auto &shape : comp.shape.convex_shapes)
             {
-                shape.setPosition(entities.at(comp_ids.at(comp_id))->getPosition());
-                shape.setScale(entities.at(comp_ids.at(comp_id))->getSize() / 2.);
-                shape.setRotation(entities.at(comp_ids.at(comp_id))->getAngle());
+                shape.setPosition(entity.getPosition());
+                shape.setScale(entity.getSize() / 2.);
+                shape.setRotation(entity.getAngle());
             }
+            comp.shape.updateWorldShapes();
+            setLayers(entity_ind, comp);
+            rects.push_back(comp.shape.getBoundingRect());
         }
+        m_static_tree.clear();
+        m_static_tree.addRects(rects, m_static_ids);
+        m_static_rebuild_requested = false;
+
+        m_broadphase_stats.static_rebuild_time_ms = millisecondsSince(tic);
+    }
 
-        for (std::size_t comp_id = 0; comp_id < comps.size(); ++comp_id)
+    //! \brief updates rects of objects which moved out of their rects in the broadphase and copies their layers
+    void CollisionSystem::refitBroadphase(EntityRegistryT &entities)
+    {
+        const bool uses_sweep = m_broadphase == Broadphase::SweepAndPrune;
+        for (std::size_t comp_id = 0; comp_id < m_components.data.size(); ++comp_id)
         {
-            //! update the tree if the entity moved outside of it's BoundingBox
-            // auto& entity
-            auto &comp = comps[comp_id];
-            auto &tree = m_object_type2tree.at(comp.type);
-            auto entity_ind = comp_ids.at(comp_id);
+            auto &comp = m_components.data[comp_id];
+            if (comp.is_static)
+            {
+                continue;
+            }
+            auto entity_ind = m_components.data_ind2id[comp_id];
+            setLayers(entity_ind, comp);
 
             auto fitting_rect = comp.shape.getBoundingRect();
-            auto big_bounding_rect = tree.getObjectRect(entity_ind);
+            if (comp.continuous)
+            {
+                //! the rect covers the whole motion, so that the broadphase finds everything the body passed
+                auto start_rect = fitting_rect;
+                start_rect.r_min -= comp.motion;
+                start_rect.r_max -= comp.motion;
+                fitting_rect = makeUnion(fitting_rect, start_rect);
+            }
+            const auto &big_bounding_rect = m_tree.getObjectRect(entity_ind);
 
             //! if object moved in a way that rect in the collision tree does not fully contain it
-            if (makeUnion(fitting_rect, big_bounding_rect).volume() > big_bounding_rect.volume())
+            if (!contains(big_bounding_rect, fitting_rect))
             {
-                tree.removeObject(entity_ind);
-                tree.addRect(fitting_rect.inflate(1.5f), entity_ind);
+                auto type_ind = static_cast<std::size_t>(comp.type);
+                auto fat_rect = makeFatRect(fitting_rect, entities.at(entity_ind)->m_vel);
+                if (m_tree.moveObjectInPlace(entity_ind, fat_rect))
+                {
+                    m_tree_update_stats.in_place_moves[type_ind]++;
+                }
+                else
+                {
+                    m_tree.moveObject(entity_ind, fat_rect);
+                    m_tree_update_stats.reinserts[type_ind]++;
+                }
+                //! the sweep holds the same rects as the tree, so it changes only when the tree does
+                if (uses_sweep)
+                {
+                    m_sweep.moveObject(entity_ind, fat_rect);
+                }
             }
         }
+        m_tree.updateQuality();
 
-        for (auto &[type_pair, callback] : m_registered_resolvers)
+        if (uses_sweep)
         {
-            auto &[type_a, type_b] = type_pair;
-            auto &tree_a = m_object_type2tree.at((ObjectType)type_a);
-            auto &tree_b = m_object_type2tree.at((ObjectType)type_b);
+            auto tic = std::chrono::high_resolution_clock::now();
+            m_sweep.sort();
+            m_broadphase_stats.sweep_sort_time_ms = millisecondsSince(tic);
+            m_broadphase_stats.sweep_swaps = m_sweep.getLastSwapCount();
+        }
+    }
+
+    //! \brief finds overlapping rects of all moving colliders in one self query of the broadphase
+    //! \brief and of moving and static colliders in one query of the static tree, static pairs are never searched
+    //! \brief pairs are kept if the layers of both colliders accept each other and their types have a resolver,
+    //! \brief then they are ordered like the types of the resolver and binned by it
+    void CollisionSystem::findClosePairs()
+    {
+        m_resolver_pairs.resize(m_resolver_order.size());
+        for (auto &close_pairs : m_resolver_pairs)
+        {
+            close_pairs.clear();
+        }
 
-            std::vector<std::pair<int, int>> close_pairs;
-            if (type_a == type_b)
+        std::size_t candidate_count = 0;
+        auto binPair = [&](int entity_a, int entity_b)
+        {
+            candidate_count++;
+            const auto &layers_a = m_entity_layers[entity_a];
+            const auto &layers_b = m_entity_layers[entity_b];
+            if ((layers_a.category & layers_b.mask) == 0 || (layers_b.category & layers_a.mask) == 0)
             {
-                close_pairs = tree_a.findClosePairsWithin();
+                return;
             }
-            else
+            const auto &slot = m_resolver_table[static_cast<std::size_t>(layers_a.type) * static_cast<std::size_t>(ObjectType::Count) +
+                                                static_cast<std::size_t>(layers_b.type)];
+            if (slot.resolver_index == -1)
             {
-                close_pairs = tree_a.findClosePairsWith2(tree_b);
+                return;
             }
+            //! pairs of the same type are ordered by ids, so that the pair cache sees the same pair in every frame
+            if (slot.is_swapped || (layers_a.type == layers_b.type && entity_a > entity_b))
+            {
+                std::swap(entity_a, entity_b);
+            }
+            m_resolver_pairs[slot.resolver_index].push_back({entity_a, entity_b});
+        };
+        if (m_broadphase == Broadphase::SweepAndPrune)
+        {
+            m_sweep.forEachClosePairWithin(binPair);
+        }
+        else
+        {
+            m_tree.forEachClosePairWithin(binPair);
+        }
+        m_tree.forEachClosePairWith(m_static_tree, binPair);
 
-            narrowPhase2(close_pairs, entities, callback);
+        m_broadphase_stats.candidate_pair_count = candidate_count;
+        for (std::size_t resolver_index = 0; resolver_index < m_resolver_order.size(); ++resolver_index)
+        {
+            const auto pair_count = m_resolver_pairs[resolver_index].size();
+            m_resolver_order[resolver_index].second->close_pair_count = pair_count;
+            m_broadphase_stats.accepted_pair_count += pair_count;
         }
+    }
 
-        m_collided2.clear();
+    //! \brief tests close pairs of one batch, pairs separated in the last frame are first tested on the axis which separated them
+    //! \brief pairs with a moving continuous body are swept over the motion of the last frame instead
+    //! \brief pairs with a sensor are only tested for overlap, no manifold is built for them
+    CollisionSystem::NarrowPhaseCounts CollisionSystem::narrowPhase(const PairBatch &batch, std::vector<Contact> &contacts) const
+    {
+        contacts.clear();
+        NarrowPhaseCounts counts;
+        const auto &close_pairs = m_resolver_pairs[batch.resolver_index];
+        for (auto pair_index = batch.first_pair; pair_index < batch.end_pair; ++pair_index)
+        {
+            auto [i1, i2] = close_pairs[pair_index];
+            assert(i1 != i2); //! no self collisions
+
+            const auto &comp1 = m_components.get(i1);
+            const auto &comp2 = m_components.get(i2);
+            const auto &shapes1 = comp1.shape.world_shapes;
+            const auto &shapes2 = comp2.shape.world_shapes;
+            CollisionData collision_data;
+            utils::Vector2f motion = {0, 0}; //! of the first body relative to the second one
+            if (comp1.continuous || comp2.continuous)
+            {
+                motion = (comp1.continuous ? comp1.motion : utils::Vector2f{0, 0}) -
+                         (comp2.continuous ? comp2.motion : utils::Vector2f{0, 0});
+            }
+            auto cached = m_pair_cache.find({i1, i2});
+            if (comp1.is_sensor || comp2.is_sensor)
+            {
+                //! sensors need only to know whether the shapes touch now, so the motion is not swept
+                counts.sensor_pairs++;
+                if (cached != m_pair_cache.end() && areSeparatedAlong(shapes1, shapes2, cached->second.separating_axis))
+                {
+                    collision_data.separation_axis = cached->second.separating_axis;
+                    counts.axis_early_outs++;
+                }
+                else
+                {
+                    collision_data.is_overlap_only = shapesOverlap(shapes1, shapes2, collision_data.separation_axis);
+                }
+            }
+            else if (motion.x != 0.f || motion.y != 0.f)
+            {
+                counts.swept_pairs++;
+                if (!sweptShapesCollide(shapes1, motion, shapes2, collision_data))
+                {
+                    collision_data.minimum_translation = -1.f;
+                }
+            }
+            else if (cached != m_pair_cache.end() && areSeparatedAlong(shapes1, shapes2, cached->second.separating_axis))
+            {
+                collision_data.separation_axis = cached->second.separating_axis;
+                counts.axis_early_outs++;
+            }
+            else if (!shapesCollide(shapes1, shapes2, collision_data))
+            {
+                collision_data.minimum_translation = -1.f;
+            }
+            contacts.push_back({i1, i2, collision_data});
+        }
+        return counts;
+    }
+
+    //! \returns true if projections of \p shape1 and \p shape2 on \p axis do not overlap, false for zero \p axis
+    bool CollisionSystem::areSeparatedAlong(const std::vector<WorldPolygon> &shape1, const std::vector<WorldPolygon> &shape2,
+                                            utils::Vector2f axis)
+    {
+        if (axis.x == 0.f && axis.y == 0.f)
+        {
+            return false;
+        }
+        auto projectAll = [axis](const std::vector<WorldPolygon> &shape)
+        {
+            Projection1D projection;
+            for (auto &sub_shape : shape)
+            {
+                auto sub_projection = sub_shape.project(axis);
+                projection.min = std::min(projection.min, sub_projection.min);
+                projection.max = std::max(projection.max, sub_projection.max);
+            }
+            return projection;
+        };
+        return !overlap1D(projectAll(shape1), projectAll(shape2));
     }
 
-    void CollisionSystem::shapesCollide(const std::vector<Polygon>& shape1, const std::vector<Polygon>& shape2,
-                    GameObject& obj1, GameObject& obj2, CollisionCallbackT &callback)
+    //! \returns true if any sub shapes overlap, otherwise \p separating_axis is the axis which separated the last tested sub shapes
+    bool CollisionSystem::shapesOverlap(const std::vector<WorldPolygon> &shape1, const std::vector<WorldPolygon> &shape2,
+                                        utils::Vector2f &separating_axis)
     {
         for (auto &sub_shape1 : shape1)
         {
             for (auto &sub_shape2 : shape2)
             {
+                if (testOverlap(sub_shape1, sub_shape2, separating_axis))
+                {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
 
-                CollisionData collision_data = getCollisionData(sub_shape1, sub_shape2);
-
+    //! \returns true if any sub shapes collide, \p collision_data then describes the first found collision
+    bool CollisionSystem::shapesCollide(const std::vector<WorldPolygon> &shape1, const std::vector<WorldPolygon> &shape2,
+                                        CollisionData &collision_data) const
+    {
+        for (auto &sub_shape1 : shape1)
+        {
+            for (auto &sub_shape2 : shape2)
+            {
+                collision_data = getCollisionData(sub_shape1, sub_shape2);
                 if (collision_data.minimum_translation > 0) //! there is a collision
                 {
-
-                    collisions.push_back({&obj1, &obj2, collision_data});
-
-                    p_post_office->send(CollisionEvent{obj1.getId(), obj2.getId()});
-                    callback(obj1, obj2, collision_data);
                     //! Fuck this shit, do not collide with multiple subshapes?
-                    return;
+                    return true;
                 }
             }
         }
+        return false;
     }
-    void CollisionSystem::narrowPhase2(const std::vector<std::pair<int, int>> &colliding_pairs,
-                                       EntityRegistryT &entities, CollisionCallbackT &callback)
+
+    //! \returns distance a shape can move between probes of a sweep without stepping over a thin overlap
+    static float getSweepStepLength(const WorldPolygon &shape)
     {
-        for (auto [i1, i2] : colliding_pairs)
+        if (shape.isRound())
         {
-            assert(i1 != i2 && m_collided2.count({i1, i2}) == 0); //! no self collisions and evaluate each collision once
+            return shape.radius;
+        }
+        auto size = shape.bounding_rect.getSize();
+        return std::min(size.x, size.y) / 2.f;
+    }
 
-            auto &obj1 = *entities.at(i1);
-            auto &obj2 = *entities.at(i2);
-            m_collided2.insert({i1, i2});
+    //! \brief \p shape1 moves by \p motion and ends at its current position, the ranges of the motion in which
+    //! \brief sub shapes overlap on the separating axes are probed and the earliest found collision is kept
+    //! \returns true if any sub shapes collided during the motion
+    bool CollisionSystem::sweptShapesCollide(const std::vector<WorldPolygon> &shape1, utils::Vector2f motion,
+                                             const std::vector<WorldPolygon> &shape2, CollisionData &collision_data) const
+    {
+        bool collided = false;
+        const float motion_length = norm(motion);
+        for (auto &sub_shape1 : shape1)
+        {
+            for (auto &sub_shape2 : shape2)
+            {
+                float time_of_impact;
+                float time_of_exit;
+                if (!calcSweptOverlap(sub_shape1, motion, sub_shape2, time_of_impact, time_of_exit) ||
+                    (collided && time_of_impact >= collision_data.time_of_impact))
+                {
+                    continue;
+                }
 
-            auto &shape1 = m_components.get(i1).shape.convex_shapes;
-            auto &shape2 = m_components.get(i2).shape.convex_shapes;
-            shapesCollide(shape1, shape2, obj1, obj2, callback);
+                //! polygons overlap during the whole range and the first probe hits, round shapes can miss it
+                //! near corners, so the range is probed in steps shorter than the shapes are thick
+                const float span = time_of_exit - time_of_impact;
+                const float step_length = std::min(getSweepStepLength(sub_shape1), getSweepStepLength(sub_shape2));
+                const float step_count = step_length > 0.f ? std::ceil(span * motion_length / step_length) : k_max_sweep_samples;
+                const auto sample_count = std::clamp<std::size_t>(static_cast<std::size_t>(step_count), 1, k_max_sweep_samples);
+                for (std::size_t sample = 0; sample < sample_count; ++sample)
+                {
+                    float time = time_of_impact + span * (sample + 0.1f) / sample_count;
+                    if (collided && time >= collision_data.time_of_impact)
+                    {
+                        break;
+                    }
+                    auto moved_shape = sub_shape1;
+                    moved_shape.translate(motion * (time - 1.f));
+                    auto sub_collision_data = getCollisionData(moved_shape, sub_shape2);
+                    if (sub_collision_data.minimum_translation > 0.f)
+                    {
+                        sub_collision_data.time_of_impact = time;
+                        collision_data = sub_collision_data;
+                        collided = true;
+                        break;
+                    }
+                }
+            }
         }
+        return collided;
     }
 
-    CollisionData CollisionSystem::getCollisionData(const Polygon &pa, const Polygon &pb) const
+    CollisionData CollisionSystem::getCollisionData(const WorldPolygon &pa, const WorldPolygon &pb) const
     {
-        auto points_a = pa.getPointsInWorld();
-        auto points_b = pb.getPointsInWorld();
-        auto c_data = calcCollisionData(points_a, points_b);
+        if (pa.isRound() || pb.isRound())
+        {
+            return calcCollisionData(pa, pb); //! round shapes find the contact point without clipping
+        }
+
+        auto c_data = calcPolygonsCollisionData(pa, pb);
 
         if (c_data.minimum_translation < 0.f)
         {
             return c_data; //! there is no collision so we don't need to extract manifold
         }
-        auto center_a = pa.getPosition();
-        auto center_b = pb.getPosition();
+        auto center_a = pa.center;
+        auto center_b = pb.center;
         //! make separation axis point always from a to b
         auto are_flipped = dot((center_a - center_b), c_data.separation_axis) > 0;
         if (are_flipped)
@@ -146,145 +775,324 @@ namespace Collisions
             c_data.separation_axis *= -1.f;
         }
 
-        auto col_feats1 = obtainFeatures(c_data.separation_axis, points_a);
-        auto col_feats2 = obtainFeatures(-1.f * c_data.separation_axis, points_b);
+        auto col_feats1 = obtainFeatures(c_data.separation_axis, pa);
+        auto col_feats2 = obtainFeatures(-1.f * c_data.separation_axis, pb);
 
         auto clipped_edge = clipEdges(col_feats1, col_feats2, c_data.separation_axis);
-        if (clipped_edge.size() == 0) //! clipping failed so we don't do collision
+        if (clipped_edge.count == 0) //! clipping failed so we don't do collision
         {
             c_data.minimum_translation = -1.f;
             return c_data;
         }
-        for (auto ce : clipped_edge)
+        for (std::size_t i = 0; i < clipped_edge.count; ++i)
         {
-            c_data.contact_point += ce;
+            c_data.contact_point += clipped_edge.points[i];
         }
-        c_data.contact_point /= (float)clipped_edge.size();
+        c_data.contact_point /= (float)clipped_edge.count;
 
         return c_data;
     }
 
     std::vector<int> CollisionSystem::findNearestObjectInds(ObjectType type, utils::Vector2f center, float radius) const
     {
-        auto &tree = m_object_type2tree.at(type);
-
         AABB collision_rect({center - utils::Vector2f{radius, radius}, center + utils::Vector2f{radius, radius}});
-        return tree.findIntersectingLeaves(collision_rect);
+        std::vector<int> nearest;
+        forEachIntersectingCollider(collision_rect, [&](int ind)
+                                    {
+            if (m_entity_layers[ind].type == type)
+            {
+                nearest.push_back(ind);
+            } });
+        return nearest;
     }
 
     std::vector<CollisionComponent *> CollisionSystem::findIntersections(ObjectType type, Polygon collision_body)
     {
-        auto nearest_inds = m_object_type2tree.at(type).findIntersectingLeaves(collision_body.getBoundingRect());
-        auto points = collision_body.getPointsInWorld();
-
         std::vector<CollisionComponent *> collision_ids;
-        for (auto ind : nearest_inds)
-        {
+        findIntersections(type, collision_body, collision_ids);
+        return collision_ids;
+    }
+
+    void CollisionSystem::findIntersections(ObjectType type, const Polygon &collision_body,
+                                            std::vector<CollisionComponent *> &intersecting) const
+    {
+        WorldPolygon body;
+        collision_body.updateWorld(body);
+        forEachIntersectingCollider(body.bounding_rect, [&](int ind)
+                                    {
+            if (m_entity_layers[ind].type != type)
+            {
+                return;
+            }
             auto &collision_comp = m_components.get(ind);
+            for (auto &shape : collision_comp.shape.world_shapes)
+            {
+                utils::Vector2f separating_axis;
+                if (testOverlap(body, shape, separating_axis))
+                {
+                    intersecting.push_back(&collision_comp);
+                    break;
+                }
+            } });
+    }
+
+    //! \brief finds objects of \p type intersecting each of \p collision_bodies in one batched tree traversal
+    //! \param intersecting  filled with pairs of body index and intersecting component, sorted by the body index
+    void CollisionSystem::findIntersectionsBatch(ObjectType type, const std::vector<Polygon> &collision_bodies,
+                                                 std::vector<std::pair<int, CollisionComponent *>> &intersecting)
+    {
+        m_query_rects.clear();
+        m_query_bodies.resize(collision_bodies.size());
+        for (std::size_t body_index = 0; body_index < collision_bodies.size(); ++body_index)
+        {
+            collision_bodies[body_index].updateWorld(m_query_bodies[body_index]);
+            m_query_rects.push_back(m_query_bodies[body_index].bounding_rect);
+        }
 
-            for (auto &shape : collision_comp.shape.convex_shapes)
+        intersecting.clear();
+        auto add_candidate = [&](int body_index, int ind)
+        {
+            if (m_entity_layers[ind].type == type)
             {
-                auto points_other = shape.getPointsInWorld();
-                auto c_data = calcCollisionData(points, points_other);
-                if (c_data.minimum_translation > 0.)
+                intersecting.push_back({body_index, &m_components.get(ind)});
+            }
+        };
+        m_static_tree.forEachIntersectingBatch(m_query_rects, add_candidate);
+        m_tree.forEachIntersectingBatch(m_query_rects, add_candidate);
+        std::sort(intersecting.begin(), intersecting.end(), [](const auto &a, const auto &b)
+                  { return a.first < b.first; });
+
+        //! narrow phase, candidates which do not really intersect are thrown away
+        std::size_t kept_count = 0;
+        for (std::size_t i = 0; i < intersecting.size(); ++i)
+        {
+            auto [body_index, p_comp] = intersecting[i];
+            for (auto &shape : p_comp->shape.world_shapes)
+            {
+                utils::Vector2f separating_axis;
+                if (testOverlap(m_query_bodies[body_index], shape, separating_axis))
                 {
-                    collision_ids.push_back(&collision_comp);
+                    intersecting[kept_count++] = intersecting[i];
+                    break;
                 }
             }
         }
-        return collision_ids;
+        intersecting.resize(kept_count);
     }
 
     std::vector<CollisionComponent *> CollisionSystem::findNearestObjects(ObjectType type, utils::Vector2f center, float radius) const
     {
-        auto &tree = m_object_type2tree.at(type);
-
-        AABB collision_rect({center - utils::Vector2f{radius, radius}, center + utils::Vector2f{radius, radius}});
-        auto nearest_inds = tree.findIntersectingLeaves(collision_rect);
         std::vector<CollisionComponent *> objects;
-        for (auto ind : nearest_inds)
+        findNearestObjects(type, center, radius, objects);
+        return objects;
+    }
+
+    void CollisionSystem::findNearestObjects(ObjectType type, utils::Vector2f center, float radius,
+                                             std::vector<CollisionComponent *> &nearest) const
+    {
+        forEachNearestObject(type, center, radius, [&nearest](CollisionComponent &collision_comp)
+                             { nearest.push_back(&collision_comp); });
+    }
+
+    //! \returns the nearest point of shapes of \p type on the segment, or its end if there is none
+    utils::Vector2f CollisionSystem::findClosestIntesection(ObjectType type, utils::Vector2f at, utils::Vector2f dir, float length) const
+    {
+        return rayCast(at, dir, length, makeTypeMask({type})).hit_point;
+    }
+
+    //! \brief finds the nearest shape of any type in \p type_mask hit by the ray from \p from along unit \p dir
+    //! \brief the trees are traversed front to back and rects behind the nearest hit are skipped,
+    //! \brief the static tree goes first so that walls cut the ray short before the moving colliders are visited
+    //! \brief rays starting inside a shape hit it where they leave it
+    RayCastData CollisionSystem::rayCast(utils::Vector2f from, utils::Vector2f dir, float length, ObjectTypeMask type_mask) const
+    {
+        const auto to = from + dir * length;
+        RayCastData nearest_hit;
+        nearest_hit.hit_point = to;
+        nearest_hit.distance = length;
+        auto visit_hit = [&](int entity_ind, float)
         {
-            auto &collision_comp = m_components.get(ind);
-            auto mvt = collision_comp.shape.convex_shapes[0].getMVTOfSphere(center, radius);
-            if (norm2(mvt) > 0.001f)
+            if ((type_mask & makeTypeMask({m_entity_layers[entity_ind].type})) == 0)
             {
-                objects.push_back(&collision_comp);
+                return nearest_hit.distance;
             }
+            for (auto &shape : m_components.get(entity_ind).shape.world_shapes)
+            {
+                float time;
+                utils::Vector2f normal;
+                if (intersectShape(from, to, shape, time, normal) && time * length < nearest_hit.distance)
+                {
+                    nearest_hit = {entity_ind, from + dir * (time * length), normal, time * length};
+                }
+            }
+            return nearest_hit.distance;
+        };
+        m_static_tree.forEachOnRay(from, dir, nearest_hit.distance, visit_hit);
+        m_tree.forEachOnRay(from, dir, nearest_hit.distance, visit_hit);
+        return nearest_hit;
+    }
+
+    //! \brief casts all \p rays, \p hits[i] is then the nearest hit of \p rays[i]
+    //! \brief rays are independent, so they are split between the worker threads
+    void CollisionSystem::rayCastBatch(const std::vector<RayQuery> &rays, std::vector<RayCastData> &hits)
+    {
+        hits.resize(rays.size());
+        const auto batch_count = (rays.size() + k_ray_batch_size - 1) / k_ray_batch_size;
+        m_workers.parallelFor(batch_count, [&](std::size_t batch_index, std::size_t)
+                              {
+            auto batch_end = std::min(rays.size(), (batch_index + 1) * k_ray_batch_size);
+            for (auto ray_index = batch_index * k_ray_batch_size; ray_index < batch_end; ++ray_index)
+            {
+                const auto &ray = rays[ray_index];
+                hits[ray_index] = rayCast(ray.from, ray.dir, ray.length, ray.type_mask);
+            } });
+    }
+
+    //! \brief chooses the test by the kinds of shapes, polygons use separating axes and round shapes the distances
+    //! \brief of their cores, for round shapes the separation axis points from \p shape1 to \p shape2
+    CollisionData inline calcCollisionData(const WorldPolygon &shape1, const WorldPolygon &shape2)
+    {
+        if (!shape1.isRound() && !shape2.isRound())
+        {
+            return calcPolygonsCollisionData(shape1, shape2);
         }
-        return objects;
+        if (shape1.isCircle() && shape2.isCircle())
+        {
+            return calcCirclesCollisionData(shape1, shape2);
+        }
+        if (shape1.isRound() && shape2.isRound())
+        {
+            return calcRoundShapesCollisionData(shape1, shape2);
+        }
+        if (shape1.isRound())
+        {
+            return shape1.isCircle() ? calcCirclePolygonCollisionData(shape1, shape2)
+                                     : calcCapsulePolygonCollisionData(shape1, shape2);
+        }
+        auto c_data = shape2.isCircle() ? calcCirclePolygonCollisionData(shape2, shape1)
+                                        : calcCapsulePolygonCollisionData(shape2, shape1);
+        c_data.separation_axis *= -1.f;
+        c_data.belongs_to_a = !c_data.belongs_to_a;
+        return c_data;
     }
 
-    utils::Vector2f CollisionSystem::findClosestIntesection(ObjectType type, utils::Vector2f at, utils::Vector2f dir, float length)
+    //! \brief answers only whether the shapes touch, which is all sensors and overlap queries need,
+    //! \brief touching polygons are found like in calcCollisionData(), but neither depth nor contact point are computed
+    //! \param separating_axis  axis separating polygons, zero if none was found
+    bool inline testOverlap(const WorldPolygon &shape1, const WorldPolygon &shape2, utils::Vector2f &separating_axis)
     {
-        utils::Vector2f closest_intersection = at + dir * length;
-        float min_dist = 200.f;
-        auto inters = m_object_type2tree.at(type).rayCast(at, dir, length);
-        for (auto ent_ind : inters)
+        separating_axis = {0, 0};
+        if (!shape1.isRound() && !shape2.isRound())
         {
-            auto &comp = m_components.get(ent_ind);
-            for (auto &shape : comp.shape.convex_shapes)
+            return testPolygonsOverlap(shape1, shape2, separating_axis);
+        }
+        //! tests of round shapes find the contact point from distances of their cores, which costs little
+        return calcCollisionData(shape1, shape2).minimum_translation > 0.f;
+    }
+
+    //! \brief separating axis test which stops at the first separating axis and does not look for the smallest overlap
+    bool inline testPolygonsOverlap(const WorldPolygon &polygon1, const WorldPolygon &polygon2, utils::Vector2f &separating_axis)
+    {
+        for (auto polygon : {&polygon1, &polygon2})
+        {
+            for (std::size_t i = 0; i < polygon->count; ++i)
             {
-                auto points = shape.getPointsInWorld();
-                int next = 1;
-                for (int i = 0; i < points.size(); ++i)
+                const auto &normal = polygon->normals[i];
+                if (normal.x == 0.f && normal.y == 0.f) //! degenerate edge
                 {
-                    utils::Vector2f r1 = points.at(i);
-                    utils::Vector2f r2 = points.at(next);
-
-                    utils::Vector2f segment_intersection;
-                    if (utils::segmentsIntersect(r1, r2, at, at + dir * length, segment_intersection))
-                    {
-                        auto new_dist = dist(segment_intersection, at);
-                        if (new_dist < min_dist)
-                        {
-                            closest_intersection = segment_intersection;
-                            min_dist = new_dist;
-                        }
-                    }
-                    next++;
-                    if (next == points.size())
-                    {
-                        next = 0;
-                    }
+                    continue;
+                }
+                if (!overlap1D(polygon1.project(normal), polygon2.project(normal)))
+                {
+                    separating_axis = normal;
+                    return false;
                 }
             }
         }
-        return closest_intersection;
+        return true;
     }
 
-    CollisionData inline calcCollisionData(const std::vector<utils::Vector2f> &points1,
-                                           const std::vector<utils::Vector2f> &points2)
+    //! \brief finds the range [\p time_of_impact, \p time_of_exit] within [0, 1] of the motion in which \p shape1,
+    //! \brief moving by \p motion and given at its end, overlaps \p shape2 on each tested axis, only translation is considered
+    //! \brief the range is exact for polygons, round shapes are not separated by a finite set of axes,
+    //! \brief so for them the range can be longer than the real one
+    //! \returns false if the shapes are separated during the whole motion
+    bool inline calcSweptOverlap(const WorldPolygon &shape1, utils::Vector2f motion, const WorldPolygon &shape2,
+                                 float &time_of_impact, float &time_of_exit)
     {
-        CollisionData collision_result;
+        time_of_impact = 0.f;
+        time_of_exit = 1.f;
+        auto clipOnAxis = [&](utils::Vector2f axis)
+        {
+            if (axis.x == 0.f && axis.y == 0.f) //! degenerate edge
+            {
+                return true;
+            }
+            auto proj1 = shape1.project(axis);
+            auto proj2 = shape2.project(axis);
+            //! shape1 at time t is shifted by (t - 1) * motion from its current position
+            const float offset_min = proj2.min - proj1.max; //! shifts along the axis at which the projections touch
+            const float offset_max = proj2.max - proj1.min;
+            const float speed = dot(motion, axis);
+            if (std::abs(speed) < 1e-6f)
+            {
+                return offset_min <= 0.f && 0.f <= offset_max;
+            }
+            float time_1 = 1.f + offset_min / speed;
+            float time_2 = 1.f + offset_max / speed;
+            if (time_1 > time_2)
+            {
+                std::swap(time_1, time_2);
+            }
+            time_of_impact = std::max(time_of_impact, time_1);
+            time_of_exit = std::min(time_of_exit, time_2);
+            return time_of_impact <= time_of_exit;
+        };
 
-        int next = 1;
-        const auto n_points1 = points1.size();
-        const auto n_points2 = points2.size();
+        for (auto shape : {&shape1, &shape2})
+        {
+            for (std::size_t i = 0; i < shape->count; ++i)
+            {
+                if (!clipOnAxis(shape->normals[i]))
+                {
+                    return false;
+                }
+            }
+        }
+        //! sides of the area swept by round shapes
+        if (shape1.isRound() || shape2.isRound())
+        {
+            utils::Vector2f side_normal = {-motion.y, motion.x};
+            return clipOnAxis(side_normal / norm(side_normal));
+        }
+        return true;
+    }
 
-        Edge contact_edge;
+    //! \brief separating axis test using edge normals cached in the polygons, projections are vectorized
+    CollisionData inline calcPolygonsCollisionData(const WorldPolygon &polygon1, const WorldPolygon &polygon2)
+    {
+        CollisionData collision_result;
 
         float min_overlap = std::numeric_limits<float>::max();
         utils::Vector2f &min_axis = collision_result.separation_axis;
-        for (int curr = 0; curr < n_points1; ++curr)
+        for (auto polygon : {&polygon1, &polygon2})
         {
-
-            auto t1 = points1[next] - points1[curr]; //! line perpendicular to current polygon edge
-            utils::Vector2f n1 = {t1.y, -t1.x};
-            if (utils::approx_equal_zero(norm2(n1)))
+            for (std::size_t i = 0; i < polygon->count; ++i)
             {
-                continue;
-            }
-            n1 /= norm(n1);
-            auto proj1 = projectOnAxis(n1, points1);
-            auto proj2 = projectOnAxis(n1, points2);
+                const auto &n1 = polygon->normals[i]; //! line perpendicular to polygon edge
+                if (n1.x == 0.f && n1.y == 0.f) //! degenerate edge
+                {
+                    continue;
+                }
+                auto proj1 = polygon1.project(n1);
+                auto proj2 = polygon2.project(n1);
 
-            if (!overlap1D(proj1, proj2))
-            {
-                collision_result.minimum_translation = -1;
-                return collision_result;
-            }
-            else
-            {
+                if (!overlap1D(proj1, proj2))
+                {
+                    collision_result.minimum_translation = -1;
+                    min_axis = n1; //! kept so that the next test of the pair can start with it
+                    return collision_result;
+                }
                 auto overlap = calcOverlap(proj1, proj2);
                 if (utils::approx_equal_zero(overlap))
                 {
@@ -294,86 +1102,391 @@ namespace Collisions
                 {
                     min_overlap = overlap;
                     min_axis = n1;
+                    collision_result.belongs_to_a = polygon == &polygon1;
                 }
             }
+        }
+
+        collision_result.minimum_translation = min_overlap;
+        return collision_result;
+    }
 
-            next++;
-            if (next == n_points1)
+    //! \brief closest points \p closest1 and \p closest2 of segments [\p p1, \p q1] and [\p p2, \p q2]
+    //! \brief segments of zero length are points
+    void inline closestPointsOfSegments(utils::Vector2f p1, utils::Vector2f q1, utils::Vector2f p2, utils::Vector2f q2,
+                                        utils::Vector2f &closest1, utils::Vector2f &closest2)
+    {
+        constexpr float epsilon = std::numeric_limits<float>::epsilon();
+        const auto d1 = q1 - p1;
+        const auto d2 = q2 - p2;
+        const auto r = p1 - p2;
+        const float length2_1 = norm2(d1);
+        const float length2_2 = norm2(d2);
+        const float f = dot(d2, r);
+
+        float s = 0.f; //! position on the first segment
+        float t = 0.f; //! position on the second segment
+        if (length2_1 <= epsilon && length2_2 > epsilon)
+        {
+            t = std::clamp(f / length2_2, 0.f, 1.f);
+        }
+        else if (length2_1 > epsilon)
+        {
+            const float c = dot(d1, r);
+            if (length2_2 <= epsilon)
+            {
+                s = std::clamp(-c / length2_1, 0.f, 1.f);
+            }
+            else
             {
-                next = 0;
+                const float b = dot(d1, d2);
+                const float denominator = length2_1 * length2_2 - b * b; //! zero for parallel segments
+                s = denominator > 0.f ? std::clamp((b * f - c * length2_2) / denominator, 0.f, 1.f) : 0.f;
+                t = (b * s + f) / length2_2;
+                if (t < 0.f)
+                {
+                    t = 0.f;
+                    s = std::clamp(-c / length2_1, 0.f, 1.f);
+                }
+                else if (t > 1.f)
+                {
+                    t = 1.f;
+                    s = std::clamp((b - c) / length2_1, 0.f, 1.f);
+                }
             }
         }
-        next = 1;
-        for (int curr = 0; curr < n_points2; ++curr)
+        closest1 = p1 + d1 * s;
+        closest2 = p2 + d2 * t;
+    }
+
+    //! \brief collision of spheres at \p center1 and \p center2, \p fallback_axis is used when the centers coincide
+    CollisionData inline calcSpheresCollisionData(utils::Vector2f center1, float radius1, utils::Vector2f center2, float radius2,
+                                                  utils::Vector2f fallback_axis)
+    {
+        CollisionData collision_result;
+        const auto dr = center2 - center1;
+        const float dist2 = norm2(dr);
+        const float radii = radius1 + radius2;
+        if (dist2 >= radii * radii)
         {
+            return collision_result;
+        }
+        const float dist = std::sqrt(dist2);
+        collision_result.separation_axis = dist > 0.f ? dr / dist : fallback_axis;
+        collision_result.minimum_translation = radii - dist;
+        collision_result.contact_point = center1 + collision_result.separation_axis * (radius1 - collision_result.minimum_translation / 2.f);
+        return collision_result;
+    }
+
+    CollisionData inline calcCirclesCollisionData(const WorldPolygon &circle1, const WorldPolygon &circle2)
+    {
+        return calcSpheresCollisionData(circle1.getPoint(0), circle1.radius, circle2.getPoint(0), circle2.radius, {1, 0});
+    }
+
+    //! \brief circles and capsules collide when their cores are closer than the sum of radii
+    CollisionData inline calcRoundShapesCollisionData(const WorldPolygon &shape1, const WorldPolygon &shape2)
+    {
+        utils::Vector2f closest1;
+        utils::Vector2f closest2;
+        closestPointsOfSegments(shape1.getPoint(0), shape1.getPoint(shape1.count - 1),
+                                shape2.getPoint(0), shape2.getPoint(shape2.count - 1), closest1, closest2);
+        auto fallback_axis = shape1.isCapsule() ? shape1.normals[0] : utils::Vector2f{1, 0};
+        if (dot(shape2.center - shape1.center, fallback_axis) < 0.f)
+        {
+            fallback_axis *= -1.f;
+        }
+        return calcSpheresCollisionData(closest1, shape1.radius, closest2, shape2.radius, fallback_axis);
+    }
 
-            auto t1 = points2[next] - points2[curr]; //! line perpendicular to current polygon edge
-            utils::Vector2f n1 = {t1.y, -t1.x};
-            if (utils::approx_equal_zero(norm2(n1)))
+    //! \brief finds the polygon edge closest to the circle center, the center is then either inside,
+    //! \brief or closest to the edge or to one of its vertices
+    CollisionData inline calcCirclePolygonCollisionData(const WorldPolygon &circle, const WorldPolygon &polygon)
+    {
+        CollisionData collision_result;
+        collision_result.belongs_to_a = false;
+
+        const auto center = circle.getPoint(0);
+        const float radius = circle.radius;
+        float max_separation = -std::numeric_limits<float>::max();
+        std::size_t face = 0;
+        for (std::size_t i = 0; i < polygon.count; ++i)
+        {
+            const auto &normal = polygon.normals[i];
+            if (normal.x == 0.f && normal.y == 0.f) //! degenerate edge
             {
                 continue;
             }
-            n1 /= norm(n1);
-            auto proj2 = projectOnAxis(n1, points2);
-            auto proj1 = projectOnAxis(n1, points1);
-
-            if (!overlap1D(proj1, proj2))
+            float separation = dot(normal, center - polygon.getPoint(i));
+            if (separation > radius)
             {
-                collision_result.minimum_translation = -1;
                 return collision_result;
             }
-            else
+            if (separation > max_separation)
             {
-                auto overlap = calcOverlap(proj1, proj2);
-                if (utils::approx_equal_zero(overlap))
-                {
-                    continue;
-                }
-                if (overlap < min_overlap)
-                {
-                    min_overlap = overlap;
-                    min_axis = n1;
-                    collision_result.belongs_to_a = false;
-                }
+                max_separation = separation;
+                face = i;
             }
+        }
+
+        const auto normal = polygon.normals[face];
+        if (max_separation <= 0.f) //! center is inside
+        {
+            collision_result.separation_axis = -1.f * normal;
+            collision_result.minimum_translation = radius - max_separation;
+            collision_result.contact_point = center - normal * max_separation;
+            return collision_result;
+        }
+
+        const auto v1 = polygon.getPoint(face);
+        const auto v2 = polygon.getPoint((face + 1) % polygon.count);
+        utils::Vector2f closest = center - normal * max_separation;
+        if (dot(center - v1, v2 - v1) <= 0.f)
+        {
+            closest = v1;
+        }
+        else if (dot(center - v2, v1 - v2) <= 0.f)
+        {
+            closest = v2;
+        }
+        const auto dr = closest - center;
+        const float dist2 = norm2(dr);
+        if (dist2 >= radius * radius)
+        {
+            return collision_result;
+        }
+        const float dist = std::sqrt(dist2);
+        collision_result.separation_axis = dist > 0.f ? dr / dist : -1.f * normal;
+        collision_result.minimum_translation = radius - dist;
+        collision_result.contact_point = closest;
+        return collision_result;
+    }
 
-            next++;
-            if (next == n_points2)
+    //! \brief uses the distance of the capsule core from the polygon outline when the core is outside,
+    //! \brief when the core reaches inside, the separating axes of the polygon and of the capsule are tested
+    CollisionData inline calcCapsulePolygonCollisionData(const WorldPolygon &capsule, const WorldPolygon &polygon)
+    {
+        const auto start = capsule.getPoint(0);
+        const auto end = capsule.getPoint(1);
+
+        float min_dist2 = std::numeric_limits<float>::max();
+        utils::Vector2f core_point;
+        utils::Vector2f outline_point;
+        bool start_is_inside = true;
+        for (std::size_t i = 0; i < polygon.count; ++i)
+        {
+            utils::Vector2f closest_core;
+            utils::Vector2f closest_outline;
+            const auto v1 = polygon.getPoint(i);
+            closestPointsOfSegments(start, end, v1, polygon.getPoint((i + 1) % polygon.count), closest_core, closest_outline);
+            const float dist2 = norm2(closest_core - closest_outline);
+            if (dist2 < min_dist2)
             {
-                next = 0;
+                min_dist2 = dist2;
+                core_point = closest_core;
+                outline_point = closest_outline;
             }
+            start_is_inside = start_is_inside && dot(polygon.normals[i], start - v1) <= 0.f;
         }
 
-        collision_result.minimum_translation = min_overlap;
+        CollisionData collision_result;
+        //! cores touching the outline are handled as reaching inside, so that the axis is not normalized from noise
+        const float touch_dist = 1e-3f * capsule.radius;
+        if (min_dist2 > touch_dist * touch_dist && !start_is_inside) //! the core does not reach inside the polygon
+        {
+            if (min_dist2 >= capsule.radius * capsule.radius)
+            {
+                return collision_result;
+            }
+            const float dist = std::sqrt(min_dist2);
+            collision_result.separation_axis = (outline_point - core_point) / dist;
+            collision_result.minimum_translation = capsule.radius - dist;
+            collision_result.contact_point = outline_point;
+            collision_result.belongs_to_a = false;
+            return collision_result;
+        }
+
+        //! the shortest push of the polygon out of the capsule along any of the axes separates them
+        collision_result.minimum_translation = std::numeric_limits<float>::max();
+        collision_result.belongs_to_a = false;
+        for (std::size_t i = 0; i <= polygon.count; ++i)
+        {
+            const auto axis = i < polygon.count ? polygon.normals[i] : capsule.normals[0];
+            if (axis.x == 0.f && axis.y == 0.f) //! degenerate edge
+            {
+                continue;
+            }
+            const auto capsule_projection = capsule.project(axis);
+            const auto polygon_projection = polygon.project(axis);
+            const float forward_push = capsule_projection.max - polygon_projection.min;
+            const float backward_push = polygon_projection.max - capsule_projection.min;
+            if (std::min(forward_push, backward_push) < collision_result.minimum_translation)
+            {
+                collision_result.minimum_translation = std::min(forward_push, backward_push);
+                collision_result.separation_axis = forward_push <= backward_push ? axis : -1.f * axis;
+                collision_result.belongs_to_a = i == polygon.count;
+            }
+        }
+        collision_result.contact_point = start_is_inside ? (start + end) / 2.f : core_point;
         return collision_result;
     }
 
-    int inline furthestVertex(utils::Vector2f separation_axis, const std::vector<utils::Vector2f> &points)
+    //! \brief finds where segment from \p from to \p to first enters the circle or capsule \p shape
+    bool inline intersectRoundShape(utils::Vector2f from, utils::Vector2f to, const WorldPolygon &shape,
+                                    utils::Vector2f &intersection)
+    {
+        const auto dir = to - from;
+        const float length2 = norm2(dir);
+        if (length2 == 0.f)
+        {
+            return false;
+        }
+
+        //! circles and capsules are convex, so a segment starting inside crosses the outline once, where it leaves
+        //! the last exit of the parts (end spheres and sides) is that crossing, the first entry otherwise
+        utils::Vector2f closest_core;
+        utils::Vector2f closest_from;
+        closestPointsOfSegments(shape.getPoint(0), shape.getPoint(shape.count - 1), from, from, closest_core, closest_from);
+        const bool starts_inside = norm2(from - closest_core) < shape.radius * shape.radius;
+
+        float min_t = std::numeric_limits<float>::max();
+        float max_t = -1.f;
+        //! sphere around each point of the core
+        for (std::size_t i = 0; i < shape.count; ++i)
+        {
+            const auto dr = from - shape.getPoint(i);
+            const float b = dot(dr, dir);
+            const float c = norm2(dr) - shape.radius * shape.radius;
+            const float discriminant = b * b - length2 * c;
+            if (discriminant < 0.f)
+            {
+                continue;
+            }
+            const float t_in = (-b - std::sqrt(discriminant)) / length2;
+            const float t_out = (-b + std::sqrt(discriminant)) / length2;
+            if (t_in >= 0.f && t_in <= 1.f)
+            {
+                min_t = std::min(min_t, t_in);
+            }
+            max_t = std::max(max_t, t_out);
+        }
+        //! sides of the capsule
+        if (shape.isCapsule())
+        {
+            const auto offset = shape.normals[0] * shape.radius;
+            for (auto side_offset : {offset, -1.f * offset})
+            {
+                utils::Vector2f side_intersection;
+                if (utils::segmentsIntersect(shape.getPoint(0) + side_offset, shape.getPoint(1) + side_offset,
+                                             from, to, side_intersection))
+                {
+                    const float t = std::sqrt(norm2(side_intersection - from) / length2);
+                    min_t = std::min(min_t, t);
+                    max_t = std::max(max_t, t);
+                }
+            }
+        }
+        const float t = starts_inside ? max_t : min_t;
+        if (t < 0.f || t > 1.f)
+        {
+            return false;
+        }
+        intersection = from + dir * t;
+        return true;
+    }
+
+    //! \brief clips the segment from \p from to \p to by the edges of convex \p polygon
+    //! \returns true if the segment crosses the outline, \p time is then the fraction of the segment
+    //! \returns at the first crossing and \p normal the outward normal of the crossed edge
+    bool inline intersectPolygon(utils::Vector2f from, utils::Vector2f to, const WorldPolygon &polygon,
+                                 float &time, utils::Vector2f &normal)
     {
-        float max_dist = -std::numeric_limits<float>::max();
-        int index = -1;
-        for (int i = 0; i < points.size(); ++i)
+        const auto dir = to - from;
+        float time_in = 0.f;
+        float time_out = 1.f;
+        utils::Vector2f normal_in = {0, 0};
+        utils::Vector2f normal_out = {0, 0};
+        for (std::size_t i = 0; i < polygon.count; ++i)
         {
-            auto dist = dot(points[i], separation_axis);
-            if (dist > max_dist)
+            const auto &edge_normal = polygon.normals[i];
+            if (edge_normal.x == 0.f && edge_normal.y == 0.f) //! degenerate edge
+            {
+                continue;
+            }
+            const float distance = dot(edge_normal, polygon.getPoint(i) - from); //! positive if from is inside the edge
+            const float speed = dot(edge_normal, dir);
+            if (speed == 0.f)
+            {
+                if (distance < 0.f)
+                {
+                    return false;
+                }
+                continue;
+            }
+            const float edge_time = distance / speed;
+            if (speed < 0.f && edge_time > time_in) //! entering
+            {
+                time_in = edge_time;
+                normal_in = edge_normal;
+            }
+            else if (speed > 0.f && edge_time < time_out) //! leaving
+            {
+                time_out = edge_time;
+                normal_out = edge_normal;
+            }
+            if (time_in > time_out)
             {
-                index = i;
-                max_dist = dist;
+                return false;
             }
         }
+        if (normal_in.x != 0.f || normal_in.y != 0.f)
+        {
+            time = time_in;
+            normal = normal_in;
+            return true;
+        }
+        //! the segment starts inside, so it crosses the outline where it leaves
+        if (normal_out.x != 0.f || normal_out.y != 0.f)
+        {
+            time = time_out;
+            normal = normal_out;
+            return true;
+        }
+        return false;
+    }
 
-        return index;
+    //! \brief first crossing of the segment from \p from to \p to with the outline of \p shape
+    //! \returns true if there is one, \p time is the fraction of the segment and \p normal points out of the shape
+    bool inline intersectShape(utils::Vector2f from, utils::Vector2f to, const WorldPolygon &shape,
+                               float &time, utils::Vector2f &normal)
+    {
+        if (!shape.isRound())
+        {
+            return intersectPolygon(from, to, shape, time, normal);
+        }
+        utils::Vector2f intersection;
+        if (!intersectRoundShape(from, to, shape, intersection))
+        {
+            return false;
+        }
+        utils::Vector2f closest_core;
+        utils::Vector2f closest_intersection;
+        closestPointsOfSegments(shape.getPoint(0), shape.getPoint(shape.count - 1), intersection, intersection,
+                                closest_core, closest_intersection);
+        normal = intersection - closest_core;
+        normal /= norm(normal);
+        time = std::sqrt(norm2(intersection - from) / norm2(to - from));
+        return true;
     }
 
-    CollisionFeature inline obtainFeatures(const utils::Vector2f axis, const std::vector<utils::Vector2f> &points)
+    CollisionFeature inline obtainFeatures(const utils::Vector2f axis, const WorldPolygon &polygon)
     {
 
-        const auto n_points = points.size();
-        auto furthest_v_ind1 = furthestVertex(axis, points);
+        const auto n_points = polygon.count;
+        auto furthest_v_ind1 = polygon.furthestVertex(axis);
 
-        auto v1 = points[furthest_v_ind1];
-        auto v1_next = points[(furthest_v_ind1 + 1) % n_points];
-        auto v1_prev = points[(furthest_v_ind1 - 1 + n_points) % n_points];
+        auto v1 = polygon.getPoint(furthest_v_ind1);
+        auto v1_next = polygon.getPoint((furthest_v_ind1 + 1) % n_points);
+        auto v1_prev = polygon.getPoint((furthest_v_ind1 - 1 + n_points) % n_points);
 
         auto from_next = v1 - v1_next;
         auto from_prev = v1 - v1_prev;
@@ -392,19 +1505,19 @@ namespace Collisions
         return feature;
     }
 
-    std::vector<utils::Vector2f> inline clip(utils::Vector2f v1, utils::Vector2f v2, utils::Vector2f n, float overlap)
+    ContactPoints inline clip(utils::Vector2f v1, utils::Vector2f v2, utils::Vector2f n, float overlap)
     {
 
-        std::vector<utils::Vector2f> cp;
+        ContactPoints cp;
         float d1 = dot(v1, n) - overlap;
         float d2 = dot(v2, n) - overlap;
         if (d1 >= 0.0)
         {
-            cp.push_back(v1);
+            cp.push(v1);
         }
         if (d2 >= 0.0)
         {
-            cp.push_back(v2);
+            cp.push(v2);
         }
         if (d1 * d2 < 0.0)
         {
@@ -414,12 +1527,12 @@ namespace Collisions
             float u = d1 / (d1 - d2);
             e *= u;
             e += v1;
-            cp.push_back(e);
+            cp.push(e);
         }
         return cp;
     }
 
-    std::vector<utils::Vector2f> inline clipEdges(CollisionFeature &ref_features, CollisionFeature &inc_features, utils::Vector2f n)
+    ContactPoints inline clipEdges(CollisionFeature &ref_features, CollisionFeature &inc_features, utils::Vector2f n)
     {
 
         auto &ref_edge = ref_features.edge;
@@ -441,17 +1554,16 @@ namespace Collisions
         // clip the incident edge by the first
         // vertex of the reference edge
         auto cp = clip(inc_edge.from, inc_edge.to(), ref_v, o1);
-        auto cp_new = cp;
         // if we dont have 2 points left then fail
-        if (cp.size() < 2)
+        if (cp.count < 2)
         {
             return {};
         }
 
         double o2 = dot(ref_v, ref_edge.to());
-        cp = clip(cp[0], cp[1], -ref_v, -o2);
+        cp = clip(cp.points[0], cp.points[1], -ref_v, -o2);
         // if we dont have 2 points left then fail
-        if (cp.size() < 2)
+        if (cp.count < 2)
         {
             return {};
         }
@@ -463,19 +1575,15 @@ namespace Collisions
         double max = dot(refNorm, ref_features.best_vertex);
         // make sure the final points are not past this maximum
 
-        std::vector<float> depths(2);
-        depths[0] = dot(refNorm, cp.at(0)) - max;
-        depths[1] = dot(refNorm, cp.at(1)) - max;
-
-        if (depths[0] < 0.0f)
-        {
-            cp.erase(cp.begin());
-        }
-        if (depths[1] < 0.0f)
+        ContactPoints deep_cp;
+        for (std::size_t i = 0; i < cp.count; ++i)
         {
-            cp.pop_back();
+            if (dot(refNorm, cp.points[i]) - max >= 0.0f)
+            {
+                deep_cp.push(cp.points[i]);
+            }
         }
-        return cp;
+        return deep_cp;
     }
 
     void bounce(GameObject &obj1, GameObject &obj2, CollisionData c_data)
@@ -540,18 +1648,18 @@ namespace Collisions
             drawComponent(m_components.data[comp_id], canvas);
         }
 
-        //! draw physics collisions
-        for (auto &[obj1, obj2, c_data] : collisions)
+        //! draw collisions of the last frame, when they are traced
+        for (std::size_t i = m_trace.size(); i > 0 && m_trace.at(i - 1).tick == m_tick; --i)
         {
-            canvas.drawCricleBatched(obj1->getPosition(), 2., {1, 0, 0, 1});
-            canvas.drawCricleBatched(obj2->getPosition(), 2., {0, 1, 1, 1});
+            auto &record = m_trace.at(i - 1);
+            canvas.drawCricleBatched(record.contact_point, 2., {1, 0, 0, 1});
 
             //! separation axis
-            canvas.drawLineBatched(c_data.contact_point, c_data.contact_point + 10. * c_data.separation_axis, 0.2, {0, 0, 1, 1});
+            canvas.drawLineBatched(record.contact_point, record.contact_point + 10. * record.separation_axis, 0.2, {0, 0, 1, 1});
         }
-        collisions.clear();
     }
 
+    //! \brief pairs of colliders of types \p type_a and \p type_b are given to \p callback, the first collider has \p type_a
     void CollisionSystem::registerResolver(ObjectType type_a, ObjectType type_b, CollisionCallbackT callback)
     {
         if (!callback)
@@ -565,8 +1673,81 @@ namespace Collisions
                 obj_b.onCollisionWith(obj_a, c_data);
             };
         }
+        //! the broadphase finds each pair once, so the types may collide through one resolver only
+        assert(type_a == type_b || !m_registered_resolvers.contains({(int)type_b, (int)type_a}));
 
-        m_registered_resolvers.insert({{(int)type_a, (int)type_b}, callback});
+        m_registered_resolvers.insert({{(int)type_a, (int)type_b}, Resolver{callback}});
+
+        //! resolvers run in order of their types, so that it does not depend on hashing
+        m_resolver_order.clear();
+        for (auto &[type_pair, resolver] : m_registered_resolvers)
+        {
+            m_resolver_order.push_back({type_pair, &resolver});
+        }
+        std::sort(m_resolver_order.begin(), m_resolver_order.end(), [](const auto &a, const auto &b)
+                  { return a.first < b.first; });
+
+        //! the table tells the resolver of a pair of types in both orders
+        const auto type_count = static_cast<std::size_t>(ObjectType::Count);
+        m_resolver_table.fill({});
+        for (std::size_t resolver_index = 0; resolver_index < m_resolver_order.size(); ++resolver_index)
+        {
+            auto [first_type, second_type] = m_resolver_order[resolver_index].first;
+            m_resolver_table[first_type * type_count + second_type] = {static_cast<int>(resolver_index), false};
+            if (first_type != second_type)
+            {
+                m_resolver_table[second_type * type_count + first_type] = {static_cast<int>(resolver_index), true};
+            }
+        }
+    }
+
+    //! \brief switches the structure used to find close pairs of all colliders
+    void CollisionSystem::setBroadphase(Broadphase broadphase)
+    {
+        if (broadphase == m_broadphase)
+        {
+            return;
+        }
+        m_broadphase = broadphase;
+        m_sweep.clear();
+        if (m_broadphase == Broadphase::SweepAndPrune)
+        {
+            fillSweep();
+        }
+    }
+
+    Broadphase CollisionSystem::getBroadphase() const
+    {
+        return m_broadphase;
+    }
+
+    //! \brief when \p call_on_stay is false, the callback of the resolver is called only when a contact begins
+    void CollisionSystem::setCallOnStay(ObjectType type_a, ObjectType type_b, bool call_on_stay)
+    {
+        m_registered_resolvers.at({(int)type_a, (int)type_b}).call_on_stay = call_on_stay;
+    }
+
+    const ResolversT &CollisionSystem::getResolvers() const
+    {
+        return m_registered_resolvers;
+    }
+
+    //! \brief fills the sweep with the rects that are in the tree
+    void CollisionSystem::fillSweep()
+    {
+        std::vector<AABB> rects;
+        std::vector<int> ids;
+        for (std::size_t comp_id = 0; comp_id < m_components.data.size(); ++comp_id)
+        {
+            auto entity_ind = m_components.data_ind2id[comp_id];
+            if (m_tree.containsObject(entity_ind))
+            {
+                rects.push_back(m_tree.getObjectRect(entity_ind));
+                ids.push_back(entity_ind);
+            }
+        }
+        m_sweep.addRects(rects, ids);
+        m_sweep.sort();
     }
 
 } //! namespace collisions
@@ -1,7 +1,11 @@
 #pragma once
 
 #include "BVH.h"
+#include "CollisionTrace.h"
+#include "ContactSolver.h"
+#include "SweepAndPrune.h"
 
+#include <array>
 #include <memory>
 #include <vector>
 #include <unordered_set>
@@ -14,6 +18,7 @@
 #include "PostOffice.h"
 #include "Systems/System.h"
 #include "Renderer.h"
+#include "Utils/ThreadPool.h"
 
 namespace Collisions
 {
@@ -26,18 +31,125 @@ namespace Collisions
         }
     };
 
+    //! \brief how much bigger than the fitting rects are the rects stored in the collision trees
+    struct FatRectSettings
+    {
+        float margin = 0.2f;              //! fraction of the rect size added to it
+        float velocity_lookahead = 0.25f; //! rects are extended along velocity to cover this many seconds of motion
+    };
+
+    //! \brief numbers of collision tree leaves which had to be updated this frame
+    struct TreeUpdateStats
+    {
+        std::array<std::size_t, static_cast<std::size_t>(ObjectType::Count)> reinserts = {};      //! leaves moved in the tree
+        std::array<std::size_t, static_cast<std::size_t>(ObjectType::Count)> in_place_moves = {}; //! leaves only refitted
+
+        void reset()
+        {
+            reinserts.fill(0);
+            in_place_moves.fill(0);
+        }
+    };
+
+    //! \brief work of the shared broadphase in this frame
+    struct BroadphaseStats
+    {
+        float sweep_sort_time_ms = 0.f; //! only when the sweep is the broadphase
+        std::size_t sweep_swaps = 0;
+        std::size_t candidate_pair_count = 0; //! pairs of overlapping rects found by the self query
+        std::size_t accepted_pair_count = 0;  //! candidates which passed the layer masks and have a resolver
+        float static_rebuild_time_ms = 0.f;   //! zero in frames without a rebuild of the static tree
+
+        void reset()
+        {
+            sweep_sort_time_ms = 0.f;
+            sweep_swaps = 0;
+            candidate_pair_count = 0;
+            accepted_pair_count = 0;
+            static_rebuild_time_ms = 0.f;
+        }
+    };
+
+    //! \brief structure shared by all colliders which finds pairs of objects whose rects overlap
+    enum class Broadphase
+    {
+        BoundingVolumeTree, //! good for sparse or mostly static objects
+        SweepAndPrune,      //! good for dense crowds moving a little each frame
+    };
+
     using CollisionCallbackT = std::function<void(GameObject &, GameObject &, CollisionData)>;
+
+    //! \brief ray of a batched raycast, stopped by objects of types in \p type_mask
+    struct RayQuery
+    {
+        utils::Vector2f from;
+        utils::Vector2f dir; //! unit direction
+        float length;
+        ObjectTypeMask type_mask;
+    };
+
+    struct Resolver
+    {
+        CollisionCallbackT callback;
+        bool call_on_stay = true; //! callback is called in each frame of a contact, otherwise only when it begins
+        std::size_t close_pair_count = 0; //! pairs given to the resolver by the broadphase in the last frame
+    };
+    using ResolversT = std::unordered_map<std::pair<int, int>, Resolver, pair_hash>;
+
+    //! \brief state of a pair of entities with overlapping rects, kept between frames
+    struct CachedPair
+    {
+        CollisionData data;                 //! manifold of the last frame in which the pair touched
+        utils::Vector2f separating_axis = {0, 0}; //! axis which separated the shapes in the last frame, zero if not known
+        std::size_t first_contact_tick = 0; //! frame in which the current contact began
+        std::size_t last_tick = 0;          //! last frame in which the pair was tested
+        ObjectType type_a;
+        ObjectType type_b;
+        bool is_touching = false;
+        ContactImpulse impulse; //! impulse of the contact solver in the last frame, zero when the pair does not touch
+    };
+
+    //! \brief time spent in each stage of finding collisions during the last frame
+    struct PipelineStats
+    {
+        float transform_time_ms = 0.f;   //! moving shapes to their entities
+        float refit_time_ms = 0.f;       //! updating trees and sweeps
+        float pairs_time_ms = 0.f;       //! finding close pairs
+        float narrowphase_time_ms = 0.f; //! testing close pairs for collisions
+        float dispatch_time_ms = 0.f;    //! calling collision callbacks
+        std::size_t pair_batch_count = 0;
+        std::size_t transformed_shape_count = 0; //! shapes whose cached world geometry had to be recomputed
+        std::size_t cached_pair_count = 0;
+        std::size_t axis_early_out_count = 0; //! pairs still separated by the axis cached in the last frame
+        std::size_t swept_pair_count = 0;     //! pairs with a moving continuous body, tested over the whole motion
+        std::size_t swept_contact_count = 0;  //! earliest contacts of continuous bodies found by the sweeps
+        std::size_t sensor_pair_count = 0;    //! pairs with a sensor, tested for overlap only
+        float solver_time_ms = 0.f;           //! resolving contacts of physics bodies
+    };
+
     class CollisionSystem : public SystemI
     {
 
         std::unordered_map<int, std::weak_ptr<GameObject>> m_objects;
-        std::unordered_map<ObjectType, BoundingVolumeTree> m_object_type2tree;
+
+        //! one broadphase holds moving colliders of all types, pairs of all resolvers are found by a single self query
+        BoundingVolumeTree m_tree;
+        SweepAndPrune m_sweep; //! holds the same rects as the tree, only filled when it is the broadphase
+        Broadphase m_broadphase = Broadphase::BoundingVolumeTree;
+
+        //! static colliders are only queried by the moving ones, the tree is built in bulk and never refitted
+        BoundingVolumeTree m_static_tree;
+        std::vector<int> m_static_ids;      //! entities of inserted static colliders, in order of insertion
+        bool m_static_rebuild_requested = false;
 
     public:
-        CollisionSystem(PostOffice &messanger, ContiguousColony<CollisionComponent, int> &comps);
+        CollisionSystem(PostOffice &messanger, ContiguousColony<CollisionComponent, int> &comps,
+                        ContiguousColony<PhysicsComponent, int> &bodies, utils::ThreadPool &workers);
 
         void insertObject(GameObject &obj);
+        void insertObjects(const std::vector<GameObject *> &objects);
         void removeObject(GameObject &object);
+        void removeObjects(const std::vector<GameObject *> &objects);
 
         virtual void preUpdate(float dt, EntityRegistryT &entities) override;
         virtual void update(float dt) override {}
@@ -45,32 +157,171 @@ namespace Collisions
 
         void draw(Renderer &canvas);
 
+        BoundingVolumeTree &getTree();
+        BoundingVolumeTree &getStaticTree();
+        void requestStaticRebuild();
+
         void registerResolver(ObjectType type_a, ObjectType type_b, CollisionCallbackT callback = nullptr);
+        void setBroadphase(Broadphase broadphase);
+        Broadphase getBroadphase() const;
+        void setCallOnStay(ObjectType type_a, ObjectType type_b, bool call_on_stay);
+        const ResolversT &getResolvers() const;
 
         std::vector<int> findNearestObjectInds(ObjectType type, utils::Vector2f center, float radius) const;
         std::vector<CollisionComponent *> findNearestObjects(ObjectType type, utils::Vector2f center, float radius) const;
         std::vector<CollisionComponent *> findIntersections(ObjectType type, Polygon collision_body);
         std::vector<int> findIntersectingObjectInds(ObjectType type, Polygon collision_body);
 
-        utils::Vector2f findClosestIntesection(ObjectType type, utils::Vector2f at, utils::Vector2f dir, float length);
+        //! queries which append results to caller owned buffers, so that the buffers can be reused between frames
+        void findNearestObjects(ObjectType type, utils::Vector2f center, float radius,
+                                std::vector<CollisionComponent *> &nearest) const;
+        void findIntersections(ObjectType type, const Polygon &collision_body,
+                               std::vector<CollisionComponent *> &intersecting) const;
+        void findIntersectionsBatch(ObjectType type, const std::vector<Polygon> &collision_bodies,
+                                    std::vector<std::pair<int, CollisionComponent *>> &intersecting);
+
+        template <class VisitorT>
+        void forEachNearestObject(ObjectType type, utils::Vector2f center, float radius, VisitorT &&visitor) const;
+
+        utils::Vector2f findClosestIntesection(ObjectType type, utils::Vector2f at, utils::Vector2f dir, float length) const;
+        RayCastData rayCast(utils::Vector2f from, utils::Vector2f dir, float length, ObjectTypeMask type_mask) const;
+        void rayCastBatch(const std::vector<RayQuery> &rays, std::vector<RayCastData> &hits);
+
+    public:
+        FatRectSettings m_fat_rect_settings;
+        TreeUpdateStats m_tree_update_stats;
+        BroadphaseStats m_broadphase_stats;
+        PipelineStats m_pipeline_stats;
+        CollisionTrace m_trace; //! last collisions for debugging, disabled by default
+        ContactSolver m_solver; //! resolves contacts between entities with a PhysicsComponent
 
     private:
-        void shapesCollide(const std::vector<Polygon> &shape1, const std::vector<Polygon> &shape2,
-                           GameObject &obj1, GameObject &obj2, CollisionCallbackT &callback);
-        void narrowPhase2(const std::vector<std::pair<int, int>> &colliding_pairs,
-                          EntityRegistryT &entities,
-                          CollisionCallbackT &callback);
+        //! result of the narrowphase for one close pair, pairs which do not touch keep the separating axis
+        struct Contact
+        {
+            int entity_a;
+            int entity_b;
+            CollisionData data;
+        };
+
+        //! resolver of a pair of types in the flat resolver table
+        struct ResolverSlot
+        {
+            int resolver_index = -1; //! into m_resolver_order, -1 if the types do not collide
+            bool is_swapped = false; //! the resolver was registered with the types in the other order
+        };
+
+        //! layers of a collider copied from its component, so that the broadphase filters pairs without map lookups
+        struct ColliderLayers
+        {
+            ObjectType type;
+            ObjectTypeMask category = 0;
+            ObjectTypeMask mask = 0;
+        };
+
+        //! range of close pairs of one resolver tested together on one thread
+        struct PairBatch
+        {
+            std::size_t resolver_index;
+            std::size_t first_pair;
+            std::size_t end_pair;
+        };
+
+        //! numbers of pairs counted by the narrowphase of one batch
+        struct NarrowPhaseCounts
+        {
+            std::size_t axis_early_outs = 0;
+            std::size_t swept_pairs = 0;
+            std::size_t sensor_pairs = 0;
+        };
+
+        static constexpr std::size_t k_transform_batch_size = 256;
+        static constexpr std::size_t k_narrowphase_batch_size = 64;
+        static constexpr std::size_t k_ray_batch_size = 32;
+        static constexpr std::size_t k_max_sweep_samples = 16; //! most probes of one overlap range of a swept round shape
 
-        CollisionData getCollisionData(const Polygon &pa, const  Polygon &pb) const;
+        void rebuildStatic(EntityRegistryT &entities);
+        void refitBroadphase(EntityRegistryT &entities);
+        void findClosePairs();
+        void setLayers(int entity_id, const CollisionComponent &comp);
+        NarrowPhaseCounts narrowPhase(const PairBatch &batch, std::vector<Contact> &contacts) const;
+        void dispatchContacts(EntityRegistryT &entities);
+        void endContact(const std::pair<int, int> &entity_pair, const CachedPair &cached_pair);
+        bool shapesCollide(const std::vector<WorldPolygon> &shape1, const std::vector<WorldPolygon> &shape2,
+                           CollisionData &collision_data) const;
+        bool sweptShapesCollide(const std::vector<WorldPolygon> &shape1, utils::Vector2f motion,
+                                const std::vector<WorldPolygon> &shape2, CollisionData &collision_data) const;
+        static bool shapesOverlap(const std::vector<WorldPolygon> &shape1, const std::vector<WorldPolygon> &shape2,
+                                  utils::Vector2f &separating_axis);
+        static bool areSeparatedAlong(const std::vector<WorldPolygon> &shape1, const std::vector<WorldPolygon> &shape2,
+                                      utils::Vector2f axis);
+
+        CollisionData getCollisionData(const WorldPolygon &pa, const WorldPolygon &pb) const;
+        AABB makeFatRect(AABB fitting_rect, utils::Vector2f vel) const;
+        void fillSweep();
+        template <class VisitorT>
+        void forEachIntersectingCollider(const AABB &rect, VisitorT &&visitor) const;
 
     private:
         PostOffice *p_post_office;
-        std::unordered_map<std::pair<int, int>, CollisionCallbackT, pair_hash> m_registered_resolvers;
+        ResolversT m_registered_resolvers;
         std::unordered_set<std::pair<int, int>, pair_hash> m_collided2;
 
         ContiguousColony<CollisionComponent, int> &m_components;
+
+        utils::ThreadPool &m_workers; //! shared with other systems, owned by the GameWorld
+
+        std::array<ResolverSlot, static_cast<std::size_t>(ObjectType::Count) * static_cast<std::size_t>(ObjectType::Count)>
+            m_resolver_table; //! indexed by type_a * ObjectType::Count + type_b
+        std::vector<ColliderLayers> m_entity_layers; //! indexed by entity id
+
+        //! buffers of the collision pipeline reused between frames
+        std::vector<std::pair<std::pair<int, int>, Resolver *>> m_resolver_order; //! resolvers sorted by their types
+        std::vector<std::vector<std::pair<int, int>>> m_resolver_pairs;          //! close pairs of each resolver
+        std::vector<PairBatch> m_pair_batches;
+        std::vector<std::vector<Contact>> m_batch_contacts; //! contacts found in each pair batch
+
+        //! pairs of entities tested in the last frame, used to tell beginning contacts from staying ones
+        std::unordered_map<std::pair<int, int>, CachedPair, pair_hash> m_pair_cache;
+        std::size_t m_tick = 0;
+        std::vector<int> m_removed_ids; //! entities removed since the last frame, whose contacts end
+        std::vector<ContactBeginEvent> m_begin_events;
+        std::vector<ContactStayEvent> m_stay_events;
+        std::vector<ContactEndEvent> m_end_events;
+        std::unordered_map<int, float> m_earliest_impacts; //! earliest time of impact of each continuous body in this frame
+
+        //! buffers reused between frames so that queries do not allocate
+        std::vector<AABB> m_query_rects;
+        std::vector<WorldPolygon> m_query_bodies;
     };
 
+    //! \brief calls \p visitor(entity_id) for each static or moving collider whose rect intersects \p rect
+    template <class VisitorT>
+    void CollisionSystem::forEachIntersectingCollider(const AABB &rect, VisitorT &&visitor) const
+    {
+        m_static_tree.forEachIntersecting(rect, visitor);
+        m_tree.forEachIntersecting(rect, visitor);
+    }
+
+    //! \brief calls \p visitor(CollisionComponent&) for each object of \p type
+    //! \brief whose shape intersects circle at \p center with \p radius
+    template <class VisitorT>
+    void CollisionSystem::forEachNearestObject(ObjectType type, utils::Vector2f center, float radius, VisitorT &&visitor) const
+    {
+        AABB collision_rect({center - utils::Vector2f{radius, radius}, center + utils::Vector2f{radius, radius}});
+        forEachIntersectingCollider(collision_rect, [&](int ind)
+                                    {
+            if (m_entity_layers[ind].type != type)
+            {
+                return;
+            }
+            auto &collision_comp = m_components.get(ind);
+            if (collision_comp.shape.world_shapes[0].overlapsSphere(center, radius))
+            {
+                visitor(collision_comp);
+            } });
+    }
+
     struct Edge
     {
         utils::Vector2f from;
@@ -92,13 +343,39 @@ namespace Collisions
         Edge edge;
     };
 
-    CollisionData inline calcCollisionData(const std::vector<utils::Vector2f> &points1,
-                                           const std::vector<utils::Vector2f> &points2);
-    int inline furthestVertex(utils::Vector2f separation_axis, const std::vector<utils::Vector2f> &points);
-    CollisionFeature inline obtainFeatures(const utils::Vector2f axis, const std::vector<utils::Vector2f> &points);
-    std::vector<utils::Vector2f> inline clip(utils::Vector2f v1, utils::Vector2f v2, utils::Vector2f n, float overlap);
+    //! \brief result of clipping, which never has more than two points
+    struct ContactPoints
+    {
+        std::array<utils::Vector2f, 2> points;
+        std::size_t count = 0;
+
+        void push(utils::Vector2f point)
+        {
+            assert(count < points.size());
+            points[count++] = point;
+        }
+    };
+
+    CollisionData inline calcCollisionData(const WorldPolygon &shape1, const WorldPolygon &shape2);
+    CollisionData inline calcPolygonsCollisionData(const WorldPolygon &polygon1, const WorldPolygon &polygon2);
+    CollisionData inline calcCirclesCollisionData(const WorldPolygon &circle1, const WorldPolygon &circle2);
+    CollisionData inline calcRoundShapesCollisionData(const WorldPolygon &shape1, const WorldPolygon &shape2);
+    CollisionData inline calcCirclePolygonCollisionData(const WorldPolygon &circle, const WorldPolygon &polygon);
+    CollisionData inline calcCapsulePolygonCollisionData(const WorldPolygon &capsule, const WorldPolygon &polygon);
+    bool inline testOverlap(const WorldPolygon &shape1, const WorldPolygon &shape2, utils::Vector2f &separating_axis);
+    bool inline testPolygonsOverlap(const WorldPolygon &polygon1, const WorldPolygon &polygon2, utils::Vector2f &separating_axis);
+    bool inline calcSweptOverlap(const WorldPolygon &shape1, utils::Vector2f motion, const WorldPolygon &shape2,
+                                 float &time_of_impact, float &time_of_exit);
+    bool inline intersectRoundShape(utils::Vector2f from, utils::Vector2f to, const WorldPolygon &shape,
+                                    utils::Vector2f &intersection);
+    bool inline intersectPolygon(utils::Vector2f from, utils::Vector2f to, const WorldPolygon &polygon,
+                                 float &time, utils::Vector2f &normal);
+    bool inline intersectShape(utils::Vector2f from, utils::Vector2f to, const WorldPolygon &shape,
+                               float &time, utils::Vector2f &normal);
+    CollisionFeature inline obtainFeatures(const utils::Vector2f axis, const WorldPolygon &polygon);
+    ContactPoints inline clip(utils::Vector2f v1, utils::Vector2f v2, utils::Vector2f n, float overlap);
 
-    std::vector<utils::Vector2f> inline clipEdges(
+    ContactPoints inline clipEdges(
         CollisionFeature &ref_features,
         CollisionFeature &inc_features,
         utils::Vector2f n);
@@ -0,0 +1,166 @@
+#include "CollisionTrace.h"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+
+namespace Collisions
+{
+
+    //! binary dump starts with the magic, the version and the number of records, records follow from the oldest one
+    //! all values are stored in the byte order of the machine which made the dump
+    constexpr char k_trace_magic[4] = {'C', 'T', 'R', 'C'};
+    constexpr std::uint32_t k_trace_version = 1;
+
+    CollisionTrace::CollisionTrace(std::size_t capacity)
+        : m_capacity(std::max<std::size_t>(capacity, 1))
+    {
+    }
+
+    void CollisionTrace::setEnabled(bool enabled)
+    {
+        if (enabled == m_enabled)
+        {
+            return;
+        }
+        m_enabled = enabled;
+        if (enabled)
+        {
+            m_records.resize(m_capacity);
+        }
+        else
+        {
+            std::vector<CollisionTraceRecord>().swap(m_records);
+        }
+        m_next = 0;
+        m_size = 0;
+    }
+
+    //! \brief changing the capacity throws away recorded collisions
+    void CollisionTrace::setCapacity(std::size_t capacity)
+    {
+        m_capacity = std::max<std::size_t>(capacity, 1);
+        if (m_enabled)
+        {
+            m_records.assign(m_capacity, {});
+        }
+        m_next = 0;
+        m_size = 0;
+    }
+
+    std::size_t CollisionTrace::getCapacity() const
+    {
+        return m_capacity;
+    }
+
+    void CollisionTrace::clear()
+    {
+        m_next = 0;
+        m_size = 0;
+    }
+
+    std::size_t CollisionTrace::size() const
+    {
+        return m_size;
+    }
+
+    //! \param index  0 is the oldest record
+    const CollisionTraceRecord &CollisionTrace::at(std::size_t index) const
+    {
+        assert(index < m_size);
+        auto oldest = (m_next + m_records.size() - m_size) % m_records.size();
+        return m_records[(oldest + index) % m_records.size()];
+    }
+
+    template <class ValueT>
+    static void writeValue(std::ofstream &file, const ValueT &value)
+    {
+        file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    template <class ValueT>
+    static void readValue(std::ifstream &file, ValueT &value)
+    {
+        file.read(reinterpret_cast<char *>(&value), sizeof(value));
+    }
+
+    //! \returns true if all records were written into \p file_path
+    bool CollisionTrace::dump(const std::filesystem::path &file_path) const
+    {
+        std::ofstream file(file_path, std::ios::binary);
+        if (!file)
+        {
+            return false;
+        }
+        file.write(k_trace_magic, sizeof(k_trace_magic));
+        writeValue(file, k_trace_version);
+        writeValue(file, static_cast<std::uint64_t>(m_size));
+        for (std::size_t i = 0; i < m_size; ++i)
+        {
+            const auto &record = at(i);
+            writeValue(file, record.tick);
+            writeValue(file, static_cast<std::int32_t>(record.id_a));
+            writeValue(file, static_cast<std::int32_t>(record.id_b));
+            writeValue(file, static_cast<std::int32_t>(record.type_a));
+            writeValue(file, static_cast<std::int32_t>(record.type_b));
+            writeValue(file, record.separation_axis.x);
+            writeValue(file, record.separation_axis.y);
+            writeValue(file, record.minimum_translation);
+            writeValue(file, record.contact_point.x);
+            writeValue(file, record.contact_point.y);
+        }
+        return static_cast<bool>(file);
+    }
+
+    //! \brief replaces the recorded collisions by those from a dump, the trace is enabled so that they can be viewed
+    //! \returns false if \p file_path could not be read or is not a dump of a trace
+    bool CollisionTrace::load(const std::filesystem::path &file_path)
+    {
+        std::ifstream file(file_path, std::ios::binary);
+        char magic[4];
+        std::uint32_t version = 0;
+        std::uint64_t record_count = 0;
+        file.read(magic, sizeof(magic));
+        readValue(file, version);
+        readValue(file, record_count);
+        constexpr std::uint64_t max_record_count = 1 << 24; //! protects against allocating for corrupted counts
+        if (!file || !std::equal(magic, magic + 4, k_trace_magic) || version != k_trace_version ||
+            record_count > max_record_count)
+        {
+            return false;
+        }
+
+        std::vector<CollisionTraceRecord> records(record_count);
+        for (auto &record : records)
+        {
+            std::int32_t id_a, id_b, type_a, type_b;
+            readValue(file, record.tick);
+            readValue(file, id_a);
+            readValue(file, id_b);
+            readValue(file, type_a);
+            readValue(file, type_b);
+            readValue(file, record.separation_axis.x);
+            readValue(file, record.separation_axis.y);
+            readValue(file, record.minimum_translation);
+            readValue(file, record.contact_point.x);
+            readValue(file, record.contact_point.y);
+            record.id_a = id_a;
+            record.id_b = id_b;
+            record.type_a = static_cast<ObjectType>(type_a);
+            record.type_b = static_cast<ObjectType>(type_b);
+        }
+        if (!file)
+        {
+            return false;
+        }
+
+        m_enabled = true;
+        m_capacity = std::max<std::size_t>(m_capacity, records.size());
+        records.resize(m_capacity);
+        m_records = std::move(records);
+        m_size = record_count;
+        m_next = record_count % m_capacity;
+        return true;
+    }
+
+} //! namespace Collisions
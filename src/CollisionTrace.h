@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include <Utils/Vector2.h>
+
+#include "GameObject.h"
+
+namespace Collisions
+{
+
+    //! \brief one collision found by the collision system
+    struct CollisionTraceRecord
+    {
+        std::uint64_t tick = 0; //! frame of the collision system in which the collision was found
+        int id_a = -1;
+        int id_b = -1;
+        ObjectType type_a;
+        ObjectType type_b;
+        utils::Vector2f separation_axis = {0, 0};
+        float minimum_translation = 0.f;
+        utils::Vector2f contact_point = {0, 0};
+    };
+
+    //! \brief ring buffer keeping the last collisions for debugging, the oldest records are overwritten when it is full
+    //! \brief no memory is held and nothing is recorded while it is disabled
+    class CollisionTrace
+    {
+    public:
+        explicit CollisionTrace(std::size_t capacity = 4096);
+
+        void setEnabled(bool enabled);
+        bool isEnabled() const
+        {
+            return m_enabled;
+        }
+
+        void setCapacity(std::size_t capacity);
+        std::size_t getCapacity() const;
+
+        void record(const CollisionTraceRecord &record)
+        {
+            if (!m_enabled)
+            {
+                return;
+            }
+            m_records[m_next] = record;
+            m_next = m_next + 1 == m_records.size() ? 0 : m_next + 1;
+            m_size += m_size < m_records.size();
+        }
+
+        void clear();
+        std::size_t size() const;
+        const CollisionTraceRecord &at(std::size_t index) const;
+
+        bool dump(const std::filesystem::path &file_path) const;
+        bool load(const std::filesystem::path &file_path);
+
+    private:
+        std::vector<CollisionTraceRecord> m_records; //! allocated only while enabled
+        std::size_t m_capacity;
+        std::size_t m_next = 0; //! where the next record is written
+        std::size_t m_size = 0;
+        bool m_enabled = false;
+    };
+
+} //! namespace Collisions
@@ -27,6 +27,18 @@ public:
         m_systems2[std::type_index(typeid(*p_system))] = p_system;
     }
 
+    //! \returns registered system of type \p SystemType or nullptr when there is none
+    template <class SystemType>
+    SystemType *getSystem()
+    {
+        auto it = m_systems2.find(std::type_index(typeid(SystemType)));
+        if (it == m_systems2.end())
+        {
+            return nullptr;
+        }
+        return static_cast<SystemType *>(it->second.get());
+    }
+
     template <class ComponentType>
     ComponentType &get(int entity_id)
     {
@@ -63,11 +75,28 @@ public:
     {
         std::get<ComponentHolder<ComponentType>>(m_components).erase(entity_id);
     }
+    template <class... Components>
+    void deactivate(int entity_id)
+    {
+        (std::get<ComponentHolder<Components>>(m_components).deactivate(entity_id), ...);
+    }
+    template <class... Components>
+    void activate(int entity_id)
+    {
+        (std::get<ComponentHolder<Components>>(m_components).activate(entity_id), ...);
+    }
+
     void removeEntity(int entity_id)
     {
         std::apply([entity_id](auto &&...comp_holder)
                    { (comp_holder.erase(entity_id), ...); }, m_components);
     }
+    //! \brief removes components of all \p entity_ids, each holder is compacted only once
+    void removeEntities(const std::vector<int> &entity_ids)
+    {
+        std::apply([&entity_ids](auto &&...comp_holder)
+                   { (comp_holder.erase(entity_ids), ...); }, m_components);
+    }
 
     template <class ComponentType>
     ContiguousColony<ComponentType, int> &getComponents()
@@ -120,6 +149,7 @@ using GameSystems = ComponentWorld<BoidComponent,
                                    AvoidMeteorsComponent,
                                    TargetComponent,
                                    CollisionComponent,
+                                   PhysicsComponent,
                                    AnimationComponent,
                                    TimedEventComponent,
                                    ShootPlayerAIComponent,
@@ -5,6 +5,10 @@
 #include "Systems/TimedEvent.h"
 #include "Rect.h"
 
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
 class GameObject;
 
 enum class ObjectType
@@ -29,6 +33,30 @@ enum class ObjectType
     Count
 };
 
+//! \brief set of object types, bit 1 << type is set for each type in it
+using ObjectTypeMask = std::uint32_t;
+static_assert(static_cast<int>(ObjectType::Count) <= 32);
+
+constexpr ObjectTypeMask makeTypeMask(std::initializer_list<ObjectType> types)
+{
+    ObjectTypeMask mask = 0;
+    for (auto type : types)
+    {
+        mask |= ObjectTypeMask{1} << static_cast<int>(type);
+    }
+    return mask;
+}
+
+inline ObjectTypeMask makeTypeMask(const std::vector<ObjectType> &types)
+{
+    ObjectTypeMask mask = 0;
+    for (auto type : types)
+    {
+        mask |= ObjectTypeMask{1} << static_cast<int>(type);
+    }
+    return mask;
+}
+
 struct BoidComponent
 {
 
@@ -124,14 +152,34 @@ enum class ComponentId
 struct CollisionShape
 {
     std::vector<Polygon> convex_shapes;
+    std::vector<WorldPolygon> world_shapes; //! convex_shapes in world space, refreshed by updateWorldShapes()
+
+    CollisionShape() = default;
+    CollisionShape(std::vector<Polygon> convex_shapes)
+        : convex_shapes(std::move(convex_shapes))
+    {
+    }
 
+    //! \returns number of shapes whose transform changed, so they had to be transformed again
+    std::size_t updateWorldShapes()
+    {
+        world_shapes.resize(convex_shapes.size());
+        std::size_t updated_count = 0;
+        for (std::size_t i = 0; i < convex_shapes.size(); ++i)
+        {
+            updated_count += convex_shapes[i].updateWorld(world_shapes[i]);
+        }
+        return updated_count;
+    }
+
+    //! \brief tight rect around all shapes, valid after updateWorldShapes()
     AABB getBoundingRect() const
     {
-        assert(convex_shapes.size() > 0);
-        AABB box = convex_shapes.at(0).getBoundingRect();
-        for (std::size_t i = 1; i < convex_shapes.size(); ++i)
+        assert(convex_shapes.size() > 0 && world_shapes.size() == convex_shapes.size());
+        AABB box = world_shapes[0].bounding_rect;
+        for (std::size_t i = 1; i < world_shapes.size(); ++i)
         {
-            box = makeUnion(box, convex_shapes.at(i).getBoundingRect());
+            box = makeUnion(box, world_shapes[i].bounding_rect);
         }
         return box;
     }
@@ -142,6 +190,35 @@ struct CollisionComponent
     CollisionShape shape;
     ObjectType type;
     std::function<void(int, ObjectType)> on_collision = [](auto, auto){};
+
+    //! colliders collide only if the category of each is in the mask of the other and their types have a resolver
+    ObjectTypeMask category = 0;                   //! layers of the collider, zero stands for the layer of its type
+    ObjectTypeMask mask = ~ObjectTypeMask{0};      //! layers the collider collides with
+
+    //! static colliders are never refitted, moving them needs CollisionSystem::requestStaticRebuild()
+    bool is_static = false;
+
+    //! sensors only report overlaps, their contacts have no separation axis, depth or contact point and are never solved
+    bool is_sensor = false;
+
+    //! fast bodies are swept over their motion in the last frame so that they do not pass through thin objects
+    bool continuous = false;
+    utils::Vector2f previous_position = {0, 0}; //! position in the last frame, only kept for continuous bodies
+    utils::Vector2f motion = {0, 0};            //! translation during the last frame, only kept for continuous bodies
+};
+
+//! \brief entities with this component are pushed apart by the contact solver instead of ad-hoc responses
+//! \brief mass and inertia of dynamic bodies are taken from the RigidBody of the entity
+struct PhysicsComponent
+{
+    float restitution = 0.5f; //! how much of the approaching speed is returned in a bounce
+    float friction = 0.3f;
+    bool is_static = false; //! static bodies have infinite mass and are never moved by the solver
+
+    //! state of sleeping, bodies of an island at rest for long enough stop being solved
+    float rest_time = 0.f;
+    bool is_asleep = false;
+    utils::Vector2f last_position = {0, 0}; //! position after the last solve, bodies moved since then are not at rest
 };
 
 enum class AnimationId
@@ -180,6 +257,7 @@ struct ParticleComponent
     std::string layer_id;
     std::string shader_id;
     std::unique_ptr<Particles> particles;
+    float max_travel_distance = 0.f; //! how far from the emitting entity its living particles can get
 };
 
 enum class ShooterAIState
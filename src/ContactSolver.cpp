@@ -0,0 +1,434 @@
+#include "ContactSolver.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numbers>
+
+namespace Collisions
+{
+
+    constexpr float k_degrees_to_radians = std::numbers::pi_v<float> / 180.f;
+    constexpr std::size_t k_no_island = std::numeric_limits<std::size_t>::max();
+
+    static float cross(utils::Vector2f a, utils::Vector2f b)
+    {
+        return a.x * b.y - a.y * b.x;
+    }
+
+    //! \returns velocity of a point at \p r from the center caused by rotation with \p angle_vel
+    static utils::Vector2f cross(float angle_vel, utils::Vector2f r)
+    {
+        return {-angle_vel * r.y, angle_vel * r.x};
+    }
+
+    ContactSolver::ContactSolver(ContiguousColony<PhysicsComponent, int> &bodies)
+        : m_bodies(bodies)
+    {
+    }
+
+    bool ContactSolver::isBody(int entity_id) const
+    {
+        return m_bodies.contains(entity_id);
+    }
+
+    //! \brief queues contact of two bodies for the next solve(), \p impulse is used for warm starting and receives the new impulses
+    //! \note \p impulse has to stay valid until solve() is called
+    void ContactSolver::addContact(int entity_a, int entity_b, const CollisionData &data, ContactImpulse &impulse)
+    {
+        assert(isBody(entity_a) && isBody(entity_b));
+        m_pending_contacts.push_back({entity_a, entity_b, data, &impulse});
+    }
+
+    //! \brief changes velocities of bodies so that the queued contacts stop approaching and moves penetrating bodies apart
+    //! \brief the entities then move with the new velocities in their own updates
+    void ContactSolver::solve(float dt, EntityRegistryT &entities, utils::ThreadPool &workers)
+    {
+        auto tic = std::chrono::high_resolution_clock::now();
+
+        prepareBodies(dt, entities);
+        m_contacts.clear();
+        for (auto &pending : m_pending_contacts)
+        {
+            prepareContact(pending, dt);
+        }
+        m_pending_contacts.clear();
+        findIslands();
+
+        //! islands share no dynamic bodies, so they are solved independently
+        const auto island_count = m_island_contact_ends.size();
+        workers.parallelFor(island_count, [&](std::size_t island_index, std::size_t)
+                            { solveIsland(island_index, dt); });
+
+        m_stats.sleeping_body_count = 0;
+        for (auto body_index : m_island_bodies)
+        {
+            auto &entity = *entities.at(m_bodies.data_ind2id[body_index]);
+            const auto &body = m_solver_bodies[body_index];
+            entity.m_vel = body.vel;
+            entity.getRigidBody().angle_vel = body.angle_vel / k_degrees_to_radians;
+            if (body.bias_vel.x != 0.f || body.bias_vel.y != 0.f)
+            {
+                //! separation by the solver is not motion of the body
+                m_bodies.data[body_index].last_position += body.bias_vel * dt;
+                entity.setPosition(entity.getPosition() + body.bias_vel * dt);
+                entity.setAngle(entity.getAngle() + body.bias_angle_vel * dt / k_degrees_to_radians);
+            }
+            m_stats.sleeping_body_count += m_bodies.data[body_index].is_asleep;
+        }
+
+        m_stats.contact_count = m_contacts.size();
+        m_stats.island_count = island_count;
+        m_stats.solve_time_ms = std::chrono::duration_cast<std::chrono::microseconds>(
+                                    std::chrono::high_resolution_clock::now() - tic)
+                                    .count() /
+                                1000.f;
+    }
+
+    //! \brief copies velocities and masses of all bodies, bodies pushed by something else while asleep wake up
+    //! \brief a body is pushed when it has velocity or when it moved since the last solve
+    void ContactSolver::prepareBodies(float dt, EntityRegistryT &entities)
+    {
+        const auto body_count = m_bodies.data.size();
+        m_solver_bodies.resize(body_count);
+        for (std::size_t body_index = 0; body_index < body_count; ++body_index)
+        {
+            auto &comp = m_bodies.data[body_index];
+            auto &entity = *entities.at(m_bodies.data_ind2id[body_index]);
+            auto &body = m_solver_bodies[body_index];
+            body.position = entity.getPosition();
+            body.motion_vel = dt > 0.f ? (body.position - comp.last_position) / dt : utils::Vector2f{0, 0};
+            comp.last_position = body.position;
+            body.vel = entity.m_vel;
+            body.bias_vel = {0, 0};
+            body.bias_angle_vel = 0.f;
+            if (comp.is_static || !entity.doesPhysics())
+            {
+                body.angle_vel = 0.f;
+                body.inv_mass = 0.f;
+                body.inv_inertia = 0.f;
+                continue;
+            }
+            const auto &rigid = entity.getRigidBody();
+            body.angle_vel = rigid.angle_vel * k_degrees_to_radians;
+            body.inv_mass = rigid.mass > 0.f ? 1.f / rigid.mass : 0.f;
+            body.inv_inertia = rigid.inertia > 0.f ? 1.f / rigid.inertia : 0.f;
+
+            const bool is_moved = norm2(body.motion_vel) >= m_settings.sleep_speed * m_settings.sleep_speed;
+            if (comp.is_asleep && (body.vel.x != 0.f || body.vel.y != 0.f || body.angle_vel != 0.f || is_moved))
+            {
+                comp.is_asleep = false;
+                comp.rest_time = 0.f;
+            }
+        }
+    }
+
+    void ContactSolver::prepareContact(const PendingContact &pending, float dt)
+    {
+        const auto index_a = m_bodies.getIndex(pending.entity_a);
+        const auto index_b = m_bodies.getIndex(pending.entity_b);
+        const auto &a = m_solver_bodies[index_a];
+        const auto &b = m_solver_bodies[index_b];
+        if (a.inv_mass == 0.f && b.inv_mass == 0.f)
+        {
+            return;
+        }
+
+        Contact contact;
+        contact.body_a = index_a;
+        contact.body_b = index_b;
+        contact.normal = pending.data.separation_axis;
+        contact.r_a = pending.data.contact_point - a.position;
+        contact.r_b = pending.data.contact_point - b.position;
+
+        const float rn_a = cross(contact.r_a, contact.normal);
+        const float rn_b = cross(contact.r_b, contact.normal);
+        const float normal_k = a.inv_mass + b.inv_mass + a.inv_inertia * rn_a * rn_a + b.inv_inertia * rn_b * rn_b;
+        contact.normal_mass = normal_k > 0.f ? 1.f / normal_k : 0.f;
+
+        const utils::Vector2f tangent = {contact.normal.y, -contact.normal.x};
+        const float rt_a = cross(contact.r_a, tangent);
+        const float rt_b = cross(contact.r_b, tangent);
+        const float tangent_k = a.inv_mass + b.inv_mass + a.inv_inertia * rt_a * rt_a + b.inv_inertia * rt_b * rt_b;
+        contact.tangent_mass = tangent_k > 0.f ? 1.f / tangent_k : 0.f;
+
+        const auto &comp_a = m_bodies.data[index_a];
+        const auto &comp_b = m_bodies.data[index_b];
+        contact.friction = std::sqrt(comp_a.friction * comp_b.friction);
+
+        //! approaching bodies bounce back, penetrating ones are pushed apart by a part of the penetration each frame
+        const auto relative_vel = b.vel + cross(b.angle_vel, contact.r_b) - a.vel - cross(a.angle_vel, contact.r_a);
+        const float normal_vel = dot(relative_vel, contact.normal);
+        contact.velocity_bias = 0.f;
+        if (normal_vel < -m_settings.restitution_threshold)
+        {
+            contact.velocity_bias = -std::max(comp_a.restitution, comp_b.restitution) * normal_vel;
+        }
+        contact.position_bias = 0.f;
+        if (dt > 0.f)
+        {
+            const float penetration = std::max(pending.data.minimum_translation - m_settings.penetration_slop, 0.f);
+            contact.position_bias = m_settings.baumgarte * penetration / dt;
+        }
+        contact.bias_impulse = 0.f;
+
+        contact.p_impulse = pending.p_impulse;
+        contact.impulse = m_settings.warm_starting ? *pending.p_impulse : ContactImpulse{};
+        m_contacts.push_back(contact);
+    }
+
+    std::size_t ContactSolver::findRoot(std::size_t body_index)
+    {
+        while (m_island_parents[body_index] != body_index)
+        {
+            m_island_parents[body_index] = m_island_parents[m_island_parents[body_index]]; //! path halving
+            body_index = m_island_parents[body_index];
+        }
+        return body_index;
+    }
+
+    //! \brief joins dynamic bodies touching each other into islands and sorts contacts and bodies by their islands
+    //! \brief static bodies do not join islands, their contacts belong to the island of the other body
+    void ContactSolver::findIslands()
+    {
+        const auto body_count = m_solver_bodies.size();
+        m_island_parents.resize(body_count);
+        for (std::size_t body_index = 0; body_index < body_count; ++body_index)
+        {
+            m_island_parents[body_index] = body_index;
+        }
+        auto isDynamic = [this](std::size_t body_index)
+        {
+            return m_solver_bodies[body_index].inv_mass > 0.f;
+        };
+        for (auto &contact : m_contacts)
+        {
+            if (isDynamic(contact.body_a) && isDynamic(contact.body_b))
+            {
+                m_island_parents[findRoot(contact.body_a)] = findRoot(contact.body_b);
+            }
+        }
+
+        //! islands are numbered in order of their first contact, so the order does not depend on threads
+        m_body_islands.assign(body_count, k_no_island);
+        m_contact_islands.resize(m_contacts.size());
+        std::size_t island_count = 0;
+        for (std::size_t contact_index = 0; contact_index < m_contacts.size(); ++contact_index)
+        {
+            const auto &contact = m_contacts[contact_index];
+            auto root = findRoot(isDynamic(contact.body_a) ? contact.body_a : contact.body_b);
+            if (m_body_islands[root] == k_no_island)
+            {
+                m_body_islands[root] = island_count++;
+            }
+            m_contact_islands[contact_index] = m_body_islands[root];
+        }
+
+        //! counting sort of contacts by their islands
+        m_island_contact_ends.assign(island_count, 0);
+        for (auto island : m_contact_islands)
+        {
+            m_island_contact_ends[island]++;
+        }
+        std::size_t contact_end = 0;
+        for (auto &island_end : m_island_contact_ends)
+        {
+            contact_end += island_end;
+            island_end = contact_end;
+        }
+        m_sorted_contacts.resize(m_contacts.size());
+        for (std::size_t contact_index = m_contacts.size(); contact_index-- > 0;)
+        {
+            m_sorted_contacts[--m_island_contact_ends[m_contact_islands[contact_index]]] = m_contacts[contact_index];
+        }
+        //! the scatter moved the ends to the starts, so the ends are the starts of the next islands
+        for (std::size_t island = 0; island + 1 < island_count; ++island)
+        {
+            m_island_contact_ends[island] = m_island_contact_ends[island + 1];
+        }
+        if (island_count > 0)
+        {
+            m_island_contact_ends.back() = m_contacts.size();
+        }
+        std::swap(m_contacts, m_sorted_contacts);
+
+        //! bodies of each island, in order of their indices
+        m_island_body_ends.assign(island_count, 0);
+        m_island_bodies.clear();
+        for (std::size_t body_index = 0; body_index < body_count; ++body_index)
+        {
+            if (isDynamic(body_index) && m_body_islands[findRoot(body_index)] != k_no_island)
+            {
+                m_island_body_ends[m_body_islands[findRoot(body_index)]]++;
+                m_island_bodies.push_back(body_index);
+            }
+        }
+        std::size_t body_end = 0;
+        for (auto &island_end : m_island_body_ends)
+        {
+            body_end += island_end;
+            island_end = body_end;
+        }
+        m_sorted_bodies.resize(m_island_bodies.size());
+        for (std::size_t i = m_island_bodies.size(); i-- > 0;)
+        {
+            auto body_index = m_island_bodies[i];
+            m_sorted_bodies[--m_island_body_ends[m_body_islands[findRoot(body_index)]]] = body_index;
+        }
+        for (std::size_t island = 0; island + 1 < island_count; ++island)
+        {
+            m_island_body_ends[island] = m_island_body_ends[island + 1];
+        }
+        if (island_count > 0)
+        {
+            m_island_body_ends.back() = m_island_bodies.size();
+        }
+        std::swap(m_island_bodies, m_sorted_bodies);
+    }
+
+    //! \brief iterates over contacts of the island, islands whose bodies are all asleep are skipped
+    //! \brief the island falls asleep when all its bodies rested for long enough
+    void ContactSolver::solveIsland(std::size_t island_index, float dt)
+    {
+        const auto contact_begin = island_index == 0 ? 0 : m_island_contact_ends[island_index - 1];
+        const auto contact_end = m_island_contact_ends[island_index];
+        const auto body_begin = island_index == 0 ? 0 : m_island_body_ends[island_index - 1];
+        const auto body_end = m_island_body_ends[island_index];
+
+        bool is_asleep = m_settings.allow_sleeping;
+        for (auto i = body_begin; i < body_end && is_asleep; ++i)
+        {
+            is_asleep = m_bodies.data[m_island_bodies[i]].is_asleep;
+        }
+        if (is_asleep)
+        {
+            return;
+        }
+        for (auto i = body_begin; i < body_end; ++i)
+        {
+            m_bodies.data[m_island_bodies[i]].is_asleep = false;
+        }
+
+        for (auto i = contact_begin; i < contact_end; ++i)
+        {
+            warmStart(m_contacts[i]);
+        }
+        for (int iteration = 0; iteration < m_settings.velocity_iterations; ++iteration)
+        {
+            for (auto i = contact_begin; i < contact_end; ++i)
+            {
+                solveContact(m_contacts[i]);
+                solvePenetration(m_contacts[i]);
+            }
+        }
+        for (auto i = contact_begin; i < contact_end; ++i)
+        {
+            *m_contacts[i].p_impulse = m_contacts[i].impulse;
+        }
+
+        if (!m_settings.allow_sleeping)
+        {
+            return;
+        }
+        float min_rest_time = std::numeric_limits<float>::max();
+        for (auto i = body_begin; i < body_end; ++i)
+        {
+            auto &comp = m_bodies.data[m_island_bodies[i]];
+            const auto &body = m_solver_bodies[m_island_bodies[i]];
+            bool is_at_rest = norm2(body.vel) < m_settings.sleep_speed * m_settings.sleep_speed &&
+                              norm2(body.motion_vel) < m_settings.sleep_speed * m_settings.sleep_speed &&
+                              std::abs(body.angle_vel) < m_settings.sleep_angle_vel * k_degrees_to_radians;
+            comp.rest_time = is_at_rest ? comp.rest_time + dt : 0.f;
+            min_rest_time = std::min(min_rest_time, comp.rest_time);
+        }
+        if (min_rest_time >= m_settings.time_to_sleep)
+        {
+            for (auto i = body_begin; i < body_end; ++i)
+            {
+                m_bodies.data[m_island_bodies[i]].is_asleep = true;
+                m_solver_bodies[m_island_bodies[i]].vel = {0, 0};
+                m_solver_bodies[m_island_bodies[i]].angle_vel = 0.f;
+            }
+        }
+    }
+
+    //! \brief static bodies are shared by islands solved in parallel, so only dynamic ones are written to
+    void ContactSolver::applyImpulse(const Contact &contact, utils::Vector2f impulse)
+    {
+        auto &a = m_solver_bodies[contact.body_a];
+        auto &b = m_solver_bodies[contact.body_b];
+        if (a.inv_mass > 0.f)
+        {
+            a.vel -= impulse * a.inv_mass;
+            a.angle_vel -= a.inv_inertia * cross(contact.r_a, impulse);
+        }
+        if (b.inv_mass > 0.f)
+        {
+            b.vel += impulse * b.inv_mass;
+            b.angle_vel += b.inv_inertia * cross(contact.r_b, impulse);
+        }
+    }
+
+    void ContactSolver::applyBiasImpulse(const Contact &contact, utils::Vector2f impulse)
+    {
+        auto &a = m_solver_bodies[contact.body_a];
+        auto &b = m_solver_bodies[contact.body_b];
+        if (a.inv_mass > 0.f)
+        {
+            a.bias_vel -= impulse * a.inv_mass;
+            a.bias_angle_vel -= a.inv_inertia * cross(contact.r_a, impulse);
+        }
+        if (b.inv_mass > 0.f)
+        {
+            b.bias_vel += impulse * b.inv_mass;
+            b.bias_angle_vel += b.inv_inertia * cross(contact.r_b, impulse);
+        }
+    }
+
+    //! \brief applies impulses of the last frame, so that resting contacts start close to the solution
+    void ContactSolver::warmStart(const Contact &contact)
+    {
+        const utils::Vector2f tangent = {contact.normal.y, -contact.normal.x};
+        applyImpulse(contact, contact.normal * contact.impulse.normal + tangent * contact.impulse.tangent);
+    }
+
+    //! \brief one iteration of the contact, the accumulated impulse is clamped instead of the single ones
+    void ContactSolver::solveContact(Contact &contact)
+    {
+        const auto &a = m_solver_bodies[contact.body_a];
+        const auto &b = m_solver_bodies[contact.body_b];
+        auto relativeVel = [&]()
+        {
+            return b.vel + cross(b.angle_vel, contact.r_b) - a.vel - cross(a.angle_vel, contact.r_a);
+        };
+
+        //! friction is bounded by the normal impulse, so it is solved first with the one from the last iteration
+        const utils::Vector2f tangent = {contact.normal.y, -contact.normal.x};
+        float tangent_impulse = -contact.tangent_mass * dot(relativeVel(), tangent);
+        const float max_friction = contact.friction * contact.impulse.normal;
+        const float old_tangent_impulse = contact.impulse.tangent;
+        contact.impulse.tangent = std::clamp(old_tangent_impulse + tangent_impulse, -max_friction, max_friction);
+        applyImpulse(contact, tangent * (contact.impulse.tangent - old_tangent_impulse));
+
+        float normal_impulse = contact.normal_mass * (-dot(relativeVel(), contact.normal) + contact.velocity_bias);
+        const float old_normal_impulse = contact.impulse.normal;
+        contact.impulse.normal = std::max(old_normal_impulse + normal_impulse, 0.f);
+        applyImpulse(contact, contact.normal * (contact.impulse.normal - old_normal_impulse));
+    }
+
+    //! \brief pushes penetrating bodies apart using only the bias velocities
+    //! \brief the impulse is not warm started, since the penetration is corrected anew in each frame
+    void ContactSolver::solvePenetration(Contact &contact)
+    {
+        const auto &a = m_solver_bodies[contact.body_a];
+        const auto &b = m_solver_bodies[contact.body_b];
+        const auto relative_vel = b.bias_vel + cross(b.bias_angle_vel, contact.r_b) - a.bias_vel - cross(a.bias_angle_vel, contact.r_a);
+        const float impulse = contact.normal_mass * (-dot(relative_vel, contact.normal) + contact.position_bias);
+        const float old_impulse = contact.bias_impulse;
+        contact.bias_impulse = std::max(old_impulse + impulse, 0.f);
+        applyBiasImpulse(contact, contact.normal * (contact.bias_impulse - old_impulse));
+    }
+
+} //! namespace Collisions
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <Utils/Vector2.h>
+
+#include "Components.h"
+#include "GameObject.h"
+#include "Systems/System.h"
+#include "Utils/ContiguousColony.h"
+#include "Utils/ThreadPool.h"
+
+namespace Collisions
+{
+
+    struct SolverSettings
+    {
+        int velocity_iterations = 8;
+        float baumgarte = 0.2f;            //! fraction of the penetration removed each frame, by moving the bodies without changing their velocities
+        float penetration_slop = 0.05f;    //! penetration left uncorrected, so that resting contacts do not jitter
+        float restitution_threshold = 5.f; //! slower approaches do not bounce
+        bool warm_starting = true;
+        bool allow_sleeping = true;
+        float sleep_speed = 2.f;         //! bodies slower than this are at rest
+        float sleep_angle_vel = 5.f;     //! in degrees per second
+        float time_to_sleep = 0.5f;      //! islands at rest for this long fall asleep
+    };
+
+    //! \brief work done by the solver in the last frame
+    struct SolverStats
+    {
+        float solve_time_ms = 0.f;
+        std::size_t contact_count = 0;
+        std::size_t island_count = 0;  //! islands with at least one contact
+        std::size_t sleeping_body_count = 0;
+    };
+
+    //! \brief impulses accumulated on the contact of a pair, kept between frames for warm starting
+    struct ContactImpulse
+    {
+        float normal = 0.f;
+        float tangent = 0.f;
+    };
+
+    //! \brief sequential impulse solver of contacts between entities with a PhysicsComponent
+    //! \brief bodies touching each other form islands, which are solved in parallel and fall asleep together
+    class ContactSolver
+    {
+    public:
+        explicit ContactSolver(ContiguousColony<PhysicsComponent, int> &bodies);
+
+        bool isBody(int entity_id) const;
+        void addContact(int entity_a, int entity_b, const CollisionData &data, ContactImpulse &impulse);
+        void solve(float dt, EntityRegistryT &entities, utils::ThreadPool &workers);
+
+    public:
+        SolverSettings m_settings;
+        SolverStats m_stats;
+
+    private:
+        //! velocities are copied from the entities and written back after solving, angle_vel is in radians here
+        //! bias velocities separate the bodies and are integrated into positions only, so that pushing bodies apart adds no energy
+        //! only m_vel of entities is solved, motion from elsewhere (like Meteor::m_impulse_vel) is in motion_vel,
+        //! it wakes bodies and keeps them awake, so their penetration is corrected, but it gets no bounce or friction
+        struct Body
+        {
+            utils::Vector2f motion_vel = {0, 0}; //! displacement since the last solve divided by dt
+            utils::Vector2f vel = {0, 0};
+            float angle_vel = 0.f;
+            utils::Vector2f bias_vel = {0, 0};
+            float bias_angle_vel = 0.f;
+            float inv_mass = 0.f;
+            float inv_inertia = 0.f;
+            utils::Vector2f position = {0, 0};
+        };
+
+        struct PendingContact
+        {
+            int entity_a;
+            int entity_b;
+            CollisionData data;
+            ContactImpulse *p_impulse;
+        };
+
+        //! contact prepared for the iterations, the normal points from body a to body b
+        struct Contact
+        {
+            std::size_t body_a;
+            std::size_t body_b;
+            utils::Vector2f normal;
+            utils::Vector2f r_a; //! from the centers to the contact point
+            utils::Vector2f r_b;
+            float normal_mass;
+            float tangent_mass;
+            float velocity_bias; //! separating velocity of the bounce
+            float position_bias; //! separating bias velocity removing the penetration
+            float friction;
+            ContactImpulse impulse;
+            float bias_impulse;
+            ContactImpulse *p_impulse;
+        };
+
+        void prepareBodies(float dt, EntityRegistryT &entities);
+        void prepareContact(const PendingContact &pending, float dt);
+        void findIslands();
+        void solveIsland(std::size_t island_index, float dt);
+        void applyImpulse(const Contact &contact, utils::Vector2f impulse);
+        void applyBiasImpulse(const Contact &contact, utils::Vector2f impulse);
+        void warmStart(const Contact &contact);
+        void solveContact(Contact &contact);
+        void solvePenetration(Contact &contact);
+        std::size_t findRoot(std::size_t body_index);
+
+    private:
+        ContiguousColony<PhysicsComponent, int> &m_bodies;
+
+        //! buffers reused between frames, bodies are indexed like the components
+        std::vector<PendingContact> m_pending_contacts;
+        std::vector<Body> m_solver_bodies;
+        std::vector<Contact> m_contacts;
+        std::vector<std::size_t> m_island_parents;      //! union find forest of bodies
+        std::vector<std::size_t> m_island_contact_ends; //! contacts are sorted by islands, island i ends at m_island_contact_ends[i]
+        std::vector<std::size_t> m_island_bodies;       //! bodies sorted by islands
+        std::vector<std::size_t> m_island_body_ends;
+        std::vector<std::size_t> m_body_islands;    //! island of each root of the forest
+        std::vector<std::size_t> m_contact_islands;
+        std::vector<Contact> m_sorted_contacts;
+        std::vector<std::size_t> m_sorted_bodies;
+    };
+
+} //! namespace Collisions
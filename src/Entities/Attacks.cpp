@@ -79,6 +79,7 @@ void Bullet::onCollisionWith(GameObject &obj, CollisionData &c_data)
         break;
     }
     case ObjectType::Laser:
+    case ObjectType::Wall:
         kill();
         break;
     }
@@ -174,19 +175,18 @@ void Bomb::onCreation()
 void Bomb::onDestruction()
 {
 
-    auto meteors = m_world->getCollisionSystem().findNearestObjects(ObjectType::Meteor, m_pos, m_explosion_radius);
-    for (auto p_meteor : meteors)
+    m_world->getCollisionSystem().forEachNearestObject(ObjectType::Meteor, m_pos, m_explosion_radius, [this](CollisionComponent &meteor)
     {
-        auto dr_to_center = m_pos - p_meteor->shape.convex_shapes[0].getPosition();
+        auto dr_to_center = m_pos - meteor.shape.convex_shapes[0].getPosition();
         auto dist_to_center = norm(dr_to_center);
         auto impulse_dir = -dr_to_center / dist_to_center;
 
         auto distance_factor = 1 - dist_to_center / m_explosion_radius;
         if (distance_factor > 0)
         {
-            // p_meteor->m_vel += distance_factor * impulse_dir * 5.f;
+            // meteor.m_vel += distance_factor * impulse_dir * 5.f;
         }
-    }
+    });
 
     auto &explosion = m_world->addObject2<Explosion>();
     explosion.setPosition(m_pos);
@@ -218,15 +218,21 @@ Laser::~Laser()
 
 }
 
-void Laser::stopAgainst(ObjectType type)
+//! \brief shortens the laser to \p distance, where the ray cast by the world hit something it stops against
+void Laser::stopAt(float distance)
 {
-    auto dir = utils::angle2dir(m_angle);
-    auto hit = m_world->getCollisionSystem().findClosestIntesection(type, m_pos, utils::angle2dir(m_angle), m_length);
-
-    m_length = dist(hit, m_pos);
+    m_length = distance;
+    followParent();
     setSize({m_length, m_width});
-    //! m_pos of laser is special, it is starting position not center so we set it manually
-    // setPosition(m_pos + m_length / 2.f * utils::angle2dir(m_angle));
+}
+
+//! \brief m_pos of laser is special, with a parent it is the center of the beam starting at the parent
+void Laser::followParent()
+{
+    if (m_parent)
+    {
+        m_pos = m_parent->getPosition() + m_offset + utils::angle2dir(m_angle) * m_length / 2.;
+    }
 }
 
 void Laser::update(float dt)
@@ -236,19 +242,12 @@ void Laser::update(float dt)
 
     m_width += m_max_width * (dt / m_life_time);
     m_length += m_max_length * (dt / m_life_time);
-    
-    for(auto& stop_type : m_stopping_types)
-    {
-        stopAgainst(stop_type);
-    }
-    if (m_parent)
+
+    if (m_parent && m_rotates_with_owner)
     {
-        if (m_rotates_with_owner)
-        {
-            m_angle = m_parent->getAngle();
-        }
-        m_pos = m_parent->getPosition() + m_offset + utils::angle2dir(m_angle) * m_length / 2.;
+        m_angle = m_parent->getAngle();
     }
+    followParent();
     setSize({m_length, m_width});
 
     if (m_time > m_life_time)
@@ -270,6 +269,7 @@ void Laser::onCreation()
 {
     Polygon shape = {4};
     CollisionComponent c_comp = {std::vector<Polygon>{shape}, ObjectType::Laser};
+    c_comp.is_sensor = true;
     m_world->m_systems.add(c_comp, getId());
 }
 
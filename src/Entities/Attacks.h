@@ -122,8 +122,10 @@ public:
         return m_owner;
     }
 
+    void stopAt(float distance);
+
 private:
-    void stopAgainst(ObjectType type);
+    void followParent();
 public:
 
     float m_min_dmg = 0.f;
@@ -52,7 +52,7 @@ void Boss1::deActivateShield()
 void Boss1::activateShield()
 {
     auto &shield = m_world->addObject3(ObjectType::Shield);
-    Polygon shield_collider = {32};
+    Polygon shield_collider = Polygon::makeCircle();
     CollisionComponent c_comp;
     c_comp.type = ObjectType::Shield;
     c_comp.shape.convex_shapes = {shield_collider};
@@ -374,7 +374,7 @@ void Boss2::deActivateShield()
 void Boss2::activateShield()
 {
     auto &shield = m_world->addObject3(ObjectType::Shield);
-    Polygon shield_collider = {32};
+    Polygon shield_collider = Polygon::makeCircle();
     CollisionComponent c_comp;
     c_comp.type = ObjectType::Shield;
     c_comp.shape.convex_shapes = {shield_collider};
@@ -116,7 +116,8 @@ void Enemy::onCreation()
     // TargetComponent t_comp = {m_player, {0, 0}, 1000.};
 
     Polygon shape = {4};
-    CollisionComponent c_comp = {std::vector<Polygon>{shape}, ObjectType::Enemy};
+    auto shapes = m_collision_shapes.empty() ? std::vector<Polygon>{shape} : m_collision_shapes;
+    CollisionComponent c_comp = {shapes, ObjectType::Enemy};
     // m_systems->addEntity(getId(), b_comp, a_comp, h_comp, t_comp, c_comp);
 
     m_systems->addEntity(getId(), c_comp);
@@ -45,6 +45,7 @@ public:
     utils::Vector2f m_target_pos;
 
     Sprite m_sprite;
+    std::vector<Polygon> m_collision_shapes; //! fitted to the sprite by the ToolBox, a square is used when empty
 
 private:
     GameSystems *m_systems;
@@ -8,6 +8,17 @@ EnemyFactory::EnemyFactory(GameWorld &world, TextureHolder &textures)
     registerCreators(textures);
 }
 
+//! \brief enemies whose texture has a shape fitted in the ToolBox collide with it, the others with a square
+void EnemyFactory::setCollisionShape(Enemy &enemy, const std::string &texture_name)
+{
+    if (!m_collision_shapes.contains(texture_name))
+    {
+        m_collision_shapes[texture_name] =
+            readCollisionShape(std::string(RESOURCES_DIR) + "/CollisionShapes.json", texture_name);
+    }
+    enemy.m_collision_shapes = m_collision_shapes.at(texture_name);
+}
+
 void EnemyFactory::registerCreators(TextureHolder &textures)
 {
     auto laser_wtf_creator = [this, &textures](Enemy &enemy) -> Enemy &
@@ -15,6 +26,7 @@ void EnemyFactory::registerCreators(TextureHolder &textures)
         HealthComponent h_comp = {.max_hp = 40.};
         m_world.m_systems.addEntityDelayed(enemy.getId(), h_comp);
         enemy.m_sprite.setTexture(*textures.get("EnemyLaser"));
+        setCollisionShape(enemy, "EnemyLaser");
         enemy.m_max_vel = 100;
         return enemy;
     };
@@ -25,6 +37,7 @@ void EnemyFactory::registerCreators(TextureHolder &textures)
         m_world.m_systems.addEntityDelayed(enemy.getId(), BoidComponent{}, AvoidMeteorsComponent{},
                                            h_comp, t_comp, LaserAIComponent{});
         enemy.m_sprite.setTexture(*textures.get("EnemyLaser"));
+        setCollisionShape(enemy, "EnemyLaser");
         enemy.m_max_vel = 50;
         return enemy;
     };
@@ -37,6 +50,7 @@ void EnemyFactory::registerCreators(TextureHolder &textures)
         m_world.m_systems.addEntityDelayed(enemy.getId(), BoidComponent{}, AvoidMeteorsComponent{},
                                            h_comp, t_comp, s_comp, sprite_comp);
         // enemy.m_sprite.setTexture(*textures.get("EnemyShip"));
+        setCollisionShape(enemy, "EnemyShip");
         return enemy;
     };
     auto energy_shooter_creator = [this, &textures](Enemy &enemy) -> Enemy &
@@ -47,6 +61,7 @@ void EnemyFactory::registerCreators(TextureHolder &textures)
         SpriteComponent sprite_comp = {.layer_id = "Unit", .sprite = Sprite{*textures.get("EnemyBomber")}};
         m_world.m_systems.addEntityDelayed(enemy.getId(), BoidComponent{}, AvoidMeteorsComponent{},
                                            h_comp, t_comp, s_comp, sprite_comp);
+        setCollisionShape(enemy, "EnemyBomber");
         enemy.m_max_vel = 80.f;
         return enemy;
     };
@@ -152,11 +167,16 @@ ProjectileFactory::ProjectileFactory(GameWorld &world, TextureHolder &textures)
     registerCreators(textures);
 }
 
+//! \brief capsule fitting the rect of the elongated \p entity, whose size has to be set already
+//! \brief projectiles are small and fast, so their colliders are swept to not pass through thin walls
 void ProjectileFactory::addLaserCollider(Bullet &entity)
 {
+    auto size = entity.getSize();
+    assert(size.x >= size.y && size.y > 0.f);
     CollisionComponent c_comp;
     c_comp.type = ObjectType::Bullet;
-    c_comp.shape.convex_shapes.emplace_back(4);
+    c_comp.shape.convex_shapes.push_back(Polygon::makeCapsule(1.f - size.y / size.x));
+    c_comp.continuous = true;
     m_world.m_systems.addEntityDelayed(entity.getId(), c_comp);
 }
 
@@ -164,7 +184,8 @@ void ProjectileFactory::addCircleCollider(Bullet &entity)
 {
     CollisionComponent c_comp;
     c_comp.type = ObjectType::Bullet;
-    c_comp.shape.convex_shapes.emplace_back(8);
+    c_comp.shape.convex_shapes.push_back(Polygon::makeCircle());
+    c_comp.continuous = true;
     m_world.m_systems.addEntityDelayed(entity.getId(), c_comp);
 }
 
@@ -240,7 +261,7 @@ void ProjectileFactory::registerCreators(TextureHolder &textures)
 
         m_world.m_systems.addEntityDelayed(bullet.getId(), s_comp);
         bullet.m_max_vel = 300.f;
-        addCircleCollider(bullet);
+        addLaserCollider(bullet);
 
         
         std::vector<SoundID> laser_sounds = {SoundID::Laser1, SoundID::Laser2, SoundID::Laser3};
@@ -264,12 +285,13 @@ void ProjectileFactory::registerCreators(TextureHolder &textures)
             obj.kill();
         };
         bullet.m_max_vel = 200.f;
-        addCircleCollider(bullet);
+        addLaserCollider(bullet);
 
         //! create the exhaust tail
         auto &tail = m_world.addObject3(ObjectType::Count);
         ParticleComponent parts = {.layer_id = "Bloom", .shader_id = "Exhaust"};
 
+        const float particle_life_time = 10.f;
         auto particles = std::make_unique<Particles>(100);
         // particles->setTexture(*textures.get("FireNoise"));
         // particles->setShader("laser");
@@ -277,7 +299,7 @@ void ProjectileFactory::registerCreators(TextureHolder &textures)
         particles->setLifetime(3.f);
         particles->setInitColor({5.f, 0.1f, 0.f, 1.f});
         particles->setFinalColor({10.f, 10.f, 2.f, 1.f});
-        particles->setEmitter([&bullet](utils::Vector2f pos) -> Particle
+        particles->setEmitter([&bullet, particle_life_time](utils::Vector2f pos) -> Particle
                               {
                 Particle p;
                 auto motion_dir = utils::angle2dir(bullet.getAngle());
@@ -285,7 +307,7 @@ void ProjectileFactory::registerCreators(TextureHolder &textures)
                 utils::Vector2f perprendicular_dir = {motion_dir.y, -motion_dir.x};
                 p.vel = bullet.m_vel* 0.1f + perprendicular_dir * randf(-5.f, 5.f); 
                 p.scale = {3.f, 3.f};
-                p.life_time = 10.f;
+                p.life_time = particle_life_time;
                 return p; });
         particles->setUpdater([&bullet](Particle &p, float dt)
                               {
@@ -294,6 +316,8 @@ void ProjectileFactory::registerCreators(TextureHolder &textures)
                               }); 
         particles->setSpawnPos({-bullet.getSize().x/2., 0.f});
         parts.particles = std::move(particles);
+        //! the trail is as long as the rocket flies during the particle life time, plus the particle drift
+        parts.max_travel_distance = particle_life_time * (bullet.m_max_vel * 1.1f + 5.f);
         m_world.m_systems.addEntityDelayed(bullet.getId(), s_comp, parts);
 
         killAfter(10.f, bullet);
@@ -3,6 +3,7 @@
 #include "../GameWorld.h"
 
 #include "../SoundSystem.h"
+#include "../ShapeDecomposition.h"
 
 enum class EnemyType
 {
@@ -52,6 +53,13 @@ class EnemyFactory : public EntityFactory<EnemyFactory, Enemy, EnemyType>
 public:
     EnemyFactory(GameWorld &world, TextureHolder &textures);
     virtual void registerCreators(TextureHolder &textures) override;
+
+private:
+    void setCollisionShape(Enemy &enemy, const std::string &texture_name);
+
+private:
+    //! collision shapes fitted to enemy textures, loaded once and keyed by texture name
+    std::unordered_map<std::string, std::vector<Polygon>> m_collision_shapes;
 };
 
 class HomingProjectileFactory : public EntityFactory<HomingProjectileFactory, Bullet, ProjectileType, GameObject *>
@@ -28,10 +28,7 @@ void Meteor::update(float dt)
     m_impulse_vel -=  m_impulse_vel * m_impulse_decay * dt;
 
     auto player_pos = p_player->getPosition();
-    auto player_vel = p_player->m_vel;
-    auto obj_moves_away = utils::dot(player_vel, m_vel) < 0;
-    auto player_obj_dist = utils::dist(m_pos, player_pos);
-    if (obj_moves_away && player_obj_dist > max_dist_from_player)
+    if (isLeftBehind(m_pos, m_vel, player_pos, p_player->m_vel, max_dist_from_player))
     {
         auto rand_radius = randf(max_dist_from_player * 0.6f, max_dist_from_player * 0.9f);
         auto rand_angle = randf(0, 360);
@@ -39,6 +36,15 @@ void Meteor::update(float dt)
         setPosition(new_obj_pos);
     }
 }
+//! \returns true if the meteor is further than \p max_dist from the player and they are getting further apart
+//! \brief this holds also for meteors flying along with the player but slower, or away from a player standing still
+bool Meteor::isLeftBehind(utils::Vector2f pos, utils::Vector2f vel, utils::Vector2f player_pos,
+                          utils::Vector2f player_vel, float max_dist)
+{
+    auto dr = pos - player_pos;
+    return utils::norm2(dr) > max_dist * max_dist && utils::dot(dr, vel - player_vel) >= 0.f;
+}
+
 void Meteor::onCreation()
 {
     CollisionComponent c_comp;
@@ -46,6 +52,7 @@ void Meteor::onCreation()
     shape.points = m_collision_shape->points;
     c_comp = {std::vector<Polygon>{shape}, ObjectType::Meteor};
     m_world->m_systems.add(c_comp, getId());
+    m_world->m_systems.add(PhysicsComponent{}, getId());
 }
 void Meteor::onDestruction()
 {
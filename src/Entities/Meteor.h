@@ -19,6 +19,9 @@ public:
     virtual void draw(LayersHolder &target) override;
     virtual void onCollisionWith(GameObject &obj, CollisionData &c_data) override;
 
+    static bool isLeftBehind(utils::Vector2f pos, utils::Vector2f vel, utils::Vector2f player_pos,
+                             utils::Vector2f player_vel, float max_dist);
+
     public:
     utils::Vector2f m_impulse_vel = {0.f};
 private:
@@ -19,8 +19,6 @@ void PlayerEntity::update(float dt)
     meteor_detector.setScale(m_size.x * 2., m_size.y / 2.);
     meteor_detector.setRotation(m_angle);
 
-    auto detected_meteor_ids = m_world->m_collision_system.findIntersections(ObjectType::Meteor, meteor_detector);
-
     fixAngle();
     boost(dt);
     if (m_is_turning_left)
@@ -36,9 +36,11 @@ ReachPlace::~ReachPlace() {}
 void ReachPlace::onCreation()
 {
     CollisionComponent c_comp;
-    Polygon shape= {10};
+    Polygon shape = Polygon::makeCircle();
     c_comp.shape.convex_shapes.push_back(shape);
     c_comp.type = ObjectType::Trigger;
+    c_comp.is_static = true;
+    c_comp.is_sensor = true;
     m_world->m_systems.add(c_comp, getId());
 }
 
@@ -108,9 +108,10 @@ GameObject &Game::createQuestGiver(std::shared_ptr<Quest> quest)
     quest_giver.setSize({50, 50});
 
     CollisionComponent c_comp;
-    Polygon shape = {32};
+    Polygon shape = Polygon::makeCircle();
     c_comp.type = ObjectType::SpaceStation;
     c_comp.shape.convex_shapes = {shape};
+    c_comp.is_static = true;
 
     SpriteComponent s_comp = {.layer_id = "Unit", .sprite = {*m_textures.get("QuestGiver")}};
 
@@ -136,7 +137,6 @@ Game::Game(Renderer &window, KeyBindings &bindings)
 {
     messanger.registerEvents<EntityDiedEvent,
                              QuestCompletedEvent,
-                             CollisionEvent,
                              DamageReceivedEvent,
                              HealthChangedEvent,
                              StartedBossFightEvent,
@@ -168,11 +168,10 @@ Game::Game(Renderer &window, KeyBindings &bindings)
 
     m_background = std::make_unique<Texture>(std::string(RESOURCES_DIR) + "/Textures/background.png");
 
-    for (int i = 0; i < 300; ++i)
+    for (auto p_meteor : m_world->spawnBatch<Meteor>(300))
     {
-        auto &meteor = m_world->addObject2<Meteor>();
         auto spawn_pos = m_player->getPosition() + randf(200, 3000) * angle2dir(randf(0, 360));
-        meteor.setPosition(spawn_pos);
+        p_meteor->setPosition(spawn_pos);
     }
     for (int i = 0; i < 0; ++i)
     {
@@ -254,6 +253,10 @@ void Game::startBossFight()
         c_comp_right.shape.convex_shapes = {4};
         c_comp_up.shape.convex_shapes = {4};
         c_comp_down.shape.convex_shapes = {4};
+        c_comp_left.is_static = true;
+        c_comp_right.is_static = true;
+        c_comp_up.is_static = true;
+        c_comp_down.is_static = true;
 
         wall_right.setPosition(center + utils::Vector2f{400, 0});
         wall_left.setPosition(center - utils::Vector2f{390, 0});
@@ -293,13 +296,9 @@ void Game::startBossFight()
     // auto kill_task = std::make_shared<DestroyEntityTask>(boss, *m_font, messanger, &q);
     // q.addTask(kill_task);
 
-    auto &entities = m_world->getEntities();
-    for (auto obj : entities.data())
+    for (auto meteor_id : m_world->getEntitiesOfType(ObjectType::Meteor))
     {
-        if (obj->getType() == ObjectType::Meteor)
-        {
-            obj->kill();
-        }
+        m_world->get(meteor_id)->kill();
     }
     //    auto& quest_giver = createQuestGiver(m_quest_factory->create(QuestType::BossFight1));
     //    quest_giver.setPosition(m_player->getPosition() + utils::Vector2f{300, 0});
@@ -325,6 +324,7 @@ void Game::startSurvival()
         CollisionComponent c_comp_left;
         c_comp_left.type = ObjectType::Wall;
         c_comp_left.shape.convex_shapes = {4};
+        c_comp_left.is_static = true;
 
         wall_left.setPosition(center);
         wall_left.setAngle(angle);
@@ -351,6 +351,8 @@ void Game::startSurvival()
 
         c_comp_left.shape.convex_shapes = {4};
         c_comp_right.shape.convex_shapes = {4};
+        c_comp_left.is_static = true;
+        c_comp_right.is_static = true;
 
         wall_right.setPosition(center_l);
         wall_right.setAngle(angle);
@@ -670,6 +672,7 @@ void Game::update(const float dt, Renderer &window)
 
     m_camera.update(dt, m_player);
     window.m_view = m_camera.getView();
+    m_world->setCameraView(m_camera.getView());
 
     parseInput(window, dt);
 
@@ -763,8 +766,8 @@ void Game::registerCollisions()
 {
     auto &colllider = m_world->getCollisionSystem();
 
-    colllider.registerResolver(ObjectType::Meteor, ObjectType::Meteor, [](GameObject &obj1, GameObject &obj2, CollisionData c_data)
-                               { Collisions::bounce(obj1, obj2, c_data); });
+    //! meteors have a PhysicsComponent, so their contacts are resolved by the contact solver
+    colllider.registerResolver(ObjectType::Meteor, ObjectType::Meteor);
     colllider.registerResolver(ObjectType::Meteor, ObjectType::Wall, [](GameObject &obj1, GameObject &obj2, CollisionData c_data)
                                { 
                                 //! bounce meteor off the wall
@@ -787,6 +790,7 @@ void Game::registerCollisions()
     colllider.registerResolver(ObjectType::Shield, ObjectType::Meteor);
     colllider.registerResolver(ObjectType::Shield, ObjectType::Bullet);
     colllider.registerResolver(ObjectType::Meteor, ObjectType::Bullet);
+    colllider.registerResolver(ObjectType::Wall, ObjectType::Bullet);
 
     colllider.registerResolver(ObjectType::Player, ObjectType::SpaceStation);
 
@@ -810,7 +814,7 @@ void Game::registerSystems()
 {
     auto &systems = m_world->m_systems;
 
-    systems.registerSystem(std::make_shared<BoidSystem>(systems.getComponents<BoidComponent>()));
+    systems.registerSystem(std::make_shared<BoidSystem>(systems.getComponents<BoidComponent>(), m_world->getWorkers()));
     systems.registerSystem(std::make_shared<AvoidanceSystem>(systems.getComponents<AvoidMeteorsComponent>(),
                                                              systems, m_world->getCollisionSystem()));
     systems.registerSystem(std::make_shared<HealthSystem>(systems.getComponents<HealthComponent>(), messanger));
@@ -820,9 +824,9 @@ void Game::registerSystems()
                                                       systems.getComponents<ShootPlayerAIComponent>(),
                                                       systems.getComponents<LaserAIComponent>()));
     systems.registerSystem(std::make_shared<SpriteSystem>(systems.getComponents<SpriteComponent>(),
-                                                          m_layers));
+                                                          m_layers, m_world->getVisibility()));
     systems.registerSystem(std::make_shared<ParticleSystem>(systems.getComponents<ParticleComponent>(),
-                                                            m_layers));
+                                                            m_layers, m_world->getVisibility()));
 
     std::filesystem::path animation_directory = {RESOURCES_DIR};
     animation_directory /= "Textures/Animations/";
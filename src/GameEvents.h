@@ -77,6 +77,34 @@ struct CollisionEventTypeEntity
     ObjectType type_b;
 };
 
+//! contact events, a contact begins in the first frame two objects touch, stays while they touch
+//! and ends in the first frame they do not touch or one of them is removed
+struct ContactBeginEvent
+{
+    int id_a;
+    int id_b;
+    ObjectType type_a;
+    ObjectType type_b;
+    CollisionData data;
+};
+struct ContactStayEvent
+{
+    int id_a;
+    int id_b;
+    ObjectType type_a;
+    ObjectType type_b;
+    CollisionData data;
+    std::size_t frame_count; //! number of frames since the contact began
+};
+struct ContactEndEvent
+{
+    int id_a;
+    int id_b;
+    ObjectType type_a;
+    ObjectType type_b;
+    std::size_t frame_count; //! number of frames the contact lasted
+};
+
 struct DamageReceivedEvent
 {
     ObjectType cause_type;
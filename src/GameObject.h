@@ -24,10 +24,12 @@ enum class Multiplier
 
 struct CollisionData
 {
-    utils::Vector2f separation_axis;
+    utils::Vector2f separation_axis = {0, 0}; //! separating axis when there is no collision, if one was found
     float minimum_translation = -1;
     bool belongs_to_a = true;
     utils::Vector2f contact_point = {0, 0};
+    float time_of_impact = 1.f; //! fraction of the last frame's motion after which continuous bodies touched
+    bool is_overlap_only = false; //! overlap found with a sensor, only the fact that the shapes touch is known
 };
 
 enum class EffectType
@@ -1,11 +1,14 @@
 #include "GameWorld.h"
 
+#include <algorithm>
 #include <chrono>
+#include <unordered_set>
 
 #include "Utils/RandomTools.h"
 
 GameWorld::GameWorld(PostOffice &messenger, TextureHolder& textures)
-    : p_messenger(&messenger), m_systems(m_entities), m_textures(textures), m_collision_system(messenger, m_systems.getComponents<CollisionComponent>())
+    : p_messenger(&messenger), m_systems(m_entities), m_textures(textures), m_collision_system(messenger, m_systems.getComponents<CollisionComponent>(),
+                                                                                                         m_systems.getComponents<PhysicsComponent>(), m_workers)
 {
     m_effect_factories[EffectType::ParticleEmiter] =
         [this]()
@@ -15,12 +18,16 @@ GameWorld::GameWorld(PostOffice &messenger, TextureHolder& textures)
     { return std::make_shared<AnimatedSprite>(this, m_textures); };
 }
 
-std::size_t GameWorld::getNActiveEntities(ObjectType type)
+std::size_t GameWorld::getNActiveEntities(ObjectType type) const
 {
-    auto &entities = m_entities.data();
-    auto n_enemies = std::count_if(entities.begin(), entities.end(), [type](auto &obj)
-                                   { return obj->getType() == type; });
-    return n_enemies;
+    return m_type2entities.at(static_cast<std::size_t>(type)).size();
+}
+
+//! \brief ids of all living entities of the given \p type
+//! \note the list changes when entities are added or removed, so do not hold on to it across frames
+const std::vector<int> &GameWorld::getEntitiesOfType(ObjectType type) const
+{
+    return m_type2entities.at(static_cast<std::size_t>(type)).data;
 }
 
 
@@ -49,43 +56,60 @@ GameObject &GameWorld::addObject(ObjectType type)
     return *m_to_add.back();
 }
 
+//! \brief adds all queued entities into the world
+//! \brief bounding volumes of the whole batch are inserted at once
 void GameWorld::addQueuedEntities()
 {
+    if (m_to_add.empty())
+    {
+        return;
+    }
+    auto tic = std::chrono::high_resolution_clock::now();
+
+    std::vector<GameObject *> added;
+    std::vector<GameObject *> added_colliders;
+    added.reserve(m_to_add.size());
     while (!m_to_add.empty())
     {
         auto new_object = m_to_add.front();
         auto new_id = new_object->getId(); //! the object already has id because we reserved it
         m_entities.insertAt(new_id, new_object);
         assert(new_id == m_entities.at(new_id)->getId());
-        
-        m_entities.at(new_id)->onCreation();
+
+        new_object->onCreation();
         if (m_systems.has<CollisionComponent>(new_id))
         {
-            m_collision_system.insertObject(*m_entities.at(new_id));
+            added_colliders.push_back(new_object.get());
         }
-        
-        if (m_entities.at(new_id)->isRoot())
+        added.push_back(new_object.get());
+        m_type2entities.at(static_cast<std::size_t>(new_object->getType())).insert(new_id, new_id);
+        m_lod.insert(new_id);
+
+        if (new_object->isRoot())
         {
             m_root_entities.insertAt(new_id, new_id);
         }
-        
+
         m_to_add.pop_front();
     }
+    m_collision_system.insertObjects(added_colliders);
+    m_visibility.insert(added);
+
+    m_spawn_stats.batch_size = added.size();
+    m_spawn_stats.insertion_time_ms = std::chrono::duration_cast<std::chrono::microseconds>(
+                                          std::chrono::high_resolution_clock::now() - tic)
+                                          .count() / 1000.f;
 }
 
-void removeEntity(GameObject *entity,
-                  GameSystems &systems,
-                  EntityRegistryT &entities,
-                  DynamicObjectPool2<int> &root_entities,
-                  Collisions::CollisionSystem &collision_system)
+//! \brief takes the \p entity out of the entity tree
+//! \brief children of a root entity become roots, and ids of removed roots are stored in \p removed_root_ids
+void detachFromEntityTree(GameObject *entity,
+                          DynamicObjectPool2<int> &root_entities,
+                          std::vector<int> &removed_root_ids)
 {
-    auto id = entity->getId();
-    entity->onDestruction();
-
-    //! destroy also the object's children and remove it from roots if necessary
     if (entity->isRoot())
     {
-        root_entities.remove(id);
+        removed_root_ids.push_back(entity->getId());
         //! children become roots
         for (auto p_child : entity->m_children)
         {
@@ -99,13 +123,6 @@ void removeEntity(GameObject *entity,
     { //! entity has a parent so it should be removed from it's children
         entity->m_parent->removeChild(entity);
     }
-
-    if (systems.has<CollisionComponent>(id))
-    {
-        collision_system.removeObject(*entity);
-    }
-    systems.removeEntity(id);
-    entities.remove(id);
 }
 
 void GameWorld::removeParent(GameObject &child)
@@ -124,38 +141,68 @@ void GameWorld::removeParent(GameObject &child)
         m_root_entities.insertAt(child_id, child_id);
     }
 }
+//! \brief destroys all entities queued this frame together with their children
+//! \brief destruction callbacks run one by one, but all storages and trees are updated once for the whole batch
 void GameWorld::removeQueuedEntities()
 {
+    if (m_to_destroy.empty())
+    {
+        return;
+    }
 
     //! we destroy the objects from children to parents, this way it doesn't get fucked
     //! TODO: The entity-tree logic should not be done in GameWorld, Add it's own thing for that
-    std::deque<GameObject *> to_destroy;
-    std::unordered_set<int> already_destroyed; //! for
+    std::vector<GameObject *> to_destroy;
+    to_destroy.reserve(m_to_destroy.size());
     while (!m_to_destroy.empty())
     {
         auto object = m_to_destroy.back();
         m_to_destroy.pop_back();
 
-        assert(!already_destroyed.contains(object->getId()));
-        already_destroyed.insert(object->getId());
-
-        to_destroy.push_front(object.get());
-
+        to_destroy.push_back(object.get());
         for (auto p_child : object->m_children)
         {
-            assert(!already_destroyed.contains(p_child->getId()));
-            already_destroyed.insert(p_child->getId());
-
-            to_destroy.push_front(p_child);
+            to_destroy.push_back(p_child);
         }
     }
-    m_to_destroy.clear();
-
+    std::reverse(to_destroy.begin(), to_destroy.end());
+
+    std::vector<int> removed_ids;
+    std::vector<int> removed_root_ids;
+    std::vector<EntityDiedEvent> died_events;
+    std::array<std::vector<int>, static_cast<std::size_t>(ObjectType::Count)> type2removed_ids;
+    removed_ids.reserve(to_destroy.size());
+    died_events.reserve(to_destroy.size());
     for (auto object : to_destroy)
     {
-        p_messenger->send(EntityDiedEvent{object->getType(), object->getId(), object->getPosition()});
-        removeEntity(object, m_systems, m_entities, m_root_entities, m_collision_system);
+        auto id = object->getId();
+        removed_ids.push_back(id);
+        type2removed_ids.at(static_cast<std::size_t>(object->getType())).push_back(id);
+        died_events.push_back(EntityDiedEvent{object->getType(), id, object->getPosition()});
+
+        object->onDestruction();
+        detachFromEntityTree(object, m_root_entities, removed_root_ids);
     }
+#ifndef NDEBUG
+    std::unordered_set<int> unique_ids(removed_ids.begin(), removed_ids.end());
+    assert(unique_ids.size() == removed_ids.size()); //! nothing can be destroyed twice
+#endif
+
+    p_messenger->sendBatch<EntityDiedEvent>(died_events);
+
+    m_collision_system.removeObjects(to_destroy);
+    m_visibility.remove(removed_ids);
+    for (std::size_t type_ind = 0; type_ind < type2removed_ids.size(); ++type_ind)
+    {
+        if (!type2removed_ids[type_ind].empty())
+        {
+            m_type2entities[type_ind].erase(type2removed_ids[type_ind]);
+        }
+    }
+    m_lod.remove(removed_ids);
+    m_systems.removeEntities(removed_ids);
+    m_root_entities.remove(removed_root_ids);
+    m_entities.remove(removed_ids);
 }
 
 void GameWorld::destroyObject(int entity_id)
@@ -163,36 +210,143 @@ void GameWorld::destroyObject(int entity_id)
     m_to_destroy.push_back(m_entities.at(entity_id));
 }
 
+//! \brief dormant entity is removed from collision trees and its steering and AI components are disabled
+void GameWorld::putToSleep(GameObject &entity)
+{
+    auto id = entity.getId();
+    if (m_systems.has<CollisionComponent>(id))
+    {
+        m_collision_system.removeObject(entity);
+    }
+    m_systems.deactivate<CollisionComponent, PhysicsComponent, BoidComponent, AvoidMeteorsComponent, TargetComponent,
+                         ShootPlayerAIComponent, LaserAIComponent>(id);
+}
+
+void GameWorld::wakeUp(GameObject &entity)
+{
+    auto id = entity.getId();
+    m_systems.activate<CollisionComponent, PhysicsComponent, BoidComponent, AvoidMeteorsComponent, TargetComponent,
+                       ShootPlayerAIComponent, LaserAIComponent>(id);
+    if (m_systems.has<CollisionComponent>(id))
+    {
+        m_collision_system.insertObject(entity);
+    }
+}
+
+//! \brief moves root entities between simulation tiers based on their distance from the player
+void GameWorld::updateSimulationTiers()
+{
+    m_lod.beginFrame();
+    if (!m_player)
+    {
+        return;
+    }
+
+    auto player_pos = m_player->getPosition();
+    for (auto id : m_root_entities.data())
+    {
+        //! static colliders live in the static tree which is built in bulk, so they never go to sleep
+        if (m_systems.has<CollisionComponent>(id) && m_systems.get<CollisionComponent>(id).is_static)
+        {
+            continue;
+        }
+        auto &entity = *m_entities.at(id);
+        auto old_tier = m_lod.getTier(id);
+        auto new_tier = m_lod.calcTier(entity.getType(), utils::dist(entity.getPosition(), player_pos));
+        if (new_tier == old_tier)
+        {
+            continue;
+        }
+
+        if (new_tier == SimulationTier::Dormant)
+        {
+            putToSleep(entity);
+        }
+        else if (old_tier == SimulationTier::Dormant)
+        {
+            wakeUp(entity);
+        }
+        m_lod.setTier(id, new_tier);
+    }
+}
+
+//! \brief lasers updated in this frame are shortened to the nearest object they stop against,
+//! \brief all their rays are cast at once so that they are spread over the worker threads
+void GameWorld::stopLasers()
+{
+    m_laser_rays.clear();
+    for (auto laser : m_updated_lasers)
+    {
+        m_laser_rays.push_back({laser->getPosition(), utils::angle2dir(laser->getAngle()),
+                                laser->m_length, makeTypeMask(laser->m_stopping_types)});
+    }
+    m_collision_system.rayCastBatch(m_laser_rays, m_laser_hits);
+    for (std::size_t i = 0; i < m_updated_lasers.size(); ++i)
+    {
+        m_updated_lasers[i]->stopAt(m_laser_hits[i].distance);
+    }
+    m_updated_lasers.clear();
+}
+
 void GameWorld::update(float dt)
 {
+    //! sprite and particle systems draw only what is visible
+    m_visibility.findVisible();
+    updateSimulationTiers();
 
     m_systems.preUpdate(dt);
     m_collision_system.preUpdate(dt, m_entities);
     m_systems.update(dt);
     m_systems.postUpdate(dt);
 
-    std::deque<GameObject *> to_update;
+    auto tic = std::chrono::high_resolution_clock::now();
+
+    std::deque<std::pair<GameObject *, float>> to_update;
     for (auto id : m_root_entities.data())
     {
-        to_update.push_back(m_entities.at(id).get());
+        auto root = m_entities.at(id).get();
+        float tick_dt;
+        if (m_lod.tick(id, dt, tick_dt))
+        {
+            to_update.push_back({root, tick_dt});
+        }
+        else if (root->isDead()) //! entities that are not updated can still be killed by others
+        {
+            destroyObject(id);
+        }
     }
     //! we update the entities starting from parents ending with children
     while (!to_update.empty())
     {
-        auto current = to_update.front();
+        auto [current, current_dt] = to_update.front();
         to_update.pop_front();
-        current->updateAll(dt);
+        current->updateAll(current_dt);
         // current->update(dt);
         if (current->isDead())
         {
             destroyObject(current->getId());
         }
+        else if (current->getType() == ObjectType::Laser)
+        {
+            m_updated_lasers.push_back(static_cast<Laser *>(current));
+        }
 
         for (auto child : current->m_children)
         {
-            to_update.push_back(child);
+            to_update.push_back({child, current_dt});
         }
     }
+    stopLasers();
+
+    float update_time = std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::high_resolution_clock::now() - tic)
+                            .count() / 1000.f;
+    m_lod.endFrame(update_time);
+
+    for (auto &obj : m_entities.data())
+    {
+        m_visibility.move(obj->getId(), obj->getPosition(), obj->getSize());
+    }
 
     addQueuedEntities();
     removeQueuedEntities();
@@ -209,18 +363,28 @@ void GameWorld::checkComponentsConsistency()
     }
 }
 
-void GameWorld::draw(LayersHolder &layers, const View& camera_view)
+void GameWorld::setCameraView(const View& camera_view)
 {
+    //! we look a bit further than the camera so that nothing pops in at the edges
     View extended_camera = camera_view;
     extended_camera.setSize(camera_view.getSize()*2.f);
+    m_visibility.setView(extended_camera);
+}
 
-    for (auto &obj : m_entities.data())
+void GameWorld::draw(LayersHolder &layers, const View& camera_view)
+{
+    setCameraView(camera_view);
+    m_visibility.findVisible();
+
+    auto &stats = m_visibility.m_entity_stats;
+    stats.reset();
+    stats.considered = m_entities.data().size();
+    for (auto id : m_visibility.getVisible())
     {
-        if(extended_camera.contains(obj->getPosition()))
-        {
-            obj->draw(layers);
-        }
+        m_entities.at(id)->draw(layers);
+        stats.submitted++;
     }
+    stats.culled = stats.considered - stats.submitted;
 
 #ifdef DEBUG
     checkComponentsConsistency();
@@ -8,11 +8,14 @@
 #include <unordered_map>
 #include <functional>
 #include <queue>
+#include <array>
 
 #include <Texture.h>
 
 #include "CollisionSystem.h"
 #include "GridNeighbourSearcher.h"
+#include "VisibilityIndex.h"
+#include "SimulationLOD.h"
 
 #include "Entities/Entities.h"
 #include "Entities/Meteor.h"
@@ -31,6 +34,15 @@ class ToolBoxUI;
 
 struct PlayerEntity;
 
+//! \brief numbers of the last batch of entities that entered the world
+struct SpawnStats
+{
+    std::size_t batch_size = 0;
+    float insertion_time_ms = 0.f; //! time spent adding the batch into the world
+};
+
+using EntityTypeIndexT = std::array<ContiguousColony<int, int>, static_cast<std::size_t>(ObjectType::Count)>;
+
 class GameWorld
 {
 
@@ -42,6 +54,11 @@ public:
         return m_collision_system;
     }
 
+    utils::ThreadPool &getWorkers()
+    {
+        return m_workers;
+    }
+
     GameObject* get(int entity_id) 
     {
         return m_entities.at(entity_id).get();
@@ -54,6 +71,18 @@ public:
     {
         return m_entities.contains(entity_id);
     }
+    VisibilityIndex &getVisibility()
+    {
+        return m_visibility;
+    }
+    SimulationLOD &getSimulationLOD()
+    {
+        return m_lod;
+    }
+    const SpawnStats &getSpawnStats() const
+    {
+        return m_spawn_stats;
+    }
 
     //! checks whether components that exist have existing entities
     void checkComponentsConsistency();
@@ -64,6 +93,8 @@ public:
     std::shared_ptr<EntityType> createEntity2();
     template <class EntityType>
     EntityType &addObjectForced();
+    template <class EntityType>
+    std::vector<EntityType *> spawnBatch(std::size_t count);
 
     ///!!!
     void destroyObject(int entity_id);
@@ -73,7 +104,8 @@ public:
     template <class TriggerType, class... Args>
     TriggerType &addTrigger(Args... args);
     
-    std::size_t getNActiveEntities(ObjectType type);
+    std::size_t getNActiveEntities(ObjectType type) const;
+    const std::vector<int> &getEntitiesOfType(ObjectType type) const;
 
     // template <class EntityType>
     // std::size_t getActiveCount()
@@ -83,12 +115,17 @@ public:
 
     void update(float dt);
     void draw(LayersHolder &window, const View& camera_view);
+    void setCameraView(const View& camera_view);
 
     void removeParent(GameObject& child);
 
 private:
     void addQueuedEntities();
     void removeQueuedEntities();
+    void updateSimulationTiers();
+    void stopLasers();
+    void putToSleep(GameObject &entity);
+    void wakeUp(GameObject &entity);
     void loadTextures();
 
 public:
@@ -96,6 +133,7 @@ public:
     PlayerEntity *m_player;
     TextureHolder& m_textures;
 
+    utils::ThreadPool m_workers; //! shared by all systems which work in parallel
     Collisions::CollisionSystem m_collision_system;
     PostOffice *p_messenger = nullptr;
 
@@ -105,6 +143,14 @@ private:
 
     EntityRegistryT m_entities;
     DynamicObjectPool2<int> m_root_entities;
+    VisibilityIndex m_visibility;
+    SimulationLOD m_lod;
+    EntityTypeIndexT m_type2entities; //! dense ids of living entities for each ObjectType
+    SpawnStats m_spawn_stats;
+
+    std::vector<Laser *> m_updated_lasers; //! lasers updated in this frame, stopped by one batched raycast
+    std::vector<Collisions::RayQuery> m_laser_rays;
+    std::vector<RayCastData> m_laser_hits;
 
     std::shared_ptr<TargetSystem> m_ts;
 
@@ -136,6 +182,28 @@ EntityType &GameWorld::addObject2()
     return *new_entity;
 }
 
+//! \brief creates \p count entities with ids reserved in one go
+//! \brief the entities enter the world together with other queued entities, so that their
+//! \brief bounding volumes are built in bulk
+//! \returns the new entities, so that they can be set up before they are added
+template <class EntityType>
+std::vector<EntityType *> GameWorld::spawnBatch(std::size_t count)
+{
+    static_assert(std::is_base_of_v<GameObject, EntityType> || std::is_same_v<GameObject, EntityType>);
+
+    auto new_ids = m_entities.reserveIndicesForInsertion(count);
+    std::vector<EntityType *> new_entities;
+    new_entities.reserve(count);
+    for (auto new_id : new_ids)
+    {
+        auto new_entity = createEntity2<EntityType>();
+        new_entity->m_id = new_id;
+        new_entities.push_back(new_entity.get());
+        m_to_add.push_back(new_entity);
+    }
+    return new_entities;
+}
+
 template <class EntityType>
 std::shared_ptr<EntityType> GameWorld::createEntity2()
 {
@@ -162,6 +230,9 @@ EntityType &GameWorld::addObjectForced()
     {
         m_collision_system.insertObject(*new_entity);
     }
+    m_visibility.insert(new_id, new_entity->getPosition(), new_entity->getSize());
+    m_type2entities.at(static_cast<std::size_t>(new_entity->getType())).insert(new_id, new_id);
+    m_lod.insert(new_id);
     m_root_entities.insertAt(new_id, new_id);
     m_entities.insertAt(new_id, new_entity);
     
@@ -7,6 +7,8 @@
 #include <vector>
 #include <unordered_map>
 #include <memory>
+#include <algorithm>
+#include <cmath>
 
 #include <Utils/Vector2.h>
 #include <DrawLayer.h>
@@ -40,151 +42,183 @@ private:
 
 
 
-template <class DataType = utils::Vector2f>
-class SparseGridNeighbourSearcher
+//! \brief grid of points rebuilt from scratch each frame, points are sorted by their cell into flat arrays
+class SortedGridNeighbourSearcher
 {
 
-    using GridIndT = std::pair<int, int>; //! x and y coordinate of a grid
-    using GridNodeType = ContiguousColony<DataType, int>;
-
 public:
-    SparseGridNeighbourSearcher(float max_radius = 30.f)
-        : grid_size(max_radius)
+    SortedGridNeighbourSearcher(float cell_size = 30.f)
+        : m_default_cell_size(cell_size)
     {
     }
 
     void clear()
     {
-        m_grid.clear();
-        m_id2grid_ind.clear();
+        m_cell_start.clear();
+        m_sorted_pos.clear();
+        m_sorted_ids.clear();
     }
 
     void drawGrid(DrawLayer &layer)
     {
         auto &canvas = layer.m_canvas;
 
-        for (auto &[grid_ind, p_data] : m_grid)
+        for (int cell = 0; cell + 1 < static_cast<int>(m_cell_start.size()); ++cell)
         {
-            auto [gx, gy] = grid_ind;
-
-            utils::Vector2f lower_l = {gx * grid_size.x, gy * grid_size.y};
-            utils::Vector2f lower_r = {(gx + 1) * grid_size.x, gy * grid_size.y};
-            utils::Vector2f upper_l = {gx * grid_size.x, (gy + 1) * grid_size.y};
-            utils::Vector2f upper_r = {(gx + 1) * grid_size.x, (gy + 1) * grid_size.y};
-            canvas.drawLineBatched(lower_l, lower_r, 0.5, {1,0,0,1});
-            canvas.drawLineBatched(lower_r, upper_r, 0.5, {1,0,0,1});
-            canvas.drawLineBatched(lower_l, upper_l, 0.5, {1,0,0,1});
-            canvas.drawLineBatched(upper_l, upper_r, 0.5, {1,0,0,1});
+            if (m_cell_start[cell] == m_cell_start[cell + 1])
+            {
+                continue;
+            }
+            utils::Vector2f lower_l = m_flat_min + m_flat_cell_size * utils::Vector2f(static_cast<float>(cell % m_flat_nx), static_cast<float>(cell / m_flat_nx));
+            utils::Vector2f upper_r = lower_l + utils::Vector2f{m_flat_cell_size, m_flat_cell_size};
+            canvas.drawLineBatched(lower_l, {upper_r.x, lower_l.y}, 0.5, {1,0,0,1});
+            canvas.drawLineBatched({upper_r.x, lower_l.y}, upper_r, 0.5, {1,0,0,1});
+            canvas.drawLineBatched(lower_l, {lower_l.x, upper_r.y}, 0.5, {1,0,0,1});
+            canvas.drawLineBatched({lower_l.x, upper_r.y}, upper_r, 0.5, {1,0,0,1});
         }
     }
 
-    //! TODO: Optimize this: neighbours vector can be provided by the caller
-    //! TODO: Optimize: too many .count calls. Should find first all pairs of neighbouring grid cells and then look at neighbours within them 
-    std::vector<std::pair<utils::Vector2f, int>> getNeighbourList(int ind, utils::Vector2f pos, float max_radius)
+    //! \brief rebuilds the flat grid from scratch by a counting sort of \p positions on their cell index
+    //! \brief ids of the points are their indices in \p positions, no memory is allocated once the buffers have grown
+    //! \brief the grid spans only the bounding box of the points, cells get bigger when it would need too many of them
+    //! \param cell_size   size of cells, the size given in the constructor is used when it is not positive
+    void rebuild(const std::vector<utils::Vector2f> &positions, float cell_size = 0.f)
     {
-        assert(max_radius <= grid_size.x);
-
-        GridIndT grid_ind = {std::floor(pos.x / grid_size.x), std::floor(pos.y / grid_size.y)};
-
-        std::vector<std::pair<utils::Vector2f, int>> neighbours;
-        neighbours.reserve(100);
-
-        const float max_radius_sq = max_radius * max_radius;
-
-        for (int dx = -1; dx <= 1; ++dx)
+        const int point_count = static_cast<int>(positions.size());
+        m_sorted_pos.resize(point_count);
+        m_sorted_ids.resize(point_count);
+        m_point_cells.resize(point_count);
+        if (point_count == 0)
         {
-            for (int dy = -1; dy <= 1; ++dy)
-            {
-                GridIndT neighbour_grid_ind = {grid_ind.first + dx, grid_ind.second + dy};
-                if (m_grid.count(neighbour_grid_ind) == 0)
-                {
-                    continue;
-                }
-                const auto &data = m_grid.at(neighbour_grid_ind)->data;
-                const auto &data_inds = m_grid.at(neighbour_grid_ind)->data_ind2id;
+            m_cell_start.assign(2, 0);
+            m_flat_nx = 1;
+            m_flat_ny = 1;
+            return;
+        }
 
-                for (std::size_t i = 0; i < data.size(); ++i)
-                {
-                    //! if within range and not neighbour with itself
-                    if (data_inds[i] != ind && utils::norm2(pos - data[i]) < max_radius_sq)
-                    {
-                        neighbours.push_back({data[i], data_inds[i]});
-                    }
-                }
-            }
+        utils::Vector2f min = positions[0];
+        utils::Vector2f max = positions[0];
+        for (auto &pos : positions)
+        {
+            min = {std::min(min.x, pos.x), std::min(min.y, pos.y)};
+            max = {std::max(max.x, pos.x), std::max(max.y, pos.y)};
         }
-        return neighbours;
-    }
 
-    void move(utils::Vector2f new_pos, int ind)
-    {
+        const float max_cell_count = std::max(1024.f, 2.f * point_count);
+        m_flat_cell_size = cell_size > 0.f ? cell_size : m_default_cell_size;
+        while ((std::floor((max.x - min.x) / m_flat_cell_size) + 1.f) *
+                   (std::floor((max.y - min.y) / m_flat_cell_size) + 1.f) >
+               max_cell_count)
+        {
+            m_flat_cell_size *= 2.f;
+        }
+        m_flat_min = min;
+        m_flat_nx = static_cast<int>((max.x - min.x) / m_flat_cell_size) + 1;
+        m_flat_ny = static_cast<int>((max.y - min.y) / m_flat_cell_size) + 1;
 
-        GridIndT old_grid_ind = m_id2grid_ind.at(ind);
-        GridIndT new_ind = {std::floor(new_pos.x / grid_size.x), std::floor(new_pos.y / grid_size.y)};
+        //! count points in cells, then the exclusive prefix sum gives starts of the cells
+        m_cell_start.assign(m_flat_nx * m_flat_ny + 1, 0);
+        for (int i = 0; i < point_count; ++i)
+        {
+            int cell = calcFlatCellX(positions[i].x) + m_flat_nx * calcFlatCellY(positions[i].y);
+            m_point_cells[i] = cell;
+            m_cell_start[cell + 1]++;
+        }
+        for (std::size_t cell = 1; cell < m_cell_start.size(); ++cell)
+        {
+            m_cell_start[cell] += m_cell_start[cell - 1];
+        }
 
-        if (old_grid_ind != new_ind)
+        //! scatter points into their cells, the counts are restored into starts afterwards
+        for (int i = 0; i < point_count; ++i)
+        {
+            int slot = m_cell_start[m_point_cells[i]]++;
+            m_sorted_pos[slot] = positions[i];
+            m_sorted_ids[slot] = i;
+        }
+        for (std::size_t cell = m_cell_start.size() - 1; cell > 0; --cell)
         {
-            auto datum = m_grid.at(old_grid_ind)->get(ind);
-            remove(old_grid_ind, ind);
-            insertAt(new_pos, datum, ind);
+            m_cell_start[cell] = m_cell_start[cell - 1];
         }
+        m_cell_start[0] = 0;
     }
 
-    
-    void insertAt(utils::Vector2f pos, DataType datum, int ind)
+    //! \brief calls \p callback(range_begin, range_end) for ranges of sorted points in cells touched by the circle
+    //! \brief cells of one row are next to each other, so each row of the touched cells is a single range
+    template <class CallbackT>
+    void forEachCellRange(utils::Vector2f pos, float max_radius, CallbackT &&callback) const
     {
-        GridIndT grid_ind = {std::floor(pos.x / grid_size.x), std::floor(pos.y / grid_size.y)};
-
-        if (m_grid.count(grid_ind) == 0)
+        if (m_sorted_pos.empty())
         {
-            addNode(grid_ind);
+            return;
         }
 
-        assert(m_id2grid_ind.count(ind) == 0);
-        m_id2grid_ind[ind] = grid_ind;
-        m_grid.at(grid_ind)->insert(ind, datum);
+        const int x_min = calcFlatCellX(pos.x - max_radius);
+        const int x_max = calcFlatCellX(pos.x + max_radius);
+        const int y_min = calcFlatCellY(pos.y - max_radius);
+        const int y_max = calcFlatCellY(pos.y + max_radius);
+        for (int y = y_min; y <= y_max; ++y)
+        {
+            callback(m_cell_start[y * m_flat_nx + x_min], m_cell_start[y * m_flat_nx + x_max + 1]);
+        }
     }
 
-    void remove(int entity_ind)
+    //! \brief calls \p callback(neighbour_pos, neighbour_id) for points of the last rebuild closer than \p max_radius to \p pos
+    //! \brief the point with id \p ind is skipped, nothing is allocated and \p max_radius is not limited by the cell size
+    template <class CallbackT>
+    void forEachNeighbour(int ind, utils::Vector2f pos, float max_radius, CallbackT &&callback) const
     {
-        remove(m_id2grid_ind.at(entity_ind), entity_ind);
+        const float max_radius_sq = max_radius * max_radius;
+        forEachCellRange(pos, max_radius, [&](int range_begin, int range_end)
+                         {
+            for (int i = range_begin; i < range_end; ++i)
+            {
+                if (m_sorted_ids[i] != ind && utils::norm2(pos - m_sorted_pos[i]) < max_radius_sq)
+                {
+                    callback(m_sorted_pos[i], m_sorted_ids[i]);
+                }
+            } });
     }
 
-    void remove(GridIndT grid_ind, int entity_ind)
+    //! \brief fills \p neighbours with results of \ref forEachNeighbour, the caller keeps the vector to reuse its memory
+    void getNeighbourList(int ind, utils::Vector2f pos, float max_radius,
+                          std::vector<std::pair<utils::Vector2f, int>> &neighbours) const
     {
-        m_id2grid_ind.erase(entity_ind);
-
-        m_grid.at(grid_ind)->erase(entity_ind);
-        if (m_grid.at(grid_ind)->isEmpty())
-        {
-            removeNode(grid_ind);
-        }
+        neighbours.clear();
+        forEachNeighbour(ind, pos, max_radius, [&neighbours](utils::Vector2f neighbour_pos, int neighbour_id)
+                         { neighbours.push_back({neighbour_pos, neighbour_id}); });
     }
 
-private:
-    void removeNode(GridIndT grid_ind)
+    //! \returns ids of points of the last rebuild ordered by cell, visiting points in this order keeps queries cache friendly
+    const std::vector<int> &getSortedIds() const
     {
-        assert(m_grid.count(grid_ind) != 0);
-        m_grid.erase(grid_ind);
+        return m_sorted_ids;
     }
-
-    void addNode(GridIndT grid_ind)
+    const std::vector<utils::Vector2f> &getSortedPositions() const
     {
-        assert(m_grid.count(grid_ind) == 0);
-        m_grid[grid_ind] = std::make_shared<GridNodeType>();
+        return m_sorted_pos;
     }
 
 private:
-    utils::Vector2f grid_size;
-
-    struct pair_hash
+    int calcFlatCellX(float x) const
     {
-        std::size_t operator()(GridIndT grid_ind) const
-        {
-            return ((grid_ind.first ^ grid_ind.second) << 16) + (grid_ind.first - grid_ind.second);
-        }
-    };
+        return std::clamp(static_cast<int>(std::floor((x - m_flat_min.x) / m_flat_cell_size)), 0, m_flat_nx - 1);
+    }
+    int calcFlatCellY(float y) const
+    {
+        return std::clamp(static_cast<int>(std::floor((y - m_flat_min.y) / m_flat_cell_size)), 0, m_flat_ny - 1);
+    }
 
-    std::unordered_map<GridIndT, std::shared_ptr<GridNodeType>, pair_hash> m_grid;
-    std::unordered_map<int, GridIndT> m_id2grid_ind;
+private:
+    float m_default_cell_size;
+
+    //! flat grid of the last rebuild, points of a cell are in [m_cell_start[cell], m_cell_start[cell + 1])
+    utils::Vector2f m_flat_min = {0, 0};
+    float m_flat_cell_size = 1.f;
+    int m_flat_nx = 1;
+    int m_flat_ny = 1;
+    std::vector<int> m_cell_start;
+    std::vector<utils::Vector2f> m_sorted_pos;
+    std::vector<int> m_sorted_ids;
+    std::vector<int> m_point_cells;
 };
@@ -1,6 +1,13 @@
 #include "Polygon.h"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
 #include <numbers>
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 #ifndef M_PI
 #define M_PI std::numbers::pi_v<float>
 #endif
@@ -19,32 +26,130 @@ Polygon::Polygon(int n_points, utils::Vector2f at) : points(n_points)
   setPosition(at);
 }
 
+//! \brief circle around \p at, the default radius makes it as big as the regular polygons
+Polygon Polygon::makeCircle(float radius, utils::Vector2f at)
+{
+  Polygon circle(0);
+  circle.points = {at};
+  circle.radius = radius;
+  return circle;
+}
+
+//! \brief capsule along the local x axis, made of a segment from -\p half_length to \p half_length
+//! \brief and everything closer to it than \p radius
+Polygon Polygon::makeCapsule(float half_length, float radius)
+{
+  Polygon capsule(0);
+  capsule.points = {{-half_length, 0.f}, {half_length, 0.f}};
+  capsule.radius = radius;
+  return capsule;
+}
+
 std::vector<utils::Vector2f> Polygon::getPointsInWorld() const
+{
+  std::vector<utils::Vector2f> world_points;
+  transformPoints(world_points);
+  return world_points;
+}
+
+//! \brief scales, rotates and translates the points into \p world_points, which are reused if big enough
+void Polygon::transformPoints(std::vector<utils::Vector2f> &world_points) const
 {
   auto n_points = points.size();
-  std::vector<utils::Vector2f> world_points(n_points);
-  //! scaling
-  for (int i = 0; i < n_points; ++i)
+  world_points.resize(n_points);
+
+  const auto scale = getScale();
+  const auto position = getPosition();
+  const float angle_rads = glm::radians(getRotation());
+  const float cos_angle = glm::cos(angle_rads);
+  const float sin_angle = glm::sin(angle_rads);
+  for (std::size_t i = 0; i < n_points; ++i)
   {
-    world_points[i] =  {points[i].x * getScale().x, points[i].y * getScale().y};
+    utils::Vector2f scaled = {points[i].x * scale.x, points[i].y * scale.y};
+    world_points[i] = {scaled.x * cos_angle - scaled.y * sin_angle + position.x,
+                       scaled.x * sin_angle + scaled.y * cos_angle + position.y};
   }
-  //! rotation
-  for (int i = 0; i < n_points; ++i)
+}
+
+static bool inline equal(utils::Vector2f a, utils::Vector2f b)
+{
+  return a.x == b.x && a.y == b.y;
+}
+
+//! \brief recomputes \p world if the transform changed since it was last computed
+//! \brief points past the capacity of world polygons are dropped, which keeps convex polygons convex
+//! \returns true if \p world was recomputed
+bool Polygon::updateWorld(WorldPolygon &world) const
+{
+  const auto n_points = std::min(points.size(), k_max_polygon_vertices);
+  if (points.size() > k_max_polygon_vertices)
   {
-    float angle_rads = glm::radians(getRotation());
-    world_points[i] =
-        {
-          world_points[i].x * glm::cos(angle_rads) - world_points[i].y * glm::sin(angle_rads),
-          world_points[i].x * glm::sin(angle_rads) + world_points[i].y * glm::cos(angle_rads),
-        };
+    //! reported once, this runs every frame and from worker threads
+    static std::atomic<bool> is_reported = false;
+    if (!is_reported.exchange(true))
+    {
+      std::cout << "Polygon with " << points.size() << " points is clamped to " << k_max_polygon_vertices
+                << " points!" << std::endl;
+    }
   }
-  //! translation
-  for (int i = 0; i < n_points; ++i)
+
+  if (world.is_valid && world.count == n_points && equal(world.position, getPosition()) &&
+      equal(world.scale, getScale()) && world.rotation == getRotation())
   {
-    world_points[i] +=  getPosition();
+    return false;
   }
+  world.position = getPosition();
+  world.scale = getScale();
+  world.rotation = getRotation();
+  world.center = getPosition();
+  world.is_valid = true;
 
-  return world_points;
+  assert(n_points > 0);
+  world.count = n_points;
+
+  const auto scale = getScale();
+  const float angle_rads = glm::radians(getRotation());
+  const float cos_angle = glm::cos(angle_rads);
+  const float sin_angle = glm::sin(angle_rads);
+  for (std::size_t i = 0; i < n_points; ++i)
+  {
+    utils::Vector2f scaled = {points[i].x * scale.x, points[i].y * scale.y};
+    world.xs[i] = scaled.x * cos_angle - scaled.y * sin_angle + world.position.x;
+    world.ys[i] = scaled.x * sin_angle + scaled.y * cos_angle + world.position.y;
+  }
+  //! padding repeats the last vertex, which does not change projections
+  for (std::size_t i = n_points; i < world.getPaddedCount(); ++i)
+  {
+    world.xs[i] = world.xs[n_points - 1];
+    world.ys[i] = world.ys[n_points - 1];
+  }
+
+  //! points can be in either order and scales can be negative, so the winding decides which normals point out
+  float doubled_area = 0.f;
+  for (std::size_t i = 0; i < n_points; ++i)
+  {
+    const auto next = (i + 1) % n_points;
+    doubled_area += world.xs[i] * world.ys[next] - world.xs[next] * world.ys[i];
+  }
+  const float orientation = doubled_area < 0.f ? -1.f : 1.f;
+
+  world.radius = radius * std::min(std::abs(scale.x), std::abs(scale.y));
+  world.bounding_rect = {world.getPoint(0), world.getPoint(0)};
+  for (std::size_t i = 0; i < n_points; ++i)
+  {
+    const auto point = world.getPoint(i);
+    auto edge = world.getPoint((i + 1) % n_points) - point;
+    utils::Vector2f normal = {orientation * edge.y, -orientation * edge.x};
+    world.normals[i] = utils::approx_equal_zero(norm2(normal)) ? utils::Vector2f{0, 0} : normal / norm(normal);
+
+    world.bounding_rect.r_min.x = std::min(world.bounding_rect.r_min.x, point.x);
+    world.bounding_rect.r_min.y = std::min(world.bounding_rect.r_min.y, point.y);
+    world.bounding_rect.r_max.x = std::max(world.bounding_rect.r_max.x, point.x);
+    world.bounding_rect.r_max.y = std::max(world.bounding_rect.r_max.y, point.y);
+  }
+  world.bounding_rect.r_min -= utils::Vector2f{world.radius, world.radius};
+  world.bounding_rect.r_max += utils::Vector2f{world.radius, world.radius};
+  return true;
 }
 
 void Polygon::move(utils::Vector2f by)
@@ -60,20 +165,132 @@ void Polygon::rotate(float by)
 
 utils::Vector2f Polygon::getMVTOfSphere(utils::Vector2f center, float radius)
 {
+  WorldPolygon world;
+  updateWorld(world);
+  return world.getMVTOfSphere(center, radius);
+}
 
-  const auto &points_world = getPointsInWorld();
+//! \brief projects all vertices on unit \p axis, uses AVX2 or SSE when the compiler targets them
+//! \brief projections of circles and capsules are extended by their radius
+Projection1D WorldPolygon::project(utils::Vector2f axis) const
+{
+  const auto padded_count = getPaddedCount();
+  Projection1D projection;
+#if defined(__AVX2__)
+  const __m256 axis_x = _mm256_set1_ps(axis.x);
+  const __m256 axis_y = _mm256_set1_ps(axis.y);
+  __m256 min_proj = _mm256_set1_ps(projection.min);
+  __m256 max_proj = _mm256_set1_ps(projection.max);
+  for (std::size_t i = 0; i < padded_count; i += 8)
+  {
+    __m256 proj = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(&xs[i]), axis_x),
+                                _mm256_mul_ps(_mm256_loadu_ps(&ys[i]), axis_y));
+    min_proj = _mm256_min_ps(min_proj, proj);
+    max_proj = _mm256_max_ps(max_proj, proj);
+  }
+  alignas(32) std::array<float, 8> mins;
+  alignas(32) std::array<float, 8> maxs;
+  _mm256_store_ps(mins.data(), min_proj);
+  _mm256_store_ps(maxs.data(), max_proj);
+  for (std::size_t lane = 0; lane < 8; ++lane)
+  {
+    projection.min = std::min(projection.min, mins[lane]);
+    projection.max = std::max(projection.max, maxs[lane]);
+  }
+#elif defined(__SSE2__)
+  const __m128 axis_x = _mm_set1_ps(axis.x);
+  const __m128 axis_y = _mm_set1_ps(axis.y);
+  __m128 min_proj = _mm_set1_ps(projection.min);
+  __m128 max_proj = _mm_set1_ps(projection.max);
+  for (std::size_t i = 0; i < padded_count; i += 4)
+  {
+    __m128 proj = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&xs[i]), axis_x), _mm_mul_ps(_mm_loadu_ps(&ys[i]), axis_y));
+    min_proj = _mm_min_ps(min_proj, proj);
+    max_proj = _mm_max_ps(max_proj, proj);
+  }
+  alignas(16) std::array<float, 4> mins;
+  alignas(16) std::array<float, 4> maxs;
+  _mm_store_ps(mins.data(), min_proj);
+  _mm_store_ps(maxs.data(), max_proj);
+  for (std::size_t lane = 0; lane < 4; ++lane)
+  {
+    projection.min = std::min(projection.min, mins[lane]);
+    projection.max = std::max(projection.max, maxs[lane]);
+  }
+#else
+  for (std::size_t i = 0; i < padded_count; ++i)
+  {
+    float proj = xs[i] * axis.x + ys[i] * axis.y;
+    projection.min = std::min(projection.min, proj);
+    projection.max = std::max(projection.max, proj);
+  }
+#endif
+  projection.min -= radius;
+  projection.max += radius;
+  return projection;
+}
+
+//! \returns index of the vertex furthest along \p axis
+//! \brief moves the points without transforming them again, the transform is then no longer the one they were computed for
+void WorldPolygon::translate(utils::Vector2f by)
+{
+  for (std::size_t i = 0; i < getPaddedCount(); ++i)
+  {
+    xs[i] += by.x;
+    ys[i] += by.y;
+  }
+  center += by;
+  bounding_rect.r_min += by;
+  bounding_rect.r_max += by;
+  is_valid = false;
+}
+
+std::size_t WorldPolygon::furthestVertex(utils::Vector2f axis) const
+{
+  float max_dist = -std::numeric_limits<float>::max();
+  std::size_t index = 0;
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    auto dist = xs[i] * axis.x + ys[i] * axis.y;
+    if (dist > max_dist)
+    {
+      index = i;
+      max_dist = dist;
+    }
+  }
+  return index;
+}
 
-  int next = 1;
-  const auto n_points1 = points.size();
+utils::Vector2f WorldPolygon::getMVTOfSphere(utils::Vector2f center, float radius) const
+{
+  if (isRound())
+  {
+    //! direction from the closest point of the core to the sphere
+    auto start = getPoint(0);
+    auto core = getPoint(count - 1) - start;
+    auto core_length2 = norm2(core);
+    float t = core_length2 > 0.f ? std::clamp(dot(center - start, core) / core_length2, 0.f, 1.f) : 0.f;
+    auto dr = center - (start + t * core);
+    auto dist2 = norm2(dr);
+    if (dist2 >= (radius + this->radius) * (radius + this->radius))
+    {
+      return {0, 0};
+    }
+    return dist2 > 0.f ? dr / std::sqrt(dist2) : utils::Vector2f{1, 0};
+  }
+
+  const auto n_points1 = count;
 
   float min_overlap = std::numeric_limits<float>::max();
   utils::Vector2f min_axis;
-  for (int curr = 0; curr < n_points1; ++curr)
+  for (std::size_t curr = 0; curr < n_points1; ++curr)
   {
-    auto t1 = points_world.at(next) - points_world[curr]; //! line perpendicular to current polygon edge
-    utils::Vector2f n1 = {t1.y, -t1.x};
-    n1 /= norm(n1);
-    auto proj1 = projectOnAxis(n1, points_world);
+    const auto &n1 = normals[curr]; //! line perpendicular to current polygon edge
+    if (n1.x == 0.f && n1.y == 0.f) //! degenerate edge
+    {
+      continue;
+    }
+    auto proj1 = project(n1);
     float proj_sphere = dot(n1, center);
     Projection1D proj2({proj_sphere - radius, proj_sphere + radius});
 
@@ -90,11 +307,34 @@ utils::Vector2f Polygon::getMVTOfSphere(utils::Vector2f center, float radius)
         min_axis = n1;
       }
     }
-    next++;
-    if (next == n_points1)
+  }
+  return min_axis;
+}
+
+//! \returns true where getMVTOfSphere() finds a nonzero translation, without computing it
+bool WorldPolygon::overlapsSphere(utils::Vector2f center, float radius) const
+{
+  if (isRound())
+  {
+    auto start = getPoint(0);
+    auto core = getPoint(count - 1) - start;
+    auto core_length2 = norm2(core);
+    float t = core_length2 > 0.f ? std::clamp(dot(center - start, core) / core_length2, 0.f, 1.f) : 0.f;
+    return norm2(center - (start + t * core)) < (radius + this->radius) * (radius + this->radius);
+  }
+
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    const auto &normal = normals[i];
+    if (normal.x == 0.f && normal.y == 0.f) //! degenerate edge
     {
-      next = 0;
+      continue;
+    }
+    float proj_sphere = dot(normal, center);
+    if (!overlap1D(project(normal), {proj_sphere - radius, proj_sphere + radius}))
+    {
+      return false;
     }
   }
-  return min_axis;
+  return true;
 }
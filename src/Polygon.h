@@ -4,16 +4,75 @@
 #include <Transform.h>
 #include <Renderer.h>
 
+#include <array>
+#include <numbers>
 #include <vector>
 
 #include "core.h"
 
+constexpr std::size_t k_max_polygon_vertices = 32; //! collision polygons can not have more vertices
+constexpr std::size_t k_polygon_simd_width = 8;    //! vertices are padded to a multiple of this
+
+//! \brief polygon transformed to the world, kept between frames so that collision queries do not transform again
+//! \brief has fixed capacity so that collision tests do not touch the heap, coordinates are stored in separate
+//! \brief arrays padded with the last vertex, so that projections on axes can be vectorized
+//! \brief circles are stored as one point and capsules as two points (their core segment) with nonzero radius
+struct WorldPolygon
+{
+  alignas(32) std::array<float, k_max_polygon_vertices> xs;
+  alignas(32) std::array<float, k_max_polygon_vertices> ys;
+  std::array<utils::Vector2f, k_max_polygon_vertices> normals; //! outward unit normals of edges from i to i + 1, zero for degenerate edges
+  std::size_t count = 0;
+  float radius = 0.f; //! distance of the outline from the points, zero for polygons
+  AABB bounding_rect; //! tight rect around the points
+  utils::Vector2f center = {0, 0};
+
+  //! transform the points were computed for
+  utils::Vector2f position = {0, 0};
+  utils::Vector2f scale = {0, 0};
+  float rotation = 0.f;
+  bool is_valid = false;
+
+  utils::Vector2f getPoint(std::size_t index) const
+  {
+    return {xs[index], ys[index]};
+  }
+
+  std::size_t getPaddedCount() const
+  {
+    return (count + k_polygon_simd_width - 1) / k_polygon_simd_width * k_polygon_simd_width;
+  }
+
+  bool isCircle() const
+  {
+    return count == 1;
+  }
+  bool isCapsule() const
+  {
+    return count == 2;
+  }
+  bool isRound() const
+  {
+    return count < 3;
+  }
+
+  Projection1D project(utils::Vector2f axis) const;
+  void translate(utils::Vector2f by);
+  std::size_t furthestVertex(utils::Vector2f axis) const;
+  utils::Vector2f getMVTOfSphere(utils::Vector2f center, float radius) const;
+  bool overlapsSphere(utils::Vector2f center, float radius) const;
+};
+
 struct Polygon : public Transform
 {
   std::vector<utils::Vector2f> points;
+  float radius = 0.f; //! radius of circles and capsules, scaled by the smaller of the scales
 
   Polygon(int n_points = 3, utils::Vector2f at = {0, 0});
 
+  static Polygon makeCircle(float radius = std::numbers::sqrt2_v<float>, utils::Vector2f at = {0, 0});
+  static Polygon makeCapsule(float half_length, float radius = 1.f);
+
   AABB getBoundingRect() const
   {
     auto r = getPosition();
@@ -27,19 +86,55 @@ struct Polygon : public Transform
   }
 
   std::vector<utils::Vector2f> getPointsInWorld() const;
+  void transformPoints(std::vector<utils::Vector2f> &world_points) const;
+  bool updateWorld(WorldPolygon &world) const;
   void move(utils::Vector2f by);
   void rotate(float by);
   void update(float dt);
 
   bool isCircle() const
   {
-    return points.size() < 3;
+    return points.size() == 1;
+  }
+  bool isCapsule() const
+  {
+    return points.size() == 2;
   }
   utils::Vector2f getMVTOfSphere(utils::Vector2f center, float radius);
 };
 
 void inline drawShape(Renderer &canvas, const Polygon &shape)
 {
+  if (shape.isCircle() || shape.isCapsule())
+  {
+    //! outline made of half circles around the ends, joined by lines for capsules
+    WorldPolygon world;
+    shape.updateWorld(world);
+    constexpr int n_arc_points = 12;
+    auto start = world.getPoint(0);
+    auto end = world.getPoint(world.count - 1);
+    auto dir = end - start;
+    float start_angle = world.isCapsule() ? std::atan2(dir.y, dir.x) + std::numbers::pi_v<float> / 2.f : 0.f;
+    float arc_angle = world.isCapsule() ? std::numbers::pi_v<float> : 2.f * std::numbers::pi_v<float>;
+    for (auto [center, angle] : {std::pair{start, start_angle}, std::pair{end, start_angle + std::numbers::pi_v<float>}})
+    {
+      for (int i = 0; i < n_arc_points; ++i)
+      {
+        float angle1 = angle + arc_angle * i / n_arc_points;
+        float angle2 = angle + arc_angle * (i + 1) / n_arc_points;
+        canvas.drawLineBatched(center + world.radius * utils::Vector2f{std::cos(angle1), std::sin(angle1)},
+                               center + world.radius * utils::Vector2f{std::cos(angle2), std::sin(angle2)}, 0.25, {0, 1., 0., 1.});
+      }
+      if (world.isCircle())
+      {
+        return;
+      }
+    }
+    utils::Vector2f normal = world.normals[0] * world.radius;
+    canvas.drawLineBatched(start + normal, end + normal, 0.25, {0, 1., 0., 1.});
+    canvas.drawLineBatched(start - normal, end - normal, 0.25, {0, 1., 0., 1.});
+    return;
+  }
   auto n_points = shape.points.size();
   auto points = shape.getPointsInWorld();
   for (int i = 0; i < n_points; ++i)
@@ -6,6 +6,7 @@
 #include <memory>
 #include <functional>
 #include <typeindex>
+#include <span>
 
 #include "GameEvents.h"
 #include "GameObject.h"
@@ -42,6 +43,10 @@ public:
     {
         messages.push_back(message);
     }
+    void send(std::span<const MessageType> batch)
+    {
+        messages.insert(messages.end(), batch.begin(), batch.end());
+    }
 
     int subscribe(Callback<MessageType> subscriber)
     {
@@ -139,6 +144,9 @@ public:
     template <class MessageDataT>
     void send(MessageDataT message);
 
+    template <class MessageDataT>
+    void sendBatch(std::span<const MessageDataT> messages);
+
     template <class MessageDataT>
     void registerEvent();
 
@@ -85,6 +85,13 @@ inline void PostOffice::send(MessageDataT message)
     getHolder<MessageDataT>().send(message);
 }
 
+//! \brief sends all \p messages at once, subscribers receive them in the same order
+template <class MessageDataT>
+inline void PostOffice::sendBatch(std::span<const MessageDataT> messages)
+{
+    getHolder<MessageDataT>().send(messages);
+}
+
 #include <iostream>
 
 template <class MessageDataT>
@@ -233,13 +233,9 @@ std::shared_ptr<Quest> QuestFactory::createBossAndQuest(utils::Vector2f boss_off
             auto kill_task = std::make_shared<DestroyEntityTask>(boss, *m_font, m_messanger, &q);
             q.addTask(kill_task);
 
-            auto &entities = m_world.getEntities();
-            for (auto obj : entities.data())
+            for (auto meteor_id : m_world.getEntitiesOfType(ObjectType::Meteor))
             {
-                if (obj->getType() == ObjectType::Meteor)
-                {
-                    obj->kill();
-                }
+                m_world.get(meteor_id)->kill();
             }
         };
 
@@ -273,6 +269,10 @@ std::vector<int> QuestFactory::buildTheWall(utils::Vector2f center, utils::Vecto
     c_comp_right.shape.convex_shapes = {4};
     c_comp_up.shape.convex_shapes = {4};
     c_comp_down.shape.convex_shapes = {4};
+    c_comp_left.is_static = true;
+    c_comp_right.is_static = true;
+    c_comp_up.is_static = true;
+    c_comp_down.is_static = true;
 
     wall_right.setPosition(center + utils::Vector2f{size.x, 0});
     wall_left.setPosition(center - utils::Vector2f{size.x, 0});
@@ -0,0 +1,535 @@
+#include "ShapeDecomposition.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iostream>
+
+#include <nlohmann/json.hpp>
+
+constexpr std::size_t k_max_fit_attempts = 24; //! tolerance grows by half each attempt, which is enough to get to a triangle
+
+static float cross(utils::Vector2f a, utils::Vector2f b)
+{
+    return a.x * b.y - a.y * b.x;
+}
+
+static bool isSamePoint(utils::Vector2f a, utils::Vector2f b)
+{
+    return a.x == b.x && a.y == b.y;
+}
+
+//! \returns twice the signed area, positive for outlines going clockwise on the screen (y points down)
+static float calcDoubledArea(const Outline &outline)
+{
+    float doubled_area = 0.f;
+    for (std::size_t i = 0; i < outline.size(); ++i)
+    {
+        const auto &next = outline[(i + 1) % outline.size()];
+        doubled_area += cross(outline[i], next);
+    }
+    return doubled_area;
+}
+
+static float calcDistanceToSegment(utils::Vector2f point, utils::Vector2f from, utils::Vector2f to)
+{
+    auto segment = to - from;
+    auto length2 = norm2(segment);
+    float t = length2 > 0.f ? std::clamp(dot(point - from, segment) / length2, 0.f, 1.f) : 0.f;
+    return norm(point - (from + t * segment));
+}
+
+//! \brief removes repeated points and points in the middle of straight parts
+static Outline removeCollinear(const Outline &outline)
+{
+    Outline cleaned;
+    const auto n = outline.size();
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        const auto &prev = outline[(i + n - 1) % n];
+        const auto &point = outline[i];
+        const auto &next = outline[(i + 1) % n];
+        if (cross(point - prev, next - point) != 0.f)
+        {
+            cleaned.push_back(point);
+        }
+    }
+    return cleaned;
+}
+
+//! \returns true if turns at all vertices go the same way as \p orientation, straight angles are allowed
+static bool isConvex(const Outline &outline, float orientation)
+{
+    const auto n = outline.size();
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        const auto &prev = outline[(i + n - 1) % n];
+        const auto &next = outline[(i + 1) % n];
+        if (orientation * cross(outline[i] - prev, next - outline[i]) < 0.f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//! \brief convex hull by the monotone chain, in the same orientation as outlines
+static Outline makeConvexHull(Outline points)
+{
+    std::sort(points.begin(), points.end(), [](auto a, auto b)
+              { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+    Outline hull(2 * points.size());
+    std::size_t count = 0;
+    auto addChain = [&](auto begin, auto end, std::size_t chain_start)
+    {
+        for (auto it = begin; it != end; ++it)
+        {
+            while (count >= chain_start + 2 && cross(hull[count - 1] - hull[count - 2], *it - hull[count - 1]) <= 0.f)
+            {
+                count--;
+            }
+            hull[count++] = *it;
+        }
+    };
+    addChain(points.begin(), points.end(), 0);
+    addChain(points.rbegin() + 1, points.rend(), count - 1);
+    hull.resize(count > 1 ? count - 1 : count);
+    return hull;
+}
+
+//! \brief follows edges between solid and empty pixels, the edges go clockwise around solid pixels on the screen,
+//! \brief so outer outlines have positive area and holes negative
+//! \brief where two solid pixels touch only by corners the outline turns right, so they belong to different outlines
+//! \returns corners of the pixels on the outline of the largest solid area, holes are ignored
+Outline traceOutline(const RgbaImage &image, std::uint8_t alpha_threshold)
+{
+    const long width = static_cast<long>(image.width);
+    const long height = static_cast<long>(image.height);
+    auto isSolid = [&](long x, long y)
+    {
+        return x >= 0 && y >= 0 && x < width && y < height && image.getAlpha(x, y) > alpha_threshold;
+    };
+    auto cornerIndex = [width](long x, long y)
+    {
+        return static_cast<int>(y * (width + 1) + x);
+    };
+
+    struct Edge
+    {
+        int from;
+        int to;
+    };
+    std::vector<Edge> edges;
+    std::vector<std::array<int, 2>> outgoing_edges((width + 1) * (height + 1), {-1, -1});
+    auto addEdge = [&](int from, int to)
+    {
+        auto &outgoing = outgoing_edges[from];
+        outgoing[outgoing[0] == -1 ? 0 : 1] = static_cast<int>(edges.size());
+        edges.push_back({from, to});
+    };
+    for (long y = 0; y < height; ++y)
+    {
+        for (long x = 0; x < width; ++x)
+        {
+            if (!isSolid(x, y))
+            {
+                continue;
+            }
+            if (!isSolid(x, y - 1))
+            {
+                addEdge(cornerIndex(x, y), cornerIndex(x + 1, y));
+            }
+            if (!isSolid(x + 1, y))
+            {
+                addEdge(cornerIndex(x + 1, y), cornerIndex(x + 1, y + 1));
+            }
+            if (!isSolid(x, y + 1))
+            {
+                addEdge(cornerIndex(x + 1, y + 1), cornerIndex(x, y + 1));
+            }
+            if (!isSolid(x - 1, y))
+            {
+                addEdge(cornerIndex(x, y + 1), cornerIndex(x, y));
+            }
+        }
+    }
+
+    auto toPoint = [width](int corner)
+    {
+        return utils::Vector2f{static_cast<float>(corner % (width + 1)), static_cast<float>(corner / (width + 1))};
+    };
+
+    Outline largest;
+    float largest_area = 0.f;
+    std::vector<bool> is_visited(edges.size(), false);
+    for (std::size_t first_edge = 0; first_edge < edges.size(); ++first_edge)
+    {
+        if (is_visited[first_edge])
+        {
+            continue;
+        }
+        Outline loop;
+        auto edge_index = static_cast<int>(first_edge);
+        while (!is_visited[edge_index])
+        {
+            is_visited[edge_index] = true;
+            const auto &edge = edges[edge_index];
+            loop.push_back(toPoint(edge.from));
+
+            const auto &outgoing = outgoing_edges[edge.to];
+            auto next_edge = outgoing[0];
+            if (outgoing[1] != -1)
+            {
+                auto direction = toPoint(edge.to) - toPoint(edge.from);
+                utils::Vector2f right_turn = {-direction.y, direction.x};
+                const auto &candidate = edges[outgoing[1]];
+                if (isSamePoint(toPoint(candidate.to) - toPoint(candidate.from), right_turn))
+                {
+                    next_edge = outgoing[1];
+                }
+            }
+            edge_index = next_edge;
+        }
+        loop = removeCollinear(loop);
+        auto area = calcDoubledArea(loop);
+        if (area > largest_area)
+        {
+            largest_area = area;
+            largest = std::move(loop);
+        }
+    }
+    return largest;
+}
+
+//! \brief Douglas-Peucker simplification of a closed outline, the outline is split in two at its first point
+//! \brief and the point furthest from it, then each chain keeps only points further than \p tolerance from its chord
+Outline simplifyOutline(const Outline &outline, float tolerance)
+{
+    const auto n = outline.size();
+    if (n <= 3)
+    {
+        return outline;
+    }
+    std::size_t furthest = 1;
+    for (std::size_t i = 2; i < n; ++i)
+    {
+        if (norm2(outline[i] - outline[0]) > norm2(outline[furthest] - outline[0]))
+        {
+            furthest = i;
+        }
+    }
+
+    std::vector<bool> is_kept(n, false);
+    is_kept[0] = true;
+    is_kept[furthest] = true;
+    std::vector<std::pair<std::size_t, std::size_t>> chains = {{0, furthest}, {furthest, n}}; //! index n is the first point again
+    while (!chains.empty())
+    {
+        auto [first, last] = chains.back();
+        chains.pop_back();
+        const auto &from = outline[first];
+        const auto &to = outline[last % n];
+        float max_distance = -1.f;
+        std::size_t max_index = first;
+        for (auto i = first + 1; i < last; ++i)
+        {
+            float distance = calcDistanceToSegment(outline[i], from, to);
+            if (distance > max_distance)
+            {
+                max_distance = distance;
+                max_index = i;
+            }
+        }
+        if (max_distance > tolerance)
+        {
+            is_kept[max_index] = true;
+            chains.push_back({first, max_index});
+            chains.push_back({max_index, last});
+        }
+    }
+
+    Outline simplified;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        if (is_kept[i])
+        {
+            simplified.push_back(outline[i]);
+        }
+    }
+    return removeCollinear(simplified);
+}
+
+//! \brief triangulates \p outline by clipping ears and then merges neighbouring parts while they stay convex
+//! \brief and have at most \p max_part_vertices (Hertel-Mehlhorn), which gives at most four times the minimal number of parts
+//! \brief outlines which intersect themselves can not be triangulated, their convex hull is the only part then
+std::vector<Outline> decomposeConvex(const Outline &outline, std::size_t max_part_vertices)
+{
+    const auto n = outline.size();
+    if (n < 3)
+    {
+        return {};
+    }
+    const float orientation = calcDoubledArea(outline) < 0.f ? -1.f : 1.f;
+    if (n <= max_part_vertices && isConvex(outline, orientation))
+    {
+        return {outline};
+    }
+
+    using Part = std::vector<std::size_t>; //! indices into the outline
+    std::vector<Part> parts;
+    std::vector<std::size_t> remaining(n);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        remaining[i] = i;
+    }
+    auto isInTriangle = [&](utils::Vector2f p, utils::Vector2f a, utils::Vector2f b, utils::Vector2f c)
+    {
+        return orientation * cross(b - a, p - a) >= 0.f && orientation * cross(c - b, p - b) >= 0.f &&
+               orientation * cross(a - c, p - c) >= 0.f;
+    };
+    while (remaining.size() > 3)
+    {
+        const auto count = remaining.size();
+        bool found_ear = false;
+        for (std::size_t i = 0; i < count && !found_ear; ++i)
+        {
+            const auto &a = outline[remaining[(i + count - 1) % count]];
+            const auto &b = outline[remaining[i]];
+            const auto &c = outline[remaining[(i + 1) % count]];
+            if (orientation * cross(b - a, c - b) <= 0.f)
+            {
+                continue;
+            }
+            bool is_ear = true;
+            for (auto other : remaining)
+            {
+                const auto &p = outline[other];
+                if (!isSamePoint(p, a) && !isSamePoint(p, b) && !isSamePoint(p, c) && isInTriangle(p, a, b, c))
+                {
+                    is_ear = false;
+                    break;
+                }
+            }
+            if (is_ear)
+            {
+                parts.push_back({remaining[(i + count - 1) % count], remaining[i], remaining[(i + 1) % count]});
+                remaining.erase(remaining.begin() + i);
+                found_ear = true;
+            }
+        }
+        if (!found_ear)
+        {
+            return {makeConvexHull(outline)};
+        }
+    }
+    parts.push_back(remaining);
+
+    auto toOutline = [&](const Part &part)
+    {
+        Outline points;
+        for (auto index : part)
+        {
+            points.push_back(outline[index]);
+        }
+        return points;
+    };
+
+    //! part p contains edge (a, b) and part q the same edge as (b, a), the merged part goes from b around p to a and around q back
+    auto merge = [](const Part &p, std::size_t edge_in_p, const Part &q, std::size_t edge_in_q)
+    {
+        Part merged;
+        for (std::size_t i = 1; i <= p.size(); ++i)
+        {
+            merged.push_back(p[(edge_in_p + i) % p.size()]);
+        }
+        for (std::size_t i = 2; i < q.size(); ++i)
+        {
+            merged.push_back(q[(edge_in_q + i) % q.size()]);
+        }
+        return merged;
+    };
+    bool merged_any = true;
+    while (merged_any)
+    {
+        merged_any = false;
+        for (std::size_t p = 0; p < parts.size() && !merged_any; ++p)
+        {
+            for (std::size_t edge_in_p = 0; edge_in_p < parts[p].size() && !merged_any; ++edge_in_p)
+            {
+                auto a = parts[p][edge_in_p];
+                auto b = parts[p][(edge_in_p + 1) % parts[p].size()];
+                for (std::size_t q = 0; q < parts.size() && !merged_any; ++q)
+                {
+                    if (q == p || parts[p].size() + parts[q].size() - 2 > max_part_vertices)
+                    {
+                        continue;
+                    }
+                    for (std::size_t edge_in_q = 0; edge_in_q < parts[q].size(); ++edge_in_q)
+                    {
+                        if (parts[q][edge_in_q] != b || parts[q][(edge_in_q + 1) % parts[q].size()] != a)
+                        {
+                            continue;
+                        }
+                        auto merged = merge(parts[p], edge_in_p, parts[q], edge_in_q);
+                        if (isConvex(toOutline(merged), orientation))
+                        {
+                            parts[p] = std::move(merged);
+                            parts.erase(parts.begin() + q);
+                            merged_any = true;
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<Outline> convex_parts;
+    for (const auto &part : parts)
+    {
+        convex_parts.push_back(removeCollinear(toOutline(part)));
+    }
+    return convex_parts;
+}
+
+//! \brief traces the outline of opaque pixels and simplifies it until its convex parts have at most
+//! \brief settings.vertex_budget vertices, the tolerance starts at settings.tolerance and grows by half each attempt
+//! \brief the result depends only on the pixels and settings
+ShapeFit fitCollisionShape(const RgbaImage &image, const ShapeFitSettings &settings)
+{
+    ShapeFit fit;
+    auto traced = traceOutline(image, settings.alpha_threshold);
+    if (traced.size() < 3)
+    {
+        return fit;
+    }
+
+    const auto max_part_vertices = std::clamp<std::size_t>(settings.max_part_vertices, 3, k_max_polygon_vertices);
+    float tolerance = std::max(settings.tolerance, 0.01f);
+    for (std::size_t attempt = 0; attempt < k_max_fit_attempts; ++attempt, tolerance *= 1.5f)
+    {
+        fit.outline = simplifyOutline(traced, tolerance);
+        fit.tolerance = tolerance;
+        //! each vertex of the outline is in some part, so outlines over the budget are not decomposed
+        if (fit.outline.size() > settings.vertex_budget && fit.outline.size() > 3)
+        {
+            continue;
+        }
+        fit.parts = decomposeConvex(fit.outline, max_part_vertices);
+        fit.vertex_count = 0;
+        bool parts_fit = !fit.parts.empty();
+        for (const auto &part : fit.parts)
+        {
+            fit.vertex_count += part.size();
+            parts_fit = parts_fit && part.size() <= max_part_vertices;
+        }
+        fit.fits_budget = parts_fit && fit.vertex_count <= settings.vertex_budget;
+        if (fit.fits_budget || fit.outline.size() <= 3)
+        {
+            break;
+        }
+    }
+
+    for (auto &part : fit.parts)
+    {
+        for (auto &point : part)
+        {
+            point = {2.f * point.x / image.width - 1.f, 1.f - 2.f * point.y / image.height};
+        }
+    }
+    return fit;
+}
+
+std::vector<Polygon> makeConvexShapes(const ShapeFit &fit)
+{
+    std::vector<Polygon> shapes;
+    for (const auto &part : fit.parts)
+    {
+        Polygon shape(0);
+        shape.points = part;
+        shapes.push_back(shape);
+    }
+    return shapes;
+}
+
+//! \brief stores convex parts of \p fit under \p texture_name, shapes of other textures in the file are kept
+bool writeCollisionShape(const std::filesystem::path &path, const std::string &texture_name, const ShapeFit &fit)
+{
+    using json = nlohmann::json;
+    json shapes = json::object();
+    if (std::filesystem::exists(path))
+    {
+        std::ifstream file(path);
+        shapes = json::parse(file, nullptr, false);
+        if (shapes.is_discarded() || !shapes.is_object())
+        {
+            std::cout << "Cannot read collision shapes in: " << path.string() << std::endl;
+            return false;
+        }
+    }
+
+    json parts = json::array();
+    for (const auto &part : fit.parts)
+    {
+        json points = json::array();
+        for (const auto &point : part)
+        {
+            points.push_back({point.x, point.y});
+        }
+        parts.push_back(points);
+    }
+    shapes[texture_name] = {{"tolerance", fit.tolerance}, {"parts", parts}};
+
+    std::ofstream file(path);
+    if (!file.is_open())
+    {
+        std::cout << "Cannot write collision shapes to: " << path.string() << std::endl;
+        return false;
+    }
+    file << shapes.dump(4);
+    return true;
+}
+
+//! \returns convex shapes stored for \p texture_name, empty if there are none or the stored ones are malformed
+std::vector<Polygon> readCollisionShape(const std::filesystem::path &path, const std::string &texture_name)
+{
+    using json = nlohmann::json;
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        return {};
+    }
+    json shapes = json::parse(file, nullptr, false);
+    if (shapes.is_discarded() || !shapes.is_object() || !shapes.contains(texture_name))
+    {
+        return {};
+    }
+
+    const auto &shape_js = shapes[texture_name];
+    if (!shape_js.is_object() || !shape_js.contains("parts") || !shape_js["parts"].is_array())
+    {
+        std::cout << "Malformed collision shape of: " << texture_name << std::endl;
+        return {};
+    }
+    ShapeFit fit;
+    for (const auto &part_js : shape_js["parts"])
+    {
+        if (!part_js.is_array() || part_js.size() < 3 || part_js.size() > k_max_polygon_vertices)
+        {
+            std::cout << "Malformed collision shape of: " << texture_name << std::endl;
+            return {};
+        }
+        Outline part;
+        for (const auto &point_js : part_js)
+        {
+            if (!point_js.is_array() || point_js.size() != 2 || !point_js[0].is_number() || !point_js[1].is_number())
+            {
+                std::cout << "Malformed collision shape of: " << texture_name << std::endl;
+                return {};
+            }
+            part.push_back({point_js[0].get<float>(), point_js[1].get<float>()});
+        }
+        fit.parts.push_back(part);
+    }
+    return makeConvexShapes(fit);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Utils/Vector2.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "Polygon.h"
+#include "Utils/PngReader.h"
+
+using Outline = std::vector<utils::Vector2f>;
+
+struct ShapeFitSettings
+{
+    std::uint8_t alpha_threshold = 128; //! pixels with higher alpha are solid
+    float tolerance = 1.f;              //! largest distance in pixels of the simplified outline from the traced one
+    std::size_t vertex_budget = 16;     //! most vertices of all convex parts together
+    std::size_t max_part_vertices = 8;  //! most vertices of one convex part
+};
+
+//! \brief convex parts are in local coordinates of the sprite, which spans [-1, 1] on both axes and its top row is at y = 1
+struct ShapeFit
+{
+    std::vector<Outline> parts;
+    Outline outline;         //! simplified outline in pixels, which was decomposed
+    float tolerance = 0.f;   //! tolerance of the simplification which met the budget
+    std::size_t vertex_count = 0;
+    bool fits_budget = false;
+};
+
+Outline traceOutline(const RgbaImage &image, std::uint8_t alpha_threshold);
+Outline simplifyOutline(const Outline &outline, float tolerance);
+std::vector<Outline> decomposeConvex(const Outline &outline, std::size_t max_part_vertices);
+ShapeFit fitCollisionShape(const RgbaImage &image, const ShapeFitSettings &settings);
+std::vector<Polygon> makeConvexShapes(const ShapeFit &fit);
+
+bool writeCollisionShape(const std::filesystem::path &path, const std::string &texture_name, const ShapeFit &fit);
+std::vector<Polygon> readCollisionShape(const std::filesystem::path &path, const std::string &texture_name);
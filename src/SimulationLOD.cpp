@@ -0,0 +1,135 @@
+#include "SimulationLOD.h"
+
+SimulationLOD::SimulationLOD()
+{
+    m_affected_types.fill(false);
+    m_sleeping_types.fill(true);
+    //! things that the player, quests or timers rely on are always simulated
+    //! static colliders of the affected types are skipped by GameWorld, they stay in the static collision tree
+    setAffectsType(ObjectType::Enemy, true);
+    setAffectsType(ObjectType::Meteor, true);
+    setAffectsType(ObjectType::Wall, true);
+    setAffectsType(ObjectType::SpaceStation, true);
+    //! meteors recycle themselves around the player in their update, so they must never stop updating
+    setSleepsType(ObjectType::Meteor, false);
+}
+
+void SimulationLOD::insert(int entity_id)
+{
+    m_states.insert(entity_id, LODState{});
+    m_stats.tier_population.at(static_cast<std::size_t>(SimulationTier::Full))++;
+}
+
+void SimulationLOD::remove(int entity_id)
+{
+    m_stats.tier_population.at(static_cast<std::size_t>(getTier(entity_id)))--;
+    m_states.erase(entity_id);
+}
+
+void SimulationLOD::remove(const std::vector<int> &entity_ids)
+{
+    for (auto id : entity_ids)
+    {
+        m_stats.tier_population.at(static_cast<std::size_t>(getTier(id)))--;
+    }
+    m_states.erase(entity_ids);
+}
+
+void SimulationLOD::beginFrame()
+{
+    m_frame++;
+    m_stats.updated_count = 0;
+    m_stats.skipped_count = 0;
+}
+
+//! \brief estimates saved time assuming that skipped updates would cost the same as the performed ones
+void SimulationLOD::endFrame(float update_time_ms)
+{
+    m_stats.update_time_ms = update_time_ms;
+    if (m_stats.updated_count > 0)
+    {
+        m_stats.saved_time_ms = update_time_ms * m_stats.skipped_count / m_stats.updated_count;
+    }
+}
+
+SimulationTier SimulationLOD::calcTier(ObjectType type, float dist_from_player) const
+{
+    if (!m_settings.enabled || !affectsType(type) || dist_from_player < m_settings.full_radius)
+    {
+        return SimulationTier::Full;
+    }
+    if (dist_from_player < m_settings.dormant_radius || !sleepsType(type))
+    {
+        return SimulationTier::Reduced;
+    }
+    return SimulationTier::Dormant;
+}
+
+SimulationTier SimulationLOD::getTier(int entity_id) const
+{
+    return m_states.get(entity_id).tier;
+}
+
+void SimulationLOD::setTier(int entity_id, SimulationTier new_tier)
+{
+    auto &state = m_states.get(entity_id);
+    m_stats.tier_population.at(static_cast<std::size_t>(state.tier))--;
+    m_stats.tier_population.at(static_cast<std::size_t>(new_tier))++;
+    state.tier = new_tier;
+    if (new_tier == SimulationTier::Dormant)
+    {
+        state.accumulated_dt = 0.f; //! dormant entities do not live through the time
+    }
+}
+
+//! \brief decides whether entity \p entity_id gets updated this frame
+//! \param tick_dt  time step to use for the update, reduced tier entities get the time they missed
+//! \returns true if the entity should be updated
+bool SimulationLOD::tick(int entity_id, float dt, float &tick_dt)
+{
+    auto &state = m_states.get(entity_id);
+    state.accumulated_dt += dt;
+
+    bool updates = state.tier == SimulationTier::Full ||
+                   (state.tier == SimulationTier::Reduced && (m_frame + entity_id) % m_settings.reduced_period == 0);
+    if (!updates)
+    {
+        if (state.tier == SimulationTier::Dormant)
+        {
+            state.accumulated_dt = 0.f;
+        }
+        m_stats.skipped_count++;
+        return false;
+    }
+
+    tick_dt = state.accumulated_dt;
+    state.accumulated_dt = 0.f;
+    m_stats.updated_count++;
+    return true;
+}
+
+void SimulationLOD::setAffectsType(ObjectType type, bool affects)
+{
+    m_affected_types.at(static_cast<std::size_t>(type)) = affects;
+}
+
+bool SimulationLOD::affectsType(ObjectType type) const
+{
+    return m_affected_types.at(static_cast<std::size_t>(type));
+}
+
+//! \brief types which do not sleep stay in the reduced tier however far they are
+void SimulationLOD::setSleepsType(ObjectType type, bool sleeps)
+{
+    m_sleeping_types.at(static_cast<std::size_t>(type)) = sleeps;
+}
+
+bool SimulationLOD::sleepsType(ObjectType type) const
+{
+    return m_sleeping_types.at(static_cast<std::size_t>(type));
+}
+
+const SimulationLODStats &SimulationLOD::getStats() const
+{
+    return m_stats;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include "Utils/ContiguousColony.h"
+#include "Components.h"
+
+//! \brief how often is an entity simulated
+enum class SimulationTier
+{
+    Full,    //! updated every frame
+    Reduced, //! updated every few frames with accumulated time step
+    Dormant, //! not updated and removed from collisions and steering
+    Count
+};
+
+struct SimulationLODSettings
+{
+    float full_radius = 1000.f;    //! entities closer to the player are updated every frame
+    float dormant_radius = 4000.f; //! entities further from the player are not updated at all
+    int reduced_period = 4;        //! entities in between are updated once per this many frames
+    bool enabled = true;
+};
+
+struct SimulationLODStats
+{
+    std::array<std::size_t, static_cast<std::size_t>(SimulationTier::Count)> tier_population = {0, 0, 0};
+    std::size_t updated_count = 0;
+    std::size_t skipped_count = 0;
+    float update_time_ms = 0.f; //! time spent updating entities this frame
+    float saved_time_ms = 0.f;  //! estimate of time the skipped updates would take
+
+    std::size_t getPopulation(SimulationTier tier) const
+    {
+        return tier_population.at(static_cast<std::size_t>(tier));
+    }
+};
+
+//! \brief decides how often entities get simulated based on their distance from the player
+class SimulationLOD
+{
+
+    struct LODState
+    {
+        SimulationTier tier = SimulationTier::Full;
+        float accumulated_dt = 0.f;
+    };
+
+public:
+    SimulationLOD();
+
+    void insert(int entity_id);
+    void remove(int entity_id);
+    void remove(const std::vector<int> &entity_ids);
+
+    void beginFrame();
+    void endFrame(float update_time_ms);
+
+    SimulationTier calcTier(ObjectType type, float dist_from_player) const;
+    SimulationTier getTier(int entity_id) const;
+    void setTier(int entity_id, SimulationTier new_tier);
+
+    bool tick(int entity_id, float dt, float &tick_dt);
+
+    void setAffectsType(ObjectType type, bool affects);
+    bool affectsType(ObjectType type) const;
+    void setSleepsType(ObjectType type, bool sleeps);
+    bool sleepsType(ObjectType type) const;
+
+    const SimulationLODStats &getStats() const;
+
+public:
+    SimulationLODSettings m_settings;
+
+private:
+    ContiguousColony<LODState, int> m_states;
+    std::array<bool, static_cast<std::size_t>(ObjectType::Count)> m_affected_types;
+    std::array<bool, static_cast<std::size_t>(ObjectType::Count)> m_sleeping_types; //! can become dormant
+
+    int m_frame = 0;
+    SimulationLODStats m_stats;
+};
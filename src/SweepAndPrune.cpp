@@ -0,0 +1,158 @@
+#include "SweepAndPrune.h"
+
+#include <algorithm>
+
+void SweepAndPrune::addRect(AABB rect, int object_index)
+{
+    if (object_index >= static_cast<int>(object2entry_indices.size()))
+    {
+        object2entry_indices.resize(object_index + 1, -1);
+    }
+    assert(object2entry_indices[object_index] == -1);
+
+    object2entry_indices[object_index] = entries.size();
+    entries.push_back({rect, object_index});
+    object_count++;
+    unsorted_count++;
+    is_sorted = false;
+}
+
+void SweepAndPrune::addRects(const std::vector<AABB> &rects, const std::vector<int> &object_indices)
+{
+    assert(rects.size() == object_indices.size());
+    entries.reserve(entries.size() + rects.size());
+    for (std::size_t i = 0; i < rects.size(); ++i)
+    {
+        addRect(rects[i], object_indices[i]);
+    }
+}
+
+void SweepAndPrune::removeObject(int object_index)
+{
+    assert(containsObject(object_index));
+    auto entry_index = object2entry_indices[object_index];
+    object2entry_indices[object_index] = -1;
+    entries.erase(entries.begin() + entry_index);
+    object_count--;
+    unsorted_count = std::min(unsorted_count, entries.size());
+    reindex(entry_index);
+}
+
+//! \brief removes all objects in one pass over the entries, the order of the remaining ones is kept
+void SweepAndPrune::removeObjects(const std::vector<int> &object_indices)
+{
+    for (auto object_index : object_indices)
+    {
+        assert(containsObject(object_index));
+        entries[object2entry_indices[object_index]].object_index = -1;
+        object2entry_indices[object_index] = -1;
+    }
+    auto new_end = std::remove_if(entries.begin(), entries.end(), [](const Entry &entry)
+                                  { return entry.object_index == -1; });
+    entries.erase(new_end, entries.end());
+    object_count = entries.size();
+    unsorted_count = std::min(unsorted_count, entries.size());
+    reindex(0);
+}
+
+//! \brief the order is not fixed here, sort() has to be called before the next query
+void SweepAndPrune::moveObject(int object_index, AABB new_rect)
+{
+    assert(containsObject(object_index));
+    entries[object2entry_indices[object_index]].rect = new_rect;
+    is_sorted = false;
+}
+
+//! \brief restores the order of entries
+//! \brief uses insertion sort which is fast for small changes from the last frame,
+//! \brief many newly added entries are sorted from scratch instead
+void SweepAndPrune::sort()
+{
+    last_swap_count = 0;
+    if (is_sorted)
+    {
+        return;
+    }
+
+    if (unsorted_count > entries.size() / 8 + 1)
+    {
+        std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b)
+                  { return a.rect.r_min.x < b.rect.r_min.x; });
+        reindex(0);
+    }
+    else
+    {
+        for (std::size_t i = 1; i < entries.size(); ++i)
+        {
+            if (entries[i - 1].rect.r_min.x <= entries[i].rect.r_min.x)
+            {
+                continue;
+            }
+            auto moved_entry = entries[i];
+            auto j = i;
+            while (j > 0 && entries[j - 1].rect.r_min.x > moved_entry.rect.r_min.x)
+            {
+                entries[j] = entries[j - 1];
+                object2entry_indices[entries[j].object_index] = j;
+                j--;
+                last_swap_count++;
+            }
+            entries[j] = moved_entry;
+            object2entry_indices[moved_entry.object_index] = j;
+        }
+    }
+    unsorted_count = 0;
+    is_sorted = true;
+}
+
+void SweepAndPrune::clear()
+{
+    entries.clear();
+    object2entry_indices.clear();
+    object_count = 0;
+    unsorted_count = 0;
+    is_sorted = true;
+}
+
+bool SweepAndPrune::containsObject(int object_index) const
+{
+    return object_index >= 0 && object_index < static_cast<int>(object2entry_indices.size()) &&
+           object2entry_indices[object_index] != -1;
+}
+
+const AABB &SweepAndPrune::getObjectRect(int object_index) const
+{
+    assert(containsObject(object_index));
+    return entries[object2entry_indices[object_index]].rect;
+}
+
+std::size_t SweepAndPrune::getObjectCount() const
+{
+    return object_count;
+}
+
+//! \returns number of entry swaps done by the last sort(), measure of how much the order changed
+std::size_t SweepAndPrune::getLastSwapCount() const
+{
+    return last_swap_count;
+}
+
+void SweepAndPrune::findClosePairsWithin(std::vector<std::pair<int, int>> &close_pairs) const
+{
+    forEachClosePairWithin([&close_pairs](int object_index_1, int object_index_2)
+                           { close_pairs.push_back({object_index_1, object_index_2}); });
+}
+
+void SweepAndPrune::findClosePairsWith2(const SweepAndPrune &other, std::vector<std::pair<int, int>> &close_pairs) const
+{
+    forEachClosePairWith(other, [&close_pairs](int object_index, int other_object_index)
+                         { close_pairs.push_back({object_index, other_object_index}); });
+}
+
+void SweepAndPrune::reindex(std::size_t first_entry)
+{
+    for (std::size_t i = first_entry; i < entries.size(); ++i)
+    {
+        object2entry_indices[entries[i].object_index] = i;
+    }
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <vector>
+#include <cassert>
+#include <cstddef>
+
+#include "core.h"
+
+//! \brief broadphase which keeps rects sorted along the x axis and finds overlapping ones by sweeping
+//! \brief the order is kept between frames and restored by insertion sort, which is almost linear
+//! \brief when objects move a little each frame
+class SweepAndPrune
+{
+
+    struct Entry
+    {
+        AABB rect;
+        int object_index;
+    };
+
+    std::vector<Entry> entries;            //! sorted by r_min.x after sort()
+    std::vector<int> object2entry_indices; //! mapping from objects to entries, -1 for objects not in the sweep
+    std::size_t object_count = 0;
+    std::size_t unsorted_count = 0; //! entries appended since the last sort()
+    bool is_sorted = true;
+    std::size_t last_swap_count = 0;
+
+public:
+    void addRect(AABB rect, int object_index);
+    void addRects(const std::vector<AABB> &rects, const std::vector<int> &object_indices);
+
+    void removeObject(int object_index);
+    void removeObjects(const std::vector<int> &object_indices);
+    void moveObject(int object_index, AABB new_rect);
+
+    void sort();
+    void clear();
+
+    bool containsObject(int object_index) const;
+    const AABB &getObjectRect(int object_index) const;
+    std::size_t getObjectCount() const;
+    std::size_t getLastSwapCount() const;
+
+    //! same interface as BoundingVolumeTree, pairs are appended to caller owned buffers
+    void findClosePairsWithin(std::vector<std::pair<int, int>> &close_pairs) const;
+    void findClosePairsWith2(const SweepAndPrune &other, std::vector<std::pair<int, int>> &close_pairs) const;
+
+    template <class VisitorT>
+    void forEachClosePairWithin(VisitorT &&visitor) const;
+    template <class VisitorT>
+    void forEachClosePairWith(const SweepAndPrune &other, VisitorT &&visitor) const;
+
+private:
+    void reindex(std::size_t first_entry);
+};
+
+//! \brief calls \p visitor(object_index_1, object_index_2) once for each pair of overlapping rects
+template <class VisitorT>
+void SweepAndPrune::forEachClosePairWithin(VisitorT &&visitor) const
+{
+    assert(is_sorted);
+    const auto entry_count = entries.size();
+    for (std::size_t i = 0; i < entry_count; ++i)
+    {
+        const auto &entry_i = entries[i];
+        for (std::size_t j = i + 1; j < entry_count && entries[j].rect.r_min.x <= entry_i.rect.r_max.x; ++j)
+        {
+            const auto &rect_j = entries[j].rect;
+            if (entry_i.rect.r_min.y <= rect_j.r_max.y && entry_i.rect.r_max.y >= rect_j.r_min.y)
+            {
+                visitor(entry_i.object_index, entries[j].object_index);
+            }
+        }
+    }
+}
+
+//! \brief calls \p visitor(object_index, other_object_index) for each pair of overlapping rects
+//! \brief where the first one is from this sweep and the second one from \p other
+template <class VisitorT>
+void SweepAndPrune::forEachClosePairWith(const SweepAndPrune &other, VisitorT &&visitor) const
+{
+    assert(is_sorted && other.is_sorted);
+    const auto &entries_a = entries;
+    const auto &entries_b = other.entries;
+    std::size_t i = 0;
+    std::size_t j = 0;
+    //! the entry starting first is swept against those of the other sweep starting before it ends
+    while (i < entries_a.size() && j < entries_b.size())
+    {
+        if (entries_a[i].rect.r_min.x <= entries_b[j].rect.r_min.x)
+        {
+            const auto &rect_a = entries_a[i].rect;
+            for (std::size_t k = j; k < entries_b.size() && entries_b[k].rect.r_min.x <= rect_a.r_max.x; ++k)
+            {
+                const auto &rect_b = entries_b[k].rect;
+                if (rect_a.r_min.y <= rect_b.r_max.y && rect_a.r_max.y >= rect_b.r_min.y)
+                {
+                    visitor(entries_a[i].object_index, entries_b[k].object_index);
+                }
+            }
+            ++i;
+        }
+        else
+        {
+            const auto &rect_b = entries_b[j].rect;
+            for (std::size_t k = i; k < entries_a.size() && entries_a[k].rect.r_min.x <= rect_b.r_max.x; ++k)
+            {
+                const auto &rect_a = entries_a[k].rect;
+                if (rect_a.r_min.y <= rect_b.r_max.y && rect_a.r_max.y >= rect_b.r_min.y)
+                {
+                    visitor(entries_a[k].object_index, entries_b[j].object_index);
+                }
+            }
+            ++j;
+        }
+    }
+}
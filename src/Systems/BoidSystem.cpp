@@ -1,15 +1,20 @@
 #include "BoidSystem.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 
-BoidSystem::BoidSystem(ContiguousColony<BoidComponent, int>& boids)
-: m_components(boids), m_neighbour_searcher(50.)
+BoidSystem::BoidSystem(ContiguousColony<BoidComponent, int>& boids, utils::ThreadPool &workers)
+: m_components(boids), m_neighbour_searcher(50.), m_workers(workers)
 {
-
+    m_neighbour_batches.resize(m_workers.getThreadCount());
 }
 
  void BoidSystem::preUpdate(float dt, EntityRegistryT& entities) 
 {
     auto comp_count = m_components.data.size();
+    m_positions.resize(comp_count);
+    m_velocities.resize(comp_count);
     for (std::size_t comp_id = 0; comp_id < comp_count; ++comp_id)
     {
         auto &comp = m_components.data[comp_id];
@@ -17,8 +22,22 @@ BoidSystem::BoidSystem(ContiguousColony<BoidComponent, int>& boids)
         comp.pos = entities.at(m_components.data_ind2id.at(comp_id))->getPosition();
         comp.vel = entities.at(m_components.data_ind2id.at(comp_id))->m_vel;
 
-        m_neighbour_searcher.insertAt(comp.pos, comp.pos, comp_id);
+        m_positions[comp_id] = comp.pos;
+        m_velocities[comp_id] = comp.vel;
     }
+
+    //! ids in the grid are indices of components, cells are as big as the longest force range
+    auto tic = std::chrono::high_resolution_clock::now();
+    const float max_range = std::max({m_settings.scatter_range, m_settings.align_range, m_settings.cohesion_range});
+    m_neighbour_searcher.rebuild(m_positions, max_range);
+    const auto &sorted_ids = m_neighbour_searcher.getSortedIds();
+    m_sorted_velocities.resize(comp_count);
+    for (std::size_t sorted_ind = 0; sorted_ind < comp_count; ++sorted_ind)
+    {
+        m_sorted_velocities[sorted_ind] = m_velocities[sorted_ids[sorted_ind]];
+    }
+    auto toc = std::chrono::high_resolution_clock::now();
+    m_stats.rebuild_time_ms = std::chrono::duration_cast<std::chrono::microseconds>(toc - tic).count() / 1000.f;
 }
 
 void BoidSystem::postUpdate(float dt, EntityRegistryT& entities) 
@@ -30,91 +49,179 @@ void BoidSystem::postUpdate(float dt, EntityRegistryT& entities)
         entities.at(m_components.data_ind2id.at(comp_id))->m_acc += comp.acc;
         comp.acc *= 0.;
     }
-    m_neighbour_searcher.clear();
 }   
+
+//! \brief boids are steered in parallel batches, each boid only writes its own acceleration
+//! \brief batches follow the order of grid cells, so that neighbouring boids are steered by the same thread
  void BoidSystem::update(float dt) 
 {
-    auto comp_count = m_components.data.size();
-    for (std::size_t comp_id = 0; comp_id < comp_count; ++comp_id)
+    auto tic = std::chrono::high_resolution_clock::now();
+
+    const auto comp_count = m_components.data.size();
+    if (m_neighbour_batches.size() != m_workers.getThreadCount())
     {
-        steer(m_components.data[comp_id], comp_id, dt);
-        // updater(m_components.data[comp_id], dt);
+        m_neighbour_batches.resize(m_workers.getThreadCount());
     }
-}
 
-void BoidSystem::steer(BoidComponent &comp, int comp_id, float dt)
-{
-    auto neighbours2 = m_neighbour_searcher.getNeighbourList(comp_id, comp.pos, comp.boid_radius);
-
-    utils::Vector2f repulsion_force(0, 0);
-    utils::Vector2f push_force(0, 0);
-    utils::Vector2f scatter_force(0, 0);
-    utils::Vector2f cohesion_force(0, 0);
-    utils::Vector2f seek_force(0, 0);
-    float n_neighbours = 0;
-    float n_neighbours_group = 0;
-    utils::Vector2f dr_nearest_neighbours(0, 0);
-    utils::Vector2f average_neighbour_position(0, 0);
-
-    utils::Vector2f align_direction = {0, 0};
-    int align_neighbours_count = 0;
+    const auto &sorted_ids = m_neighbour_searcher.getSortedIds();
+    assert(sorted_ids.size() == comp_count);
+
+    std::atomic<std::size_t> neighbour_count = 0;
+    const auto batch_count = (comp_count + k_steer_batch_size - 1) / k_steer_batch_size;
+    m_workers.parallelFor(batch_count, [&](std::size_t batch_index, std::size_t thread_index)
+                          {
+        auto &neighbours = m_neighbour_batches.at(thread_index);
+        std::size_t batch_neighbour_count = 0;
+        auto batch_end = std::min(comp_count, (batch_index + 1) * k_steer_batch_size);
+        for (std::size_t sorted_ind = batch_index * k_steer_batch_size; sorted_ind < batch_end; ++sorted_ind)
+        {
+            auto comp_id = sorted_ids[sorted_ind];
+            steer(m_components.data[comp_id], comp_id, neighbours);
+            batch_neighbour_count += std::count(neighbours.is_neighbour.begin(),
+                                                neighbours.is_neighbour.begin() + neighbours.count, 1.f);
+        }
+        neighbour_count += batch_neighbour_count; });
 
-    const float scatter_multiplier = 500;//Enemy::m_force_multipliers[Multiplier::SCATTER];
-    const float align_multiplier = 10.;//Enemy::m_force_multipliers[Multiplier::ALIGN];
-    const float seek_multiplier = 1.;//Enemy::m_force_multipliers[Multiplier::SEEK];
+    auto toc = std::chrono::high_resolution_clock::now();
+    m_stats.boid_count = comp_count;
+    m_stats.neighbour_count = neighbour_count;
+    m_stats.steer_time_ms = std::chrono::duration_cast<std::chrono::microseconds>(toc - tic).count() / 1000.f;
+}
 
-    auto range_align = 100.;//std::pow(Enemy::m_force_ranges[Multiplier::ALIGN], 2);
-    auto range_scatter = 100.;//std::pow(Enemy::m_force_ranges[Multiplier::SCATTER], 2);
+const BoidStats &BoidSystem::getStats() const
+{
+    return m_stats;
+}
 
-    for (auto [neighbour_pos, id] : neighbours2)
+//! \brief copies all points in grid cells touched by the \p radius around the boid into \p neighbours
+//! \brief candidates further than \p radius and the boid itself are only masked out, so the copy does not branch
+void BoidSystem::gatherNeighbours(const BoidComponent &comp, int comp_id, float radius, NeighbourBatch &neighbours) const
+{
+    const auto &sorted_pos = m_neighbour_searcher.getSortedPositions();
+    const auto &sorted_ids = m_neighbour_searcher.getSortedIds();
+    const float radius_sq = radius * radius;
+
+    neighbours.count = 0;
+    m_neighbour_searcher.forEachCellRange(comp.pos, radius, [&](int range_begin, int range_end)
+                                          {
+        neighbours.reserve(neighbours.count + (range_end - range_begin));
+        for (int sorted_ind = range_begin; sorted_ind < range_end; ++sorted_ind)
+        {
+            const auto slot = neighbours.count++;
+            const float dx = sorted_pos[sorted_ind].x - comp.pos.x;
+            const float dy = sorted_pos[sorted_ind].y - comp.pos.y;
+            neighbours.dx[slot] = dx;
+            neighbours.dy[slot] = dy;
+            neighbours.vel_x[slot] = m_sorted_velocities[sorted_ind].x;
+            neighbours.vel_y[slot] = m_sorted_velocities[sorted_ind].y;
+            neighbours.is_neighbour[slot] = (sorted_ids[sorted_ind] != comp_id && dx * dx + dy * dy < radius_sq) ? 1.f : 0.f;
+        } });
+
+    //! pad to whole lanes with masked out entries
+    const auto padded_count = (neighbours.count + k_lane_count - 1) / k_lane_count * k_lane_count;
+    neighbours.reserve(padded_count);
+    for (auto slot = neighbours.count; slot < padded_count; ++slot)
     {
-        const auto dr = neighbour_pos - comp.pos;
-        const auto dist2 = utils::norm2(dr);
+        neighbours.dx[slot] = 0.f;
+        neighbours.dy[slot] = 0.f;
+        neighbours.vel_x[slot] = 0.f;
+        neighbours.vel_y[slot] = 0.f;
+        neighbours.is_neighbour[slot] = 0.f;
+    }
+    neighbours.count = padded_count;
+}
 
-        if (dist2 < range_align)
+void BoidSystem::steer(BoidComponent &comp, int comp_id, NeighbourBatch &neighbours)
+{
+    const auto &settings = m_settings;
+    const float query_radius = std::min(comp.boid_radius, std::max({settings.scatter_range, settings.align_range,
+                                                                    settings.cohesion_range}));
+
+    gatherNeighbours(comp, comp_id, query_radius, neighbours);
+
+    const float scatter_range_sq = settings.scatter_range * settings.scatter_range;
+    const float align_range_sq = settings.align_range * settings.align_range;
+    const float cohesion_range_sq = settings.cohesion_range * settings.cohesion_range;
+
+    //! branch free sums over neighbours, ranges act as 0/1 weights
+    //! each lane has its own sums, so that the compiler can vectorize the loop without reordering float additions
+    const float *dx = neighbours.dx.data();
+    const float *dy = neighbours.dy.data();
+    const float *vel_x = neighbours.vel_x.data();
+    const float *vel_y = neighbours.vel_y.data();
+    const float *is_neighbour = neighbours.is_neighbour.data();
+    const std::size_t candidate_count = neighbours.count;
+    assert(candidate_count % k_lane_count == 0);
+
+    LaneSums sums;
+    for (std::size_t first = 0; first < candidate_count; first += k_lane_count)
+    {
+        for (std::size_t lane = 0; lane < k_lane_count; ++lane)
         {
-            align_direction += comp.vel;
-            align_neighbours_count++;
+            const auto i = first + lane;
+            const float dist2 = dx[i] * dx[i] + dy[i] * dy[i];
+            const float inv_dist2 = 1.f / (dist2 + 0.1f);
+
+            const float in_scatter = dist2 < scatter_range_sq ? is_neighbour[i] : 0.f;
+            const float in_align = dist2 < align_range_sq ? is_neighbour[i] : 0.f;
+            const float in_cohesion = dist2 < cohesion_range_sq ? is_neighbour[i] : 0.f;
+
+            sums.scatter_x[lane] += in_scatter * dx[i] * inv_dist2;
+            sums.scatter_y[lane] += in_scatter * dy[i] * inv_dist2;
+            sums.scatter_count[lane] += in_scatter;
+            sums.align_x[lane] += in_align * vel_x[i];
+            sums.align_y[lane] += in_align * vel_y[i];
+            sums.align_count[lane] += in_align;
+            sums.cohesion_x[lane] += in_cohesion * dx[i];
+            sums.cohesion_y[lane] += in_cohesion * dy[i];
+            sums.cohesion_count[lane] += in_cohesion;
         }
+    }
 
-        if (dist2 < range_scatter )
-        {
-            scatter_force -= scatter_multiplier * dr / (dist2+0.1);
-            dr_nearest_neighbours += dr / (dist2+0.1);
-            n_neighbours++;
-        }
-        if (dist2 < range_scatter * 2.f)
+    auto sum_lanes = [](const LaneSums::LanesT &lanes)
+    {
+        float sum = 0.f;
+        for (auto value : lanes)
         {
-            average_neighbour_position += dr;
-            n_neighbours_group++;
+            sum += value;
         }
-    }
-
-    dr_nearest_neighbours /= n_neighbours;
-
-    if (n_neighbours > 0 && norm2(dr_nearest_neighbours) >= 0.00001f)
+        return sum;
+    };
+    const float scatter_x = sum_lanes(sums.scatter_x);
+    const float scatter_y = sum_lanes(sums.scatter_y);
+    const float scatter_count = sum_lanes(sums.scatter_count);
+    const float align_x = sum_lanes(sums.align_x);
+    const float align_y = sum_lanes(sums.align_y);
+    const float align_count = sum_lanes(sums.align_count);
+    const float cohesion_x = sum_lanes(sums.cohesion_x);
+    const float cohesion_y = sum_lanes(sums.cohesion_y);
+    const float cohesion_count = sum_lanes(sums.cohesion_count);
+
+    utils::Vector2f scatter_force = -settings.scatter_multiplier * utils::Vector2f{scatter_x, scatter_y};
+    if (scatter_count > 0 && norm2(utils::Vector2f{scatter_x, scatter_y} / scatter_count) >= 0.00001f)
     {
-        scatter_force += -scatter_multiplier * dr_nearest_neighbours / norm(dr_nearest_neighbours) - comp.vel;
+        scatter_force += -settings.scatter_multiplier * utils::Vector2f{scatter_x, scatter_y} / norm(utils::Vector2f{scatter_x, scatter_y}) - comp.vel;
     }
 
-    average_neighbour_position /= n_neighbours_group;
-    if (n_neighbours_group > 0)
+    utils::Vector2f align_force = {0, 0};
+    utils::Vector2f align_direction = {align_x, align_y};
+    if (align_count > 0 && norm2(align_direction) >= 0.001f)
     {
-        // cohesion_force =   * average_neighbour_position - comp.vel;
+        align_force = settings.align_multiplier * align_direction / norm(align_direction) - comp.vel;
     }
 
-    auto dr_to_target = comp.target_pos - comp.pos;
-    if (norm(dr_to_target) > 3.f)
+    utils::Vector2f cohesion_force = {0, 0};
+    if (cohesion_count > 0)
     {
-        seek_force = seek_multiplier * max_vel * dr_to_target / norm(dr_to_target) - comp.vel;
+        cohesion_force = settings.cohesion_multiplier * utils::Vector2f{cohesion_x, cohesion_y} / cohesion_count;
     }
 
-    utils::Vector2f align_force = {0, 0};
-    if (align_neighbours_count > 0 && norm2(align_direction) >= 0.001f)
+    utils::Vector2f seek_force = {0, 0};
+    auto dr_to_target = comp.target_pos - comp.pos;
+    if (norm(dr_to_target) > settings.arrive_distance)
     {
-        align_force = align_multiplier * align_direction / norm(align_direction) - comp.vel;
+        seek_force = settings.seek_multiplier * settings.max_vel * dr_to_target / norm(dr_to_target) - comp.vel;
     }
 
     comp.acc = (scatter_force + align_force + seek_force + cohesion_force);
-    // truncate(comp.acc, max_acc);
 }
@@ -4,25 +4,102 @@
 
 #include "../Components.h"
 #include "../GridNeighbourSearcher.h"
+#include "../Utils/ThreadPool.h"
 
+#include <array>
 
+//! \brief weights and ranges of steering forces, can be changed while the game runs
+struct BoidSteeringSettings
+{
+    float max_vel = 50.f;
+    float scatter_multiplier = 500.f;
+    float align_multiplier = 10.f;
+    float cohesion_multiplier = 0.f;
+    float seek_multiplier = 1.f;
+
+    float scatter_range = 10.f;   //! boids closer than this push each other away
+    float align_range = 10.f;     //! boids closer than this align their velocities
+    float cohesion_range = 14.1f; //! boids closer than this are pulled towards their average position
+    float arrive_distance = 3.f;  //! boids closer to target stop seeking it
+};
+
+struct BoidStats
+{
+    std::size_t boid_count = 0;
+    std::size_t neighbour_count = 0; //! sum of neighbour counts of all boids
+    float rebuild_time_ms = 0.f;     //! time spent building the neighbour grid
+    float steer_time_ms = 0.f;       //! time spent computing steering forces
+};
 
 class BoidSystem : public SystemI
 {
+    static constexpr std::size_t k_lane_count = 8; //! neighbours summed at once, 8 floats fill an AVX register
+
+    //! \brief candidates from grid cells around one boid gathered into arrays, so that forces are summed in vectorizable loops
+    //! \brief the arrays only grow, \p count says how many entries are valid and is a multiple of the lane count
+    struct NeighbourBatch
+    {
+        std::vector<float> dx;
+        std::vector<float> dy;
+        std::vector<float> vel_x;
+        std::vector<float> vel_y;
+        std::vector<float> is_neighbour; //! 1 for candidates within range which are not the boid itself, 0 otherwise
+        std::size_t count = 0;
+
+        void reserve(std::size_t new_count)
+        {
+            if (dx.size() < new_count)
+            {
+                dx.resize(new_count);
+                dy.resize(new_count);
+                vel_x.resize(new_count);
+                vel_y.resize(new_count);
+                is_neighbour.resize(new_count);
+            }
+        }
+    };
+
+    //! \brief partial sums of steering forces, one for each lane
+    struct LaneSums
+    {
+        using LanesT = std::array<float, k_lane_count>;
+        alignas(32) LanesT scatter_x = {};
+        alignas(32) LanesT scatter_y = {};
+        alignas(32) LanesT scatter_count = {};
+        alignas(32) LanesT align_x = {};
+        alignas(32) LanesT align_y = {};
+        alignas(32) LanesT align_count = {};
+        alignas(32) LanesT cohesion_x = {};
+        alignas(32) LanesT cohesion_y = {};
+        alignas(32) LanesT cohesion_count = {};
+    };
+
 public:
-    BoidSystem(ContiguousColony<BoidComponent, int> &boids);
+    BoidSystem(ContiguousColony<BoidComponent, int> &boids, utils::ThreadPool &workers);
 
     virtual void preUpdate(float dt, EntityRegistryT &entities) override;
     virtual void postUpdate(float dt, EntityRegistryT &entities) override;
     virtual void update(float dt) override;
 
+    const BoidStats &getStats() const;
+
 private:
-    void steer(BoidComponent &comp, int comp_id, float dt);
+    void gatherNeighbours(const BoidComponent &comp, int comp_id, float radius, NeighbourBatch &neighbours) const;
+    void steer(BoidComponent &comp, int comp_id, NeighbourBatch &neighbours);
+
+public:
+    BoidSteeringSettings m_settings;
 
 private:
-    float max_vel = 50.f;
-    float max_acc = 5.f;
+    static constexpr std::size_t k_steer_batch_size = 256;
 
     ContiguousColony<BoidComponent, int> &m_components;
-    SparseGridNeighbourSearcher<utils::Vector2f> m_neighbour_searcher;
+    SortedGridNeighbourSearcher m_neighbour_searcher;
+    std::vector<utils::Vector2f> m_positions;  //! positions of components from which the grid is rebuilt
+    std::vector<utils::Vector2f> m_velocities; //! velocities of components, indexed like positions
+    std::vector<utils::Vector2f> m_sorted_velocities; //! velocities in the order of sorted points of the grid
+
+    utils::ThreadPool &m_workers; //! shared with other systems, owned by the GameWorld
+    std::vector<NeighbourBatch> m_neighbour_batches; //! one for each thread, reused between frames
+    BoidStats m_stats;
 };
@@ -34,12 +34,32 @@ void AvoidanceSystem::postUpdate(float dt, EntityRegistryT &entities)
         comp.acc *= 0;
     }
 }
+
+//! \brief all detectors query the meteor tree in one batch, then each component steers away from its meteors
 void AvoidanceSystem::update(float dt)
 {
     auto comp_count = m_components.data.size();
+    m_detectors.resize(comp_count, meteor_detector);
     for (std::size_t comp_id = 0; comp_id < comp_count; ++comp_id)
     {
-        avoidMeteors2(m_components.data[comp_id], dt);
+        auto &comp = m_components.data[comp_id];
+        auto &detector = m_detectors[comp_id];
+        detector.setPosition(comp.pos);
+        detector.setRotation(utils::dir2angle(comp.target_pos - comp.pos));
+        detector.setScale(comp.radius, comp.radius / 4.);
+    }
+
+    m_collision_system.findIntersectionsBatch(ObjectType::Meteor, m_detectors, m_detected_meteors);
+
+    auto detected_it = m_detected_meteors.begin();
+    for (std::size_t comp_id = 0; comp_id < comp_count; ++comp_id)
+    {
+        auto first_detected = detected_it;
+        while (detected_it != m_detected_meteors.end() && detected_it->first == static_cast<int>(comp_id))
+        {
+            ++detected_it;
+        }
+        avoidMeteors2(m_components.data[comp_id], {first_detected, detected_it});
     }
 }
 // void AvoidanceSystem::draw(float dt)
@@ -56,13 +76,14 @@ void AvoidanceSystem::avoidMeteors(AvoidMeteorsComponent &comp, float dt)
 
     const auto &r = comp.pos;
 
-    auto nearest_meteors = m_collision_system.findNearestObjects(ObjectType::Meteor, r, comp.radius);
+    m_nearest_meteors.clear();
+    m_collision_system.findNearestObjects(ObjectType::Meteor, r, comp.radius, m_nearest_meteors);
 
     utils::Vector2f avoid_force = {0, 0};
 
     float avoidance_multiplier = 50000.f;
 
-    for (auto meteor_comp : nearest_meteors)
+    for (auto meteor_comp : m_nearest_meteors)
     {
         auto &meteor_shape = meteor_comp->shape.convex_shapes[0];
 
@@ -91,22 +112,17 @@ void AvoidanceSystem::avoidMeteors(AvoidMeteorsComponent &comp, float dt)
     comp.acc += avoidance_multiplier * avoid_force;
 }
 
-void AvoidanceSystem::avoidMeteors2(AvoidMeteorsComponent &comp, float dt)
+//! \param detected_meteors  meteors intersecting the detector of the \p comp
+void AvoidanceSystem::avoidMeteors2(AvoidMeteorsComponent &comp, std::span<const DetectedMeteor> detected_meteors)
 {
 
     const auto &r = comp.pos;
 
-    meteor_detector.setPosition(comp.pos);
-    meteor_detector.setRotation(utils::dir2angle(comp.target_pos - comp.pos));
-    meteor_detector.setScale(comp.radius, comp.radius / 4.);
-
-    auto nearest_meteors = m_collision_system.findIntersections(ObjectType::Meteor, meteor_detector);
-
     utils::Vector2f avoid_force = {0, 0};
 
     float avoidance_multiplier = 100000.f;
 
-    for (auto meteor_comp : nearest_meteors)
+    for (auto [detector_ind, meteor_comp] : detected_meteors)
     {
         auto &meteor_shape = meteor_comp->shape.convex_shapes[0];
 
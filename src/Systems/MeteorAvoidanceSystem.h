@@ -7,6 +7,8 @@
 #include "../Components.h"
 #include "../BVH.h"
 
+#include <span>
+
 
 namespace Collisions
 {
@@ -15,6 +17,8 @@ namespace Collisions
 
 class AvoidanceSystem : public SystemI
 {
+    using DetectedMeteor = std::pair<int, CollisionComponent *>;
+
 public:
     AvoidanceSystem(ContiguousColony<AvoidMeteorsComponent, int> &comps,
                     GameSystems& systems,
@@ -26,7 +30,7 @@ public:
 
 private:
     void avoidMeteors(AvoidMeteorsComponent& comp, float dt);
-    void avoidMeteors2(AvoidMeteorsComponent& comp, float dt);
+    void avoidMeteors2(AvoidMeteorsComponent& comp, std::span<const DetectedMeteor> detected_meteors);
 
 private:
 
@@ -36,6 +40,11 @@ private:
     GameSystems& m_systems;
 
     Polygon meteor_detector;
+
+    //! buffers reused between frames
+    std::vector<Polygon> m_detectors;
+    std::vector<DetectedMeteor> m_detected_meteors;
+    std::vector<CollisionComponent *> m_nearest_meteors;
 };
 
 
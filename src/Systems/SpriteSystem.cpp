@@ -5,22 +5,27 @@
 #include "DrawLayer.h"
 #include "Particles.h"
 
-SpriteSystem::SpriteSystem(ContiguousColony<SpriteComponent, int> &sprites, LayersHolder& layers)
-: m_components(sprites), m_layers(layers)
+#include "../VisibilityIndex.h"
+
+SpriteSystem::SpriteSystem(ContiguousColony<SpriteComponent, int> &sprites, LayersHolder& layers, VisibilityIndex& visibility)
+: m_components(sprites), m_layers(layers), m_visibility(visibility)
 {
     
 }
 
+//! \brief only sprites of visible entities get drawn, so we sync transforms of those only
 void SpriteSystem::preUpdate(float dt, EntityRegistryT &entities)
 {
-    auto &comps = m_components.data;
-    auto &ids = m_components.data_ind2id;
-    for (std::size_t comp_id = 0; comp_id < comps.size(); ++comp_id)
+    for (auto id : m_visibility.getVisible())
     {
-        auto &comp = comps[comp_id];
-        comp.sprite.setPosition(entities.at(ids[comp_id])->getPosition());
-        comp.sprite.setRotation(glm::radians(entities.at(ids[comp_id])->getAngle()));
-        comp.sprite.setScale(entities.at(ids[comp_id])->getSize()/2.f);
+        if (!m_components.contains(id))
+        {
+            continue;
+        }
+        auto &comp = m_components.get(id);
+        comp.sprite.setPosition(entities.at(id)->getPosition());
+        comp.sprite.setRotation(glm::radians(entities.at(id)->getAngle()));
+        comp.sprite.setScale(entities.at(id)->getSize()/2.f);
     }
 }
 void SpriteSystem::postUpdate(float dt, EntityRegistryT &entities)
@@ -28,47 +33,58 @@ void SpriteSystem::postUpdate(float dt, EntityRegistryT &entities)
 }
 void SpriteSystem::update(float dt)
 {
-    auto &comps = m_components.data;
-    auto &ids = m_components.data_ind2id;
-    for (std::size_t comp_id = 0; comp_id < comps.size(); ++comp_id)
+    auto &stats = m_visibility.m_sprite_stats;
+    stats.reset();
+    stats.considered = m_components.size();
+    for (auto id : m_visibility.getVisible())
     {
-        auto &comp = comps[comp_id];
+        if (!m_components.contains(id))
+        {
+            continue;
+        }
+        auto &comp = m_components.get(id);
         auto& canvas = m_layers.getCanvas(comp.layer_id);
         canvas.drawSprite(comp.sprite, comp.shader_id);
+        stats.submitted++;
     }
-
+    stats.culled = stats.considered - stats.submitted;
 }
 
 
 
-ParticleSystem::ParticleSystem(ContiguousColony<ParticleComponent, int> &comps, LayersHolder& layers)
-: m_components(comps), m_layers(layers)
+ParticleSystem::ParticleSystem(ContiguousColony<ParticleComponent, int> &comps, LayersHolder& layers, VisibilityIndex& visibility)
+: m_components(comps), m_layers(layers), m_visibility(visibility)
 {
     
 }
 
+//! \brief particles stay where they were emitted, so emitters are visible from as far as their particles get
 void ParticleSystem::preUpdate(float dt, EntityRegistryT &entities)
 {
     auto &comps = m_components.data;
     auto &ids = m_components.data_ind2id;
     for (std::size_t comp_id = 0; comp_id < comps.size(); ++comp_id)
     {
-        auto &comp = comps[comp_id];
-        // comp.sprite.setPosition(entities.at(ids[comp_id])->getPosition());
-        // comp.sprite.setRotation(glm::radians(entities.at(ids[comp_id])->getAngle()));
-        // comp.sprite.setScale(entities.at(ids[comp_id])->getSize()/2.f);
+        m_visibility.setMargin(ids[comp_id], comps[comp_id].max_travel_distance);
     }
 }
 void ParticleSystem::postUpdate(float dt, EntityRegistryT &entities)
 {
-    auto &comps = m_components.data;
-    auto &ids = m_components.data_ind2id;
-    for (std::size_t comp_id = 0; comp_id < comps.size(); ++comp_id)
+    auto &stats = m_visibility.m_particle_stats;
+    stats.reset();
+    stats.considered = m_components.size();
+    for (auto id : m_visibility.getVisible())
     {
-        auto &comp = comps[comp_id];
+        if (!m_components.contains(id))
+        {
+            continue;
+        }
+        auto &comp = m_components.get(id);
         auto& canvas = m_layers.getCanvas(comp.layer_id);
         comp.particles->draw(canvas);
+        stats.submitted++;
     }
+    stats.culled = stats.considered - stats.submitted;
 }
 void ParticleSystem::update(float dt)
 {
@@ -3,12 +3,13 @@
 #include "System.h"
 
 class LayersHolder;
+class VisibilityIndex;
 
 
 class SpriteSystem : public SystemI
 {
 public:
-    SpriteSystem(ContiguousColony<SpriteComponent, int> &boids, LayersHolder& layers);
+    SpriteSystem(ContiguousColony<SpriteComponent, int> &boids, LayersHolder& layers, VisibilityIndex& visibility);
 
     virtual void preUpdate(float dt, EntityRegistryT &entities) override;
     virtual void postUpdate(float dt, EntityRegistryT &entities) override;
@@ -19,12 +20,13 @@ private:
     //! But it's not a bottleneck right now so who cares?
     ContiguousColony<SpriteComponent, int> &m_components;
     LayersHolder& m_layers;
+    VisibilityIndex& m_visibility;
 };
 
 class ParticleSystem : public SystemI
 {
 public:
-ParticleSystem(ContiguousColony<ParticleComponent, int> &comps, LayersHolder& layers);
+ParticleSystem(ContiguousColony<ParticleComponent, int> &comps, LayersHolder& layers, VisibilityIndex& visibility);
 
     virtual void preUpdate(float dt, EntityRegistryT &entities) override;
     virtual void postUpdate(float dt, EntityRegistryT &entities) override;
@@ -35,4 +37,5 @@ private:
     //! But it's not a bottleneck right now so who cares?
     ContiguousColony<ParticleComponent, int> &m_components;
     LayersHolder& m_layers;
+    VisibilityIndex& m_visibility;
 };
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include "../Utils/ObjectPool.h"
 
 #include <queue>
+#include <unordered_map>
 
 using EntityRegistryT = DynamicObjectPool2<std::shared_ptr<GameObject>>;
 
@@ -63,11 +64,50 @@ public:
         {
             m_components.erase(entity_id);
         }
+        m_inactive.erase(entity_id);
+    }
+
+    void erase(const std::vector<int> &entity_ids)
+    {
+        m_components.erase(entity_ids);
+        if(!m_inactive.empty())
+        {
+            for(auto id : entity_ids)
+            {
+                m_inactive.erase(id);
+            }
+        }
+    }
+
+    //! \brief moves the component out of the contiguous storage so that systems do not see it
+    void deactivate(int entity_id)
+    {
+        if(has(entity_id))
+        {
+            m_inactive.insert_or_assign(entity_id, std::move(m_components.get(entity_id)));
+            m_components.erase(entity_id);
+        }
+    }
+
+    //! \brief moves previously deactivated component back to the contiguous storage
+    //! \brief a component added while the entity was deactivated is newer, so the stashed one is dropped
+    void activate(int entity_id)
+    {
+        auto it = m_inactive.find(entity_id);
+        if(it != m_inactive.end())
+        {
+            if(!has(entity_id))
+            {
+                m_components.insert(entity_id, std::move(it->second));
+            }
+            m_inactive.erase(it);
+        }
     }
 
 private:
     std::queue<std::pair<ComponentType, int>> m_to_add;
     ContiguousColony<ComponentType, int> m_components;
+    std::unordered_map<int, ComponentType> m_inactive;
 };
 
 // template <class ComponentType>
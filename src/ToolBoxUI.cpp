@@ -3,14 +3,18 @@
 #include <imgui_impl_opengl3.h>
 #include <imgui_impl_sdl2.h>
 
+#include <algorithm>
 #include <unordered_map>
 
 #include <Window.h>
 #include <Texture.h>
 
 #include "GameWorld.h"
+#include "Systems/BoidSystem.h"
+#include "Utils/RandomTools.h"
 
 #include "nlohmann/json.hpp"
+#include "../external/magic_enum/magic_enum.hpp"
 
 ToolBoxUI::ToolBoxUI(Window &window, TextureHolder &textures)
     : m_sprite_pixels(400, 300, TextureOptions{.internal_format = TextureFormat::RGBA, .data_type = TextureDataTypes::UByte}),
@@ -237,6 +241,75 @@ void drawRectBorder(Rectf rect, Renderer &canvas)
         canvas.drawLineBatched(p4, p1, 1., {0, 1, 0.1, 1});
 }
 
+//! \returns size of the selected texture in the canvas, the longer side fills the canvas
+utils::Vector2f ToolBoxUI::getDrawnImageSize()
+{
+        utils::Vector2f tex_size = m_textures.get(m_selected_texture_name)->getSize();
+        float aspect_ratio = tex_size.y / tex_size.x;
+
+        utils::Vector2f image_size = {m_image_size.x, m_image_size.y * aspect_ratio};
+        if (aspect_ratio > 1.)
+        {
+                image_size = {m_image_size.y / aspect_ratio, m_image_size.y};
+        }
+        else
+        {
+                image_size = {m_image_size.y, m_image_size.y * aspect_ratio};
+        }
+        return image_size;
+}
+
+//! \brief fits convex parts to the alpha of the selected texture, which is read from its file, and saves them
+void ToolBoxUI::drawShapeFitter()
+{
+        if (!ImGui::CollapsingHeader("Shape from alpha"))
+        {
+                return;
+        }
+        auto &settings = m_shape_fit_settings;
+        int alpha_threshold = settings.alpha_threshold;
+        if (ImGui::SliderInt("Alpha threshold", &alpha_threshold, 0, 254))
+        {
+                settings.alpha_threshold = static_cast<std::uint8_t>(alpha_threshold);
+        }
+        ImGui::SliderFloat("Tolerance", &settings.tolerance, 0.1f, 20.f);
+        int vertex_budget = static_cast<int>(settings.vertex_budget);
+        if (ImGui::SliderInt("Vertex budget", &vertex_budget, 3, 64))
+        {
+                settings.vertex_budget = vertex_budget;
+        }
+        int max_part_vertices = static_cast<int>(settings.max_part_vertices);
+        if (ImGui::SliderInt("Vertices per part", &max_part_vertices, 3, static_cast<int>(k_max_polygon_vertices)))
+        {
+                settings.max_part_vertices = max_part_vertices;
+        }
+
+        if (ImGui::Button("Trace alpha"))
+        {
+                RgbaImage image;
+                if (readPng(m_texture_paths.at(m_selected_tex_id), image))
+                {
+                        m_shape_fit = fitCollisionShape(image, settings);
+                        m_shape_fit_status = m_shape_fit.fits_budget ? "" : "Could not fit the budget!";
+                }
+                else
+                {
+                        m_shape_fit = {};
+                        m_shape_fit_status = "Cannot read the texture, only 8 bit images without interlacing are supported!";
+                }
+                redrawImage();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Save shape") && !m_shape_fit.parts.empty())
+        {
+                bool saved = writeCollisionShape(m_collision_shapes_path, m_selected_texture_name, m_shape_fit);
+                m_shape_fit_status = saved ? "Saved to " + m_collision_shapes_path.string() : "Saving failed!";
+        }
+        ImGui::Text("Parts: %zu, Vertices: %zu, Tolerance: %.2f px", m_shape_fit.parts.size(), m_shape_fit.vertex_count,
+                    m_shape_fit.tolerance);
+        ImGui::Text("%s", m_shape_fit_status.c_str());
+}
+
 void ToolBoxUI::redrawImage()
 {
         if (m_selected_texture_name.empty())
@@ -266,18 +339,19 @@ void ToolBoxUI::redrawImage()
 
         //! draw sprite into canvas;
         Sprite sprite(*m_textures.get(m_selected_texture_name));
-        utils::Vector2f tex_size = m_textures.get(m_selected_texture_name)->getSize();
-        float aspect_ratio = tex_size.y / tex_size.x;
-        float element_aspect_ratio = m_image_size.y / m_image_size.x;
+        auto image_size = getDrawnImageSize();
 
-        utils::Vector2f image_size = {m_image_size.x, m_image_size.y * aspect_ratio};
-        if (aspect_ratio > 1.)
-        {
-                image_size = {m_image_size.y / aspect_ratio, m_image_size.y};
-        }
-        else
+        //! parts of the fitted shape are in local coordinates of the sprite, whose top is at y = 1
+        for (auto &part : m_shape_fit.parts)
         {
-                image_size = {m_image_size.y, m_image_size.y * aspect_ratio};
+                for (std::size_t id = 0; id < part.size(); ++id)
+                {
+                        auto point = part.at(id);
+                        auto next_point = part.at((id + 1) % part.size());
+                        utils::Vector2f from = {(point.x + 1.f) / 2.f * image_size.x, (1.f - point.y) / 2.f * image_size.y};
+                        utils::Vector2f to = {(next_point.x + 1.f) / 2.f * image_size.x, (1.f - next_point.y) / 2.f * image_size.y};
+                        m_sprite_canvas.drawLineBatched(from, to, 1, {0.1, 0.4, 1., 1});
+                }
         }
 
         sprite.setScale(image_size.x / 2.f, image_size.y / 2.f);
@@ -332,6 +406,7 @@ void ToolBoxUI::drawEntityDesigner()
                 {
                         // redrawImage();
                 }
+                drawShapeFitter();
         }
 
         ImVec2 mouse_pos = ImGui::GetIO().MousePos;
@@ -378,6 +453,256 @@ void ToolBoxUI::drawEntityDesigner()
         ImGui::End();
 }
 
+void drawCullingStats(const char *name, const CullingStats &stats)
+{
+        ImGui::Text("%s: considered %zu, culled %zu, submitted %zu",
+                    name, stats.considered, stats.culled, stats.submitted);
+}
+
+void drawTreeQuality(const char *name, BoundingVolumeTree &tree)
+{
+        auto &stats = tree.getQualityStats();
+        ImGui::PushID(name);
+        ImGui::Text("%s: %zu objects, max depth: %d", name, tree.getObjectCount(), stats.max_depth);
+        float perimeter_per_leaf = tree.getObjectCount() > 0 ? stats.internal_perimeter / tree.getObjectCount() : 0.f;
+        ImGui::Text("Perimeter per leaf: %.1f (%.1f when built), Rebuilds: %zu",
+                    perimeter_per_leaf, stats.built_perimeter_per_leaf, stats.rebuild_count);
+        ImGui::Text("Nodes visited by queries: %zu", stats.frame_visited_nodes);
+        ImGui::Checkbox("Auto rebuild", &tree.quality_settings.auto_rebuild);
+        ImGui::SameLine();
+        if (ImGui::Button("Rebuild"))
+        {
+                tree.rebuild();
+        }
+        ImGui::SliderFloat("Rebuild threshold", &tree.quality_settings.rebuild_threshold, 1.f, 5.f);
+        ImGui::PopID();
+}
+
+void ToolBoxUI::drawPerformanceStats()
+{
+        auto &visibility = p_world->getVisibility();
+
+        ImGui::Begin("Performance");
+        //! one pool of workers is shared by collisions, the contact solver and boids
+        auto &workers = p_world->getWorkers();
+        int thread_count = static_cast<int>(workers.getThreadCount());
+        if (ImGui::SliderInt("Threads", &thread_count, 1, 8))
+        {
+                workers.setThreadCount(thread_count);
+        }
+        if (ImGui::CollapsingHeader("Culling", ImGuiTreeNodeFlags_DefaultOpen))
+        {
+                drawCullingStats("Entities", visibility.m_entity_stats);
+                drawCullingStats("Sprites", visibility.m_sprite_stats);
+                drawCullingStats("Particles", visibility.m_particle_stats);
+        }
+        if (ImGui::CollapsingHeader("Simulation LOD", ImGuiTreeNodeFlags_DefaultOpen))
+        {
+                auto &lod = p_world->getSimulationLOD();
+                auto &stats = lod.getStats();
+                ImGui::Text("Full: %zu, Reduced: %zu, Dormant: %zu",
+                            stats.getPopulation(SimulationTier::Full),
+                            stats.getPopulation(SimulationTier::Reduced),
+                            stats.getPopulation(SimulationTier::Dormant));
+                ImGui::Text("Updated: %zu, Skipped: %zu", stats.updated_count, stats.skipped_count);
+                ImGui::Text("Update time: %.3f ms, Saved: ~%.3f ms", stats.update_time_ms, stats.saved_time_ms);
+
+                ImGui::Checkbox("Enabled", &lod.m_settings.enabled);
+                ImGui::SliderFloat("Full radius", &lod.m_settings.full_radius, 100.f, 5000.f);
+                ImGui::SliderFloat("Dormant radius", &lod.m_settings.dormant_radius, 100.f, 10000.f);
+                ImGui::SliderInt("Reduced period", &lod.m_settings.reduced_period, 1, 20);
+        }
+        if (ImGui::CollapsingHeader("Collision trees"))
+        {
+                auto &collisions = p_world->getCollisionSystem();
+                drawTreeQuality("Colliders", collisions.getTree());
+                drawTreeQuality("Static colliders", collisions.getStaticTree());
+                ImGui::Text("Static colliders: %zu, rebuild this frame: %.3f ms", collisions.getStaticTree().getObjectCount(),
+                            collisions.m_broadphase_stats.static_rebuild_time_ms);
+
+                ImGui::Text("Leaf updates this frame (reinserted / in place):");
+                auto &update_stats = collisions.m_tree_update_stats;
+                for (std::size_t type_ind = 0; type_ind < update_stats.reinserts.size(); ++type_ind)
+                {
+                        if (update_stats.reinserts[type_ind] + update_stats.in_place_moves[type_ind] > 0)
+                        {
+                                auto type_name = magic_enum::enum_name(static_cast<ObjectType>(type_ind));
+                                ImGui::Text("  %.*s: %zu / %zu", static_cast<int>(type_name.size()), type_name.data(),
+                                            update_stats.reinserts[type_ind], update_stats.in_place_moves[type_ind]);
+                        }
+                }
+                ImGui::SliderFloat("Rect margin", &collisions.m_fat_rect_settings.margin, 0.f, 2.f);
+                ImGui::SliderFloat("Velocity lookahead", &collisions.m_fat_rect_settings.velocity_lookahead, 0.f, 2.f);
+        }
+        if (ImGui::CollapsingHeader("Collision pipeline"))
+        {
+                auto &collisions = p_world->getCollisionSystem();
+                auto &stats = collisions.m_pipeline_stats;
+                ImGui::Text("Transform: %.3f ms, %zu shapes recomputed", stats.transform_time_ms, stats.transformed_shape_count);
+                ImGui::Text("Refit: %.3f ms", stats.refit_time_ms);
+                ImGui::Text("Close pairs: %.3f ms", stats.pairs_time_ms);
+                ImGui::Text("Narrowphase: %.3f ms in %zu batches", stats.narrowphase_time_ms, stats.pair_batch_count);
+                ImGui::Text("Callbacks: %.3f ms", stats.dispatch_time_ms);
+                ImGui::Text("Cached pairs: %zu, %zu still separated by the cached axis", stats.cached_pair_count,
+                            stats.axis_early_out_count);
+                ImGui::Text("Swept pairs: %zu, %zu earliest contacts of continuous bodies", stats.swept_pair_count,
+                            stats.swept_contact_count);
+                ImGui::Text("Sensor pairs: %zu", stats.sensor_pair_count);
+        }
+        auto p_boids = p_world->m_systems.getSystem<BoidSystem>();
+        if (p_boids && ImGui::CollapsingHeader("Boids"))
+        {
+                auto &settings = p_boids->m_settings;
+                ImGui::SliderFloat("Max velocity", &settings.max_vel, 0.f, 200.f);
+                ImGui::SliderFloat("Scatter", &settings.scatter_multiplier, 0.f, 2000.f);
+                ImGui::SliderFloat("Align", &settings.align_multiplier, 0.f, 100.f);
+                ImGui::SliderFloat("Cohesion", &settings.cohesion_multiplier, 0.f, 100.f);
+                ImGui::SliderFloat("Seek", &settings.seek_multiplier, 0.f, 10.f);
+                ImGui::SliderFloat("Scatter range", &settings.scatter_range, 0.f, 100.f);
+                ImGui::SliderFloat("Align range", &settings.align_range, 0.f, 100.f);
+                ImGui::SliderFloat("Cohesion range", &settings.cohesion_range, 0.f, 100.f);
+                auto &stats = p_boids->getStats();
+                ImGui::Text("Boids: %zu, Neighbours: %zu", stats.boid_count, stats.neighbour_count);
+                ImGui::Text("Grid: %.3f ms, Steering: %.3f ms", stats.rebuild_time_ms, stats.steer_time_ms);
+        }
+        if (ImGui::CollapsingHeader("Contact solver"))
+        {
+                auto &solver = p_world->getCollisionSystem().m_solver;
+                auto &settings = solver.m_settings;
+                ImGui::SliderInt("Iterations", &settings.velocity_iterations, 1, 32);
+                ImGui::SliderFloat("Baumgarte", &settings.baumgarte, 0.f, 1.f);
+                ImGui::SliderFloat("Slop", &settings.penetration_slop, 0.f, 1.f);
+                ImGui::SliderFloat("Restitution threshold", &settings.restitution_threshold, 0.f, 50.f);
+                ImGui::Checkbox("Warm starting", &settings.warm_starting);
+                ImGui::Checkbox("Sleeping", &settings.allow_sleeping);
+                ImGui::SliderFloat("Sleep speed", &settings.sleep_speed, 0.f, 20.f);
+                ImGui::SliderFloat("Time to sleep", &settings.time_to_sleep, 0.f, 5.f);
+                ImGui::Text("Solve: %.3f ms, %zu contacts in %zu islands", solver.m_stats.solve_time_ms,
+                            solver.m_stats.contact_count, solver.m_stats.island_count);
+                ImGui::Text("Sleeping bodies: %zu", solver.m_stats.sleeping_body_count);
+        }
+        if (ImGui::CollapsingHeader("Collision trace"))
+        {
+                auto &trace = p_world->getCollisionSystem().m_trace;
+                bool is_enabled = trace.isEnabled();
+                if (ImGui::Checkbox("Record", &is_enabled))
+                {
+                        trace.setEnabled(is_enabled);
+                }
+                int capacity = static_cast<int>(trace.getCapacity());
+                if (ImGui::InputInt("Capacity", &capacity, 1024, 16384) && capacity > 0)
+                {
+                        trace.setCapacity(capacity);
+                }
+                ImGui::InputText("File", m_trace_path, sizeof(m_trace_path));
+                if (ImGui::Button("Dump"))
+                {
+                        m_trace_status = trace.dump(m_trace_path) ? "Dumped" : "Dump failed";
+                }
+                ImGui::SameLine();
+                if (ImGui::Button("Load"))
+                {
+                        m_trace_status = trace.load(m_trace_path) ? "Loaded" : "Load failed";
+                }
+                ImGui::SameLine();
+                if (ImGui::Button("Clear"))
+                {
+                        trace.clear();
+                }
+                ImGui::Text("%zu / %zu records. %s", trace.size(), trace.getCapacity(), m_trace_status.c_str());
+
+                //! newest records first, the clipper only lays out the visible rows
+                if (ImGui::BeginTable("Trace", 6, ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders,
+                                      ImVec2(0.f, 300.f)))
+                {
+                        ImGui::TableSetupScrollFreeze(0, 1);
+                        for (auto column : {"Tick", "Entity a", "Entity b", "Depth", "Axis", "Contact"})
+                        {
+                                ImGui::TableSetupColumn(column);
+                        }
+                        ImGui::TableHeadersRow();
+                        ImGuiListClipper clipper;
+                        clipper.Begin(static_cast<int>(trace.size()));
+                        while (clipper.Step())
+                        {
+                                for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+                                {
+                                        const auto &record = trace.at(trace.size() - 1 - row);
+                                        auto type_a = magic_enum::enum_name(record.type_a);
+                                        auto type_b = magic_enum::enum_name(record.type_b);
+                                        ImGui::TableNextRow();
+                                        ImGui::TableNextColumn();
+                                        ImGui::Text("%llu", static_cast<unsigned long long>(record.tick));
+                                        ImGui::TableNextColumn();
+                                        ImGui::Text("%.*s %d", static_cast<int>(type_a.size()), type_a.data(), record.id_a);
+                                        ImGui::TableNextColumn();
+                                        ImGui::Text("%.*s %d", static_cast<int>(type_b.size()), type_b.data(), record.id_b);
+                                        ImGui::TableNextColumn();
+                                        ImGui::Text("%.3f", record.minimum_translation);
+                                        ImGui::TableNextColumn();
+                                        ImGui::Text("%.2f, %.2f", record.separation_axis.x, record.separation_axis.y);
+                                        ImGui::TableNextColumn();
+                                        ImGui::Text("%.1f, %.1f", record.contact_point.x, record.contact_point.y);
+                                }
+                        }
+                        ImGui::EndTable();
+                }
+        }
+        if (ImGui::CollapsingHeader("Broadphase"))
+        {
+                auto &collisions = p_world->getCollisionSystem();
+                auto &broadphase_stats = collisions.m_broadphase_stats;
+                bool uses_sweep = collisions.getBroadphase() == Collisions::Broadphase::SweepAndPrune;
+                if (ImGui::Checkbox("Sweep and prune", &uses_sweep))
+                {
+                        collisions.setBroadphase(uses_sweep ? Collisions::Broadphase::SweepAndPrune
+                                                            : Collisions::Broadphase::BoundingVolumeTree);
+                }
+                if (uses_sweep)
+                {
+                        ImGui::Text("Sweep sorted in %.3f ms with %zu swaps", broadphase_stats.sweep_sort_time_ms,
+                                    broadphase_stats.sweep_swaps);
+                }
+                ImGui::Text("Self query: %.3f ms, %zu overlapping rects, %zu passed layers",
+                            collisions.m_pipeline_stats.pairs_time_ms, broadphase_stats.candidate_pair_count,
+                            broadphase_stats.accepted_pair_count);
+
+                std::vector<std::pair<std::pair<int, int>, const Collisions::Resolver *>> resolvers;
+                for (auto &[type_pair, resolver] : collisions.getResolvers())
+                {
+                        resolvers.push_back({type_pair, &resolver});
+                }
+                std::sort(resolvers.begin(), resolvers.end(), [](const auto &a, const auto &b)
+                          { return a.first < b.first; });
+                for (auto &[type_pair, p_resolver] : resolvers)
+                {
+                        auto type_name_a = magic_enum::enum_name(static_cast<ObjectType>(type_pair.first));
+                        auto type_name_b = magic_enum::enum_name(static_cast<ObjectType>(type_pair.second));
+                        ImGui::Text("%.*s - %.*s: %zu pairs", static_cast<int>(type_name_a.size()), type_name_a.data(),
+                                    static_cast<int>(type_name_b.size()), type_name_b.data(), p_resolver->close_pair_count);
+                }
+        }
+        if (ImGui::CollapsingHeader("Spawning"))
+        {
+                auto &stats = p_world->getSpawnStats();
+                ImGui::Text("Last batch: %zu entities in %.3f ms", stats.batch_size, stats.insertion_time_ms);
+                for (std::size_t meteor_count : {300, 3000, 30000})
+                {
+                        auto label = "Spawn " + std::to_string(meteor_count) + " meteors";
+                        if (ImGui::Button(label.c_str()))
+                        {
+                                auto center = p_world->m_player->getPosition();
+                                float spread = 3000.f * std::sqrt(meteor_count / 300.f);
+                                for (auto p_meteor : p_world->spawnBatch<Meteor>(meteor_count))
+                                {
+                                        p_meteor->setPosition(center + randf(200, spread) * utils::angle2dir(randf(0, 360)));
+                                }
+                        }
+                }
+        }
+        ImGui::End();
+}
+
 void ToolBoxUI::draw()
 {
 
@@ -390,6 +715,7 @@ void ToolBoxUI::draw()
         //         ImGui::ShowDemoWindow(&show_demo_window);
 
         drawEntityDesigner();
+        drawPerformanceStats();
 
         // Rendering
         ImGui::Render();
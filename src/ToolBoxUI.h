@@ -10,6 +10,8 @@
 #include <imgui.h>
 #include <queue>
 
+#include "ShapeDecomposition.h"
+
 class GameWorld;
 
 class ToolBoxUI
@@ -25,8 +27,11 @@ public:
 
 private:
         void drawEntityDesigner();
+        void drawPerformanceStats();
 
         void redrawImage();
+        utils::Vector2f getDrawnImageSize();
+        void drawShapeFitter();
 
         bool isInImage(ImVec2 point);
 
@@ -41,6 +46,9 @@ private:
         std::string m_selected_texture_name = "";
         std::vector<std::filesystem::path> m_texture_paths; 
         std::filesystem::path m_texture_directory = "../Resources/Textures/";
+
+        char m_trace_path[256] = "collision_trace.bin"; //! where the collision trace is dumped
+        std::string m_trace_status = "";
         
         TextureHolder m_textures;
         
@@ -74,4 +82,10 @@ private:
         ImVec2 m_image_size;
         ImVec2 m_image_min;
 
+        //! collision shape fitted to the alpha of the selected texture
+        ShapeFitSettings m_shape_fit_settings;
+        ShapeFit m_shape_fit;
+        std::filesystem::path m_collision_shapes_path = std::string(RESOURCES_DIR) + "/CollisionShapes.json"; //! read by EnemyFactory
+        std::string m_shape_fit_status = "";
+
 };
\ No newline at end of file
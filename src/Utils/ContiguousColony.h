@@ -1,6 +1,9 @@
 #pragma once
 
 #include <vector>
+#include <algorithm>
+#include <functional>
+#include <cassert>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -40,6 +43,10 @@ struct ContiguousColony
     {
         return data.at(id2data_ind.at(id));
     }
+    const DataType &get(IdType id) const
+    {
+        return data.at(id2data_ind.at(id));
+    }
 
     void erase(IdType id)
     {
@@ -57,6 +64,51 @@ struct ContiguousColony
         id2data_ind.erase(id);
     }
 
+    //! \brief erases all data with \p ids, ids not in the colony are ignored
+    //! \brief the order of the remaining data is not preserved
+    void erase(const std::vector<IdType> &ids)
+    {
+        //! few erased ids are cheapest to swap and pop one by one
+        if (ids.size() * 8 < data.size())
+        {
+            for (auto id : ids)
+            {
+                if (contains(id))
+                {
+                    erase(id);
+                }
+            }
+            return;
+        }
+
+        std::vector<std::size_t> erased_inds;
+        erased_inds.reserve(ids.size());
+        for (auto id : ids)
+        {
+            auto it = id2data_ind.find(id);
+            if (it != id2data_ind.end())
+            {
+                erased_inds.push_back(it->second);
+                id2data_ind.erase(it);
+            }
+        }
+
+        //! going from the back guarantees the moved element is never an erased one
+        std::sort(erased_inds.begin(), erased_inds.end(), std::greater<>());
+        for (auto data_ind : erased_inds)
+        {
+            std::size_t last_ind = data.size() - 1;
+            if (data_ind != last_ind)
+            {
+                data[data_ind] = std::move(data[last_ind]);
+                data_ind2id[data_ind] = data_ind2id[last_ind];
+                id2data_ind.at(data_ind2id[data_ind]) = data_ind;
+            }
+            data.pop_back();
+            data_ind2id.pop_back();
+        }
+    }
+
     bool isEmpty() const
     {
         return data.empty();
@@ -98,6 +150,12 @@ struct ContiguousColony
         return id2data_ind.contains(id);
     }
 
+    //! \returns index of the data of \p id, valid until the colony changes
+    std::size_t getIndex(IdType id) const
+    {
+        return id2data_ind.at(id);
+    }
+
 public:
     std::vector<DataType> data;
     std::vector<IdType> data_ind2id;
@@ -136,6 +194,22 @@ public:
         return id;
     }
 
+    //! \brief reserves \p count ids at once, freed ids are reused first
+    std::vector<int> reserveIndicesForInsertion(std::size_t count)
+    {
+        std::size_t reused_count = std::min(count, m_free_list.size());
+        std::vector<int> ids(m_free_list.rbegin(), m_free_list.rbegin() + reused_count);
+        m_free_list.resize(m_free_list.size() - reused_count);
+        m_next_id += static_cast<int>(reused_count);
+
+        ids.reserve(count);
+        while (ids.size() < count)
+        {
+            ids.push_back(m_next_id++);
+        }
+        return ids;
+    }
+
     void insertAt(int index, auto&& datum)
     {
         assert(!m_data.contains(index));
@@ -163,6 +237,13 @@ public:
         m_next_id--;
     }
 
+    void remove(const std::vector<int> &ids)
+    {
+        m_data.erase(ids);
+        m_free_list.insert(m_free_list.end(), ids.begin(), ids.end());
+        m_next_id -= static_cast<int>(ids.size());
+    }
+
 private:
     int m_next_id = 0;
     ContiguousColony<DataType, int> m_data;
@@ -0,0 +1,459 @@
+#include "PngReader.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+namespace
+{
+
+    //! \brief reads bits of a deflate stream starting from the least significant ones
+    struct BitReader
+    {
+        const std::uint8_t *data;
+        std::size_t size;
+        std::size_t position = 0;
+        std::uint32_t bit_buffer = 0;
+        int bit_count = 0;
+        bool is_exhausted = false;
+
+        int readBits(int count)
+        {
+            while (bit_count < count)
+            {
+                if (position >= size)
+                {
+                    is_exhausted = true;
+                    return 0;
+                }
+                bit_buffer |= static_cast<std::uint32_t>(data[position++]) << bit_count;
+                bit_count += 8;
+            }
+            int value = static_cast<int>(bit_buffer & ((1u << count) - 1));
+            bit_buffer >>= count;
+            bit_count -= count;
+            return value;
+        }
+
+        void alignToByte()
+        {
+            bit_buffer = 0;
+            bit_count = 0;
+        }
+    };
+
+    constexpr int k_max_code_length = 15;
+
+    //! \brief canonical Huffman code given by the number of codes of each length and symbols sorted by their codes
+    struct Huffman
+    {
+        std::array<std::uint16_t, k_max_code_length + 1> counts = {};
+        std::vector<std::uint16_t> symbols;
+
+        void build(const std::uint8_t *lengths, std::size_t symbol_count)
+        {
+            counts.fill(0);
+            for (std::size_t symbol = 0; symbol < symbol_count; ++symbol)
+            {
+                counts[lengths[symbol]]++;
+            }
+            std::array<std::uint16_t, k_max_code_length + 1> offsets = {};
+            for (int length = 1; length < k_max_code_length; ++length)
+            {
+                offsets[length + 1] = offsets[length] + counts[length];
+            }
+            symbols.assign(symbol_count, 0);
+            for (std::size_t symbol = 0; symbol < symbol_count; ++symbol)
+            {
+                if (lengths[symbol] != 0)
+                {
+                    symbols[offsets[lengths[symbol]]++] = static_cast<std::uint16_t>(symbol);
+                }
+            }
+        }
+
+        //! \returns decoded symbol or -1 if the stream does not contain a valid code
+        int decode(BitReader &reader) const
+        {
+            int code = 0;
+            int first = 0;
+            int index = 0;
+            for (int length = 1; length <= k_max_code_length; ++length)
+            {
+                code |= reader.readBits(1);
+                int count = counts[length];
+                if (code - count < first)
+                {
+                    return symbols[index + (code - first)];
+                }
+                index += count;
+                first += count;
+                first <<= 1;
+                code <<= 1;
+            }
+            return -1;
+        }
+    };
+
+    constexpr std::array<std::uint16_t, 29> k_length_bases = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                                              35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    constexpr std::array<std::uint8_t, 29> k_length_extra_bits = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                                                  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    constexpr std::array<std::uint16_t, 30> k_distance_bases = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                                                193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                                                6145, 8193, 12289, 16385, 24577};
+    constexpr std::array<std::uint8_t, 30> k_distance_extra_bits = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                                                    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    bool inflateBlock(BitReader &reader, const Huffman &lengths, const Huffman &distances, std::vector<std::uint8_t> &output)
+    {
+        while (true)
+        {
+            int symbol = lengths.decode(reader);
+            if (symbol < 0 || reader.is_exhausted)
+            {
+                return false;
+            }
+            if (symbol < 256)
+            {
+                output.push_back(static_cast<std::uint8_t>(symbol));
+                continue;
+            }
+            if (symbol == 256)
+            {
+                return true;
+            }
+            symbol -= 257;
+            if (symbol >= static_cast<int>(k_length_bases.size()))
+            {
+                return false;
+            }
+            std::size_t length = k_length_bases[symbol] + reader.readBits(k_length_extra_bits[symbol]);
+            int distance_symbol = distances.decode(reader);
+            if (distance_symbol < 0 || distance_symbol >= static_cast<int>(k_distance_bases.size()))
+            {
+                return false;
+            }
+            std::size_t distance = k_distance_bases[distance_symbol] + reader.readBits(k_distance_extra_bits[distance_symbol]);
+            if (distance > output.size())
+            {
+                return false;
+            }
+            //! the copied range can overlap the end of the output, so bytes are copied one by one
+            auto from = output.size() - distance;
+            for (std::size_t i = 0; i < length; ++i)
+            {
+                output.push_back(output[from + i]);
+            }
+        }
+    }
+
+    bool readDynamicCodes(BitReader &reader, Huffman &lengths, Huffman &distances)
+    {
+        constexpr std::array<std::uint8_t, 19> k_code_length_order = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+        int length_count = reader.readBits(5) + 257;
+        int distance_count = reader.readBits(5) + 1;
+        int code_length_count = reader.readBits(4) + 4;
+
+        std::array<std::uint8_t, 19> code_length_lengths = {};
+        for (int i = 0; i < code_length_count; ++i)
+        {
+            code_length_lengths[k_code_length_order[i]] = static_cast<std::uint8_t>(reader.readBits(3));
+        }
+        Huffman code_lengths;
+        code_lengths.build(code_length_lengths.data(), code_length_lengths.size());
+
+        std::array<std::uint8_t, 288 + 32> all_lengths = {};
+        int index = 0;
+        while (index < length_count + distance_count)
+        {
+            int symbol = code_lengths.decode(reader);
+            if (symbol < 0 || reader.is_exhausted)
+            {
+                return false;
+            }
+            if (symbol < 16)
+            {
+                all_lengths[index++] = static_cast<std::uint8_t>(symbol);
+                continue;
+            }
+            std::uint8_t repeated = 0;
+            int repeat_count = 0;
+            if (symbol == 16)
+            {
+                if (index == 0)
+                {
+                    return false;
+                }
+                repeated = all_lengths[index - 1];
+                repeat_count = 3 + reader.readBits(2);
+            }
+            else if (symbol == 17)
+            {
+                repeat_count = 3 + reader.readBits(3);
+            }
+            else
+            {
+                repeat_count = 11 + reader.readBits(7);
+            }
+            if (index + repeat_count > length_count + distance_count)
+            {
+                return false;
+            }
+            for (int i = 0; i < repeat_count; ++i)
+            {
+                all_lengths[index++] = repeated;
+            }
+        }
+        lengths.build(all_lengths.data(), length_count);
+        distances.build(all_lengths.data() + length_count, distance_count);
+        return true;
+    }
+
+    //! \brief decompresses a zlib stream, the checksum is not verified
+    bool inflateZlib(const std::vector<std::uint8_t> &compressed, std::vector<std::uint8_t> &output)
+    {
+        if (compressed.size() < 2 || (compressed[0] & 0x0f) != 8 || ((compressed[0] << 8) | compressed[1]) % 31 != 0)
+        {
+            return false;
+        }
+        BitReader reader{compressed.data() + 2, compressed.size() - 2};
+
+        Huffman fixed_lengths;
+        Huffman fixed_distances;
+        {
+            std::array<std::uint8_t, 288> lengths;
+            std::fill(lengths.begin(), lengths.begin() + 144, 8);
+            std::fill(lengths.begin() + 144, lengths.begin() + 256, 9);
+            std::fill(lengths.begin() + 256, lengths.begin() + 280, 7);
+            std::fill(lengths.begin() + 280, lengths.end(), 8);
+            fixed_lengths.build(lengths.data(), lengths.size());
+            std::array<std::uint8_t, 30> distance_lengths;
+            distance_lengths.fill(5);
+            fixed_distances.build(distance_lengths.data(), distance_lengths.size());
+        }
+
+        bool is_last = false;
+        while (!is_last)
+        {
+            is_last = reader.readBits(1);
+            int type = reader.readBits(2);
+            if (reader.is_exhausted)
+            {
+                return false;
+            }
+            if (type == 0) //! stored block
+            {
+                reader.alignToByte();
+                if (reader.position + 4 > reader.size)
+                {
+                    return false;
+                }
+                std::size_t length = compressed[2 + reader.position] | (compressed[2 + reader.position + 1] << 8);
+                reader.position += 4;
+                if (reader.position + length > reader.size)
+                {
+                    return false;
+                }
+                output.insert(output.end(), reader.data + reader.position, reader.data + reader.position + length);
+                reader.position += length;
+            }
+            else if (type == 1)
+            {
+                if (!inflateBlock(reader, fixed_lengths, fixed_distances, output))
+                {
+                    return false;
+                }
+            }
+            else if (type == 2)
+            {
+                Huffman lengths;
+                Huffman distances;
+                if (!readDynamicCodes(reader, lengths, distances) || !inflateBlock(reader, lengths, distances, output))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::uint32_t readBigEndian(const std::uint8_t *bytes)
+    {
+        return (std::uint32_t(bytes[0]) << 24) | (std::uint32_t(bytes[1]) << 16) | (std::uint32_t(bytes[2]) << 8) | bytes[3];
+    }
+
+    std::uint8_t paethPredictor(int left, int up, int up_left)
+    {
+        int estimate = left + up - up_left;
+        int distance_left = std::abs(estimate - left);
+        int distance_up = std::abs(estimate - up);
+        int distance_up_left = std::abs(estimate - up_left);
+        if (distance_left <= distance_up && distance_left <= distance_up_left)
+        {
+            return static_cast<std::uint8_t>(left);
+        }
+        return static_cast<std::uint8_t>(distance_up <= distance_up_left ? up : up_left);
+    }
+
+} //! namespace
+
+bool readPng(const std::filesystem::path &path, RgbaImage &image)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cout << "Cannot open image: " << path.string() << std::endl;
+        return false;
+    }
+    std::vector<std::uint8_t> file_data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (!decodePng(file_data, image))
+    {
+        std::cout << "Cannot decode image: " << path.string() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool decodePng(const std::vector<std::uint8_t> &file_data, RgbaImage &image)
+{
+    constexpr std::array<std::uint8_t, 8> k_signature = {137, 80, 78, 71, 13, 10, 26, 10};
+    if (file_data.size() < k_signature.size() || !std::equal(k_signature.begin(), k_signature.end(), file_data.begin()))
+    {
+        return false;
+    }
+
+    std::size_t width = 0;
+    std::size_t height = 0;
+    int color_type = -1;
+    std::vector<std::uint8_t> palette;
+    std::vector<std::uint8_t> palette_alphas;
+    std::vector<std::uint8_t> compressed;
+    std::size_t position = k_signature.size();
+    while (position + 12 <= file_data.size())
+    {
+        std::size_t length = readBigEndian(&file_data[position]);
+        const auto *type = &file_data[position + 4];
+        const auto *chunk = &file_data[position + 8];
+        if (position + 12 + length > file_data.size())
+        {
+            return false;
+        }
+        std::string chunk_type(type, type + 4);
+        if (chunk_type == "IHDR")
+        {
+            if (length < 13)
+            {
+                return false;
+            }
+            width = readBigEndian(chunk);
+            height = readBigEndian(chunk + 4);
+            int bit_depth = chunk[8];
+            color_type = chunk[9];
+            int interlace = chunk[12];
+            if (bit_depth != 8 || interlace != 0)
+            {
+                return false;
+            }
+        }
+        else if (chunk_type == "PLTE")
+        {
+            palette.assign(chunk, chunk + length);
+        }
+        else if (chunk_type == "tRNS")
+        {
+            palette_alphas.assign(chunk, chunk + length);
+        }
+        else if (chunk_type == "IDAT")
+        {
+            compressed.insert(compressed.end(), chunk, chunk + length);
+        }
+        else if (chunk_type == "IEND")
+        {
+            break;
+        }
+        position += 12 + length;
+    }
+
+    std::size_t channels = 0;
+    switch (color_type)
+    {
+    case 0: channels = 1; break; //! grayscale
+    case 2: channels = 3; break; //! RGB
+    case 3: channels = 1; break; //! palette
+    case 4: channels = 2; break; //! grayscale with alpha
+    case 6: channels = 4; break; //! RGBA
+    default: return false;
+    }
+
+    std::vector<std::uint8_t> filtered;
+    filtered.reserve(height * (width * channels + 1));
+    if (width == 0 || height == 0 || !inflateZlib(compressed, filtered) || filtered.size() < height * (width * channels + 1))
+    {
+        return false;
+    }
+
+    //! each row starts with its filter type and is predicted from the previous row
+    const std::size_t stride = width * channels;
+    std::vector<std::uint8_t> raw(height * stride);
+    for (std::size_t y = 0; y < height; ++y)
+    {
+        const auto filter = filtered[y * (stride + 1)];
+        const auto *in = &filtered[y * (stride + 1) + 1];
+        auto *out = &raw[y * stride];
+        const auto *previous = y > 0 ? &raw[(y - 1) * stride] : nullptr;
+        for (std::size_t i = 0; i < stride; ++i)
+        {
+            int left = i >= channels ? out[i - channels] : 0;
+            int up = previous ? previous[i] : 0;
+            int up_left = previous && i >= channels ? previous[i - channels] : 0;
+            switch (filter)
+            {
+            case 0: out[i] = in[i]; break;
+            case 1: out[i] = static_cast<std::uint8_t>(in[i] + left); break;
+            case 2: out[i] = static_cast<std::uint8_t>(in[i] + up); break;
+            case 3: out[i] = static_cast<std::uint8_t>(in[i] + (left + up) / 2); break;
+            case 4: out[i] = static_cast<std::uint8_t>(in[i] + paethPredictor(left, up, up_left)); break;
+            default: return false;
+            }
+        }
+    }
+
+    image.width = width;
+    image.height = height;
+    image.pixels.resize(width * height * 4);
+    for (std::size_t pixel = 0; pixel < width * height; ++pixel)
+    {
+        const auto *in = &raw[pixel * channels];
+        auto *out = &image.pixels[pixel * 4];
+        switch (color_type)
+        {
+        case 0: out[0] = out[1] = out[2] = in[0]; out[3] = 255; break;
+        case 2: out[0] = in[0]; out[1] = in[1]; out[2] = in[2]; out[3] = 255; break;
+        case 3:
+        {
+            std::size_t entry = in[0];
+            if (3 * entry + 2 >= palette.size())
+            {
+                return false;
+            }
+            out[0] = palette[3 * entry];
+            out[1] = palette[3 * entry + 1];
+            out[2] = palette[3 * entry + 2];
+            out[3] = entry < palette_alphas.size() ? palette_alphas[entry] : 255;
+            break;
+        }
+        case 4: out[0] = out[1] = out[2] = in[0]; out[3] = in[1]; break;
+        case 6: std::copy(in, in + 4, out); break;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+//! \brief pixels of an image in rows from the top, 4 bytes per pixel in order red, green, blue, alpha
+struct RgbaImage
+{
+    std::size_t width = 0;
+    std::size_t height = 0;
+    std::vector<std::uint8_t> pixels;
+
+    std::uint8_t getAlpha(std::size_t x, std::size_t y) const
+    {
+        return pixels[4 * (y * width + x) + 3];
+    }
+};
+
+//! \brief decodes PNG files on the CPU, so that tools can read textures without a GPU context
+//! \brief supports 8 bit grayscale, RGB, palette, grayscale with alpha and RGBA images which are not interlaced
+bool readPng(const std::filesystem::path &path, RgbaImage &image);
+bool decodePng(const std::vector<std::uint8_t> &file_data, RgbaImage &image);
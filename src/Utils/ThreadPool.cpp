@@ -0,0 +1,133 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace utils
+{
+
+    ThreadPool::ThreadPool(std::size_t thread_count)
+    {
+        setThreadCount(thread_count);
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        stopWorkers();
+    }
+
+    //! \returns number of hardware threads, at most 8 since the workloads are small
+    std::size_t ThreadPool::defaultThreadCount()
+    {
+#ifdef __EMSCRIPTEN__
+        return 1;
+#else
+        return std::clamp<std::size_t>(std::thread::hardware_concurrency(), 1, 8);
+#endif
+    }
+
+    //! \param thread_count  total number of threads working on tasks including the calling one
+    void ThreadPool::setThreadCount(std::size_t thread_count)
+    {
+#ifdef __EMSCRIPTEN__
+        thread_count = 1;
+#endif
+        thread_count = std::max<std::size_t>(thread_count, 1);
+        if (thread_count == getThreadCount())
+        {
+            return;
+        }
+
+        stopWorkers();
+        m_stop = false;
+        for (std::size_t thread_index = 1; thread_index < thread_count; ++thread_index)
+        {
+            m_workers.emplace_back(&ThreadPool::workerLoop, this, thread_index, m_generation);
+        }
+    }
+
+    std::size_t ThreadPool::getThreadCount() const
+    {
+        return m_workers.size() + 1;
+    }
+
+    //! \brief calls \p task(task_index, thread_index) for each task_index in [0, \p task_count)
+    //! \brief and returns when all of them are finished, thread_index is 0 for the calling thread
+    void ThreadPool::parallelFor(std::size_t task_count, const TaskT &task)
+    {
+        if (m_workers.empty() || task_count <= 1)
+        {
+            for (std::size_t task_index = 0; task_index < task_count; ++task_index)
+            {
+                task(task_index, 0);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            p_task = &task;
+            m_task_count = task_count;
+            m_next_task = 0;
+            m_busy_workers = m_workers.size();
+            m_generation++;
+        }
+        m_wake_workers.notify_all();
+
+        work(0);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_workers_done.wait(lock, [this]
+                            { return m_busy_workers == 0; });
+        p_task = nullptr;
+    }
+
+    void ThreadPool::stopWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake_workers.notify_all();
+        for (auto &worker : m_workers)
+        {
+            worker.join();
+        }
+        m_workers.clear();
+    }
+
+    void ThreadPool::workerLoop(std::size_t thread_index, std::size_t seen_generation)
+    {
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake_workers.wait(lock, [&]
+                                    { return m_stop || m_generation != seen_generation; });
+                if (m_stop)
+                {
+                    return;
+                }
+                seen_generation = m_generation;
+            }
+
+            work(thread_index);
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busy_workers--;
+            if (m_busy_workers == 0)
+            {
+                m_workers_done.notify_one();
+            }
+        }
+    }
+
+    //! \brief takes tasks one by one until there are none left
+    void ThreadPool::work(std::size_t thread_index)
+    {
+        for (auto task_index = m_next_task++; task_index < m_task_count; task_index = m_next_task++)
+        {
+            (*p_task)(task_index, thread_index);
+        }
+    }
+
+} //! namespace utils
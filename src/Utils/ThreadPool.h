@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace utils
+{
+
+    //! \brief fixed set of worker threads executing indexed tasks, the calling thread works as well
+    //! \brief builds without thread support (emscripten) run everything on the calling thread
+    class ThreadPool
+    {
+    public:
+        using TaskT = std::function<void(std::size_t task_index, std::size_t thread_index)>;
+
+        explicit ThreadPool(std::size_t thread_count = defaultThreadCount());
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        void setThreadCount(std::size_t thread_count);
+        std::size_t getThreadCount() const;
+
+        void parallelFor(std::size_t task_count, const TaskT &task);
+
+        static std::size_t defaultThreadCount();
+
+    private:
+        void stopWorkers();
+        void workerLoop(std::size_t thread_index, std::size_t seen_generation);
+        void work(std::size_t thread_index);
+
+    private:
+        std::vector<std::thread> m_workers;
+
+        std::mutex m_mutex;
+        std::condition_variable m_wake_workers;
+        std::condition_variable m_workers_done;
+
+        const TaskT *p_task = nullptr;
+        std::size_t m_task_count = 0;
+        std::atomic<std::size_t> m_next_task = 0;
+        std::size_t m_busy_workers = 0;
+        std::size_t m_generation = 0; //! increased with each parallelFor, so that workers know there is new work
+        bool m_stop = false;
+    };
+
+} //! namespace utils
@@ -0,0 +1,115 @@
+#include "VisibilityIndex.h"
+
+#include <algorithm>
+
+#include <View.h>
+
+#include "GameObject.h"
+
+//! \brief creates a square rect containing entity at \p pos with \p size in any rotation and its margin
+AABB VisibilityIndex::makeRect(int entity_id, utils::Vector2f pos, utils::Vector2f size) const
+{
+    float radius = utils::norm(size) / 2.f;
+    if (!m_margins.empty())
+    {
+        auto it = m_margins.find(entity_id);
+        if (it != m_margins.end())
+        {
+            radius += it->second;
+        }
+    }
+    return {pos - utils::Vector2f{radius, radius}, pos + utils::Vector2f{radius, radius}};
+}
+
+void VisibilityIndex::insert(int entity_id, utils::Vector2f pos, utils::Vector2f size)
+{
+    m_tree.addRect(makeRect(entity_id, pos, size).inflate(1.5f), entity_id);
+}
+
+void VisibilityIndex::insert(const std::vector<GameObject *> &entities)
+{
+    std::vector<AABB> rects;
+    std::vector<int> entity_ids;
+    rects.reserve(entities.size());
+    entity_ids.reserve(entities.size());
+    for (auto p_entity : entities)
+    {
+        rects.push_back(makeRect(p_entity->getId(), p_entity->getPosition(), p_entity->getSize()).inflate(1.5f));
+        entity_ids.push_back(p_entity->getId());
+    }
+    m_tree.addRects(rects, entity_ids);
+}
+
+void VisibilityIndex::remove(int entity_id)
+{
+    m_tree.removeObject(entity_id);
+    m_margins.erase(entity_id);
+}
+
+void VisibilityIndex::remove(const std::vector<int> &entity_ids)
+{
+    m_tree.removeObjects(entity_ids);
+    if (!m_margins.empty())
+    {
+        for (auto id : entity_ids)
+        {
+            m_margins.erase(id);
+        }
+    }
+}
+
+//! \brief reinserts the entity only if it left the inflated rect stored in the tree
+void VisibilityIndex::move(int entity_id, utils::Vector2f pos, utils::Vector2f size)
+{
+    auto fitting_rect = makeRect(entity_id, pos, size);
+    const auto &big_bounding_rect = m_tree.getObjectRect(entity_id);
+    if (makeUnion(fitting_rect, big_bounding_rect).volume() > big_bounding_rect.volume())
+    {
+        m_tree.moveObject(entity_id, fitting_rect.inflate(1.5f));
+    }
+}
+
+bool VisibilityIndex::contains(int entity_id) const
+{
+    return m_tree.containsObject(entity_id);
+}
+
+//! \brief the entity counts as visible when the view is within \p margin of its rect,
+//! \brief the rect in the tree grows on the next move()
+void VisibilityIndex::setMargin(int entity_id, float margin)
+{
+    if (margin > 0.f)
+    {
+        m_margins[entity_id] = margin;
+    }
+    else
+    {
+        m_margins.erase(entity_id);
+    }
+}
+
+void VisibilityIndex::setView(const View &view)
+{
+    //! the view can have flipped axes so we take absolute values
+    utils::Vector2f half_size = {std::abs(view.getSize().x) / 2.f, std::abs(view.getSize().y) / 2.f};
+    m_view_rect = {view.getCenter() - half_size, view.getCenter() + half_size};
+}
+
+//! \brief queries the tree for entities whose rects intersect the view rect
+void VisibilityIndex::findVisible()
+{
+    m_tree.updateQuality();
+    m_visible_ids.clear();
+    m_tree.findIntersectingLeaves(m_view_rect, m_visible_ids);
+    std::sort(m_visible_ids.begin(), m_visible_ids.end());
+}
+
+const std::vector<int> &VisibilityIndex::getVisible() const
+{
+    return m_visible_ids;
+}
+
+const AABB &VisibilityIndex::getViewRect() const
+{
+    return m_view_rect;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "BVH.h"
+
+#include <vector>
+#include <unordered_map>
+
+class View;
+class GameObject;
+
+//! \brief per frame numbers of renderables that went through culling
+struct CullingStats
+{
+    std::size_t considered = 0; //! how many renderables exist
+    std::size_t culled = 0;     //! how many of them were thrown away
+    std::size_t submitted = 0;  //! how many of them were sent to the renderer
+
+    void reset()
+    {
+        considered = 0;
+        culled = 0;
+        submitted = 0;
+    }
+};
+
+//! \brief spatial index of entity bounding rects used to find what is visible from the camera
+//! \brief entities are stored in a BVH with inflated rects, so that they are reinserted only when
+//! \brief they move out of their inflated rect
+class VisibilityIndex
+{
+
+public:
+    void insert(int entity_id, utils::Vector2f pos, utils::Vector2f size);
+    void insert(const std::vector<GameObject *> &entities);
+    void remove(int entity_id);
+    void remove(const std::vector<int> &entity_ids);
+    void move(int entity_id, utils::Vector2f pos, utils::Vector2f size);
+    bool contains(int entity_id) const;
+    void setMargin(int entity_id, float margin);
+
+    void setView(const View &view);
+    void findVisible();
+
+    const std::vector<int> &getVisible() const;
+
+    const AABB &getViewRect() const;
+
+private:
+    AABB makeRect(int entity_id, utils::Vector2f pos, utils::Vector2f size) const;
+
+public:
+    CullingStats m_entity_stats;
+    CullingStats m_sprite_stats;
+    CullingStats m_particle_stats;
+
+private:
+    BoundingVolumeTree m_tree;
+    AABB m_view_rect;
+
+    std::vector<int> m_visible_ids; //! sorted, so that the draw order is the same in each frame
+    std::unordered_map<int, float> m_margins; //! entities drawing things outside of their rect, like particle trails
+};
@@ -48,6 +48,11 @@ struct AABB
     {
         return (r_max.x - r_min.x) * (r_max.y - r_min.y);
     }
+
+    float perimeter() const
+    {
+        return 2.f * ((r_max.x - r_min.x) + (r_max.y - r_min.y));
+    }
 };
 
 inline AABB makeUnion(const AABB &r1, const AABB &r2)
@@ -70,6 +75,13 @@ bool inline intersects(const AABB &r1, const AABB &r2)
     return intersects_x && intersects_y;
 }
 
+//! \returns true if \p inner lies completely inside \p outer
+bool inline contains(const AABB &outer, const AABB &inner)
+{
+    return outer.r_min.x <= inner.r_min.x && outer.r_min.y <= inner.r_min.y &&
+           outer.r_max.x >= inner.r_max.x && outer.r_max.y >= inner.r_max.y;
+}
+
 struct Projection1D
 {
   float min = std::numeric_limits<float>::max();